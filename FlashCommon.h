@@ -2,13 +2,21 @@
 #define NOWTECH_FLASHCOMMON
 
 #include <cstdint>
+#include <cstring>
+#include <algorithm>
 #include <type_traits>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 namespace nowtech::memory {
 
 enum class FlashCopies : uint8_t {
-  c1 = 1u,
-  c2 = 2u
+  c1            = 1u,
+  c2            = 2u,
+  c2Alternating = 3u  // two copies, each commit writes only the older one
 };
 
 enum class SpiResult : uint32_t {
@@ -30,7 +38,17 @@ enum class FlashException : uint32_t {
   cConfigInvalidId      = 5u,
   cConfigFull           = 6u,
   cConfigItemTooBig     = 7u,
-  cFlashTransferError   = 8u
+  cFlashTransferError   = 8u,
+  cConfigSchemaMismatch = 9u,
+  cBulkBadCopy1         = 10u, // CRC or consistency
+  cBulkBadCopy2         = 11u, // CRC or consistency
+  cBulkBadCopies        = 12u, // CRC or consistency
+  cBulkCopiesMismatch   = 13u,
+  cBulkInvalidId        = 14u,
+  cBulkFull             = 15u,
+  cBulkItemTooBig       = 16u,
+  cLeoBadPage           = 17u, // CRC or consistency
+  cErrorCounterFull     = 18u
 };
 
 // TODO these magic things would belong in FlashCommon, but some weird rule prevents the subclasses from easily accessing them
@@ -42,9 +60,48 @@ enum class Magic : uint8_t {
   cOnTimeOnly         =    4u,
   cLogOnTime          =    5u,
   cErrorCounterOnTime =    6u,
+  cConfigJournal      =    7u,
+  cConfigSeal         =    8u,
   cErased             = 0xff
 };
 
+enum class ConfigStorage : uint8_t {
+  cInline = 0u, // each item has its own buffer, and bigger values are allocated one by one
+  cArena  = 1u  // all values are back-to-back in a single allocation
+};
+
+enum class ConfigBoot : uint8_t {
+  cFull = 0u, // all pages are read and checked on boot
+  cLazy = 1u  // only the headers are read on boot, and the values of a page on its first access
+};
+
+enum class ConfigConcurrency : uint8_t {
+  cExclusive = 0u, // every call except getConfig needs mutual exclusion
+  cSeqlock   = 1u  // readConfig and setConfig may run concurrently with each other and with commit
+};
+
+enum class ConfigPacking : uint8_t {
+  cWhole    = 0u, // an item starts in a new page if it doesn't fit the rest of the current one
+  cSpanning = 1u  // an item may continue in the following pages, so the pages are filled completely
+};
+
+enum class ConfigPlacement : uint8_t {
+  cIdOrder = 0u, // the items are in the pages in id order
+  cHotTail = 1u  // compact may move the often changed items to their own sectors after the others
+};
+
+struct CommitStatistics final {
+  uint32_t mCommitCount;
+  uint32_t mSectorWriteCount; // sectors of the copies written by commit, a sector of each copy counts separately
+  uint32_t mSectorEraseCount;
+};
+
+enum class ChecksumKernel : uint8_t {
+  cScalar = 0u, // byte by byte, the reference implementation
+  cWord   = 1u, // 4 bytes at a time in 32-bit words
+  cSimd   = 2u  // 16 bytes at a time in SSE2 or NEON registers
+};
+
 template<Magic tMagic>
 static constexpr bool is(uint8_t const aValue) noexcept {
   return static_cast<Magic>(aValue) == tMagic;  // shortens to is<Magic::cErased>(value)
@@ -72,6 +129,68 @@ static void setValue(uint8_t * const aWhere, tType const aValue) noexcept {
   }
 }
 
+static constexpr uint32_t cBitsPerWord = 32u;
+
+static constexpr uint32_t getBitWordCount(uint32_t const aBitCount) noexcept {
+  return (aBitCount + cBitsPerWord - 1u) / cBitsPerWord;
+}
+
+/// aValue must not be 0.
+inline uint32_t countTrailingZeros(uint32_t const aValue) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<uint32_t>(__builtin_ctz(aValue));
+#else
+  uint32_t result = 0u;
+  for(uint32_t work = aValue; (work & 1u) == 0u; work >>= 1u) {
+    ++result;
+  }
+  return result;
+#endif
+}
+
+inline bool isBitSet(uint32_t const * const aWords, uint32_t const aIndex) noexcept {
+  return (aWords[aIndex / cBitsPerWord] & (1u << (aIndex % cBitsPerWord))) != 0u;
+}
+
+inline void setBit(uint32_t * const aWords, uint32_t const aIndex) noexcept {
+  aWords[aIndex / cBitsPerWord] |= 1u << (aIndex % cBitsPerWord);
+}
+
+/// Returns the index of the first set bit in [aBegin, aEnd), or aEnd if there is none.
+inline uint32_t findNextSetBit(uint32_t const * const aWords, uint32_t const aBegin, uint32_t const aEnd) noexcept {
+  uint32_t result = aEnd;
+  if(aBegin < aEnd) {
+    uint32_t wordIndex = aBegin / cBitsPerWord;
+    uint32_t const endWordIndex = getBitWordCount(aEnd);
+    uint32_t word = aWords[wordIndex] & (~0u << (aBegin % cBitsPerWord));
+    while(word == 0u && ++wordIndex < endWordIndex) {
+      word = aWords[wordIndex];
+    }
+    if(word != 0u) {
+      result = std::min(aEnd, wordIndex * cBitsPerWord + countTrailingZeros(word));
+    }
+    else { // nothing to do
+    }
+  }
+  else { // nothing to do
+  }
+  return result;
+}
+
+/// Detects the optional non-blocking interface extension:
+/// nowtech::memory::SpiResult startEraseSector(uint32_t const aSector) noexcept;
+/// nowtech::memory::SpiResult startWritePage(uint32_t const aPage, uint8_t const * const aData) noexcept;
+/// nowtech::memory::SpiResult pollBusy() noexcept; returning cBusy while the started operation is in progress.
+template<typename tInterface, typename = void>
+struct HasNonBlockingApi : std::false_type {
+};
+
+template<typename tInterface>
+struct HasNonBlockingApi<tInterface, std::void_t<decltype(tInterface::startEraseSector(0u)),
+                                                 decltype(tInterface::startWritePage(0u, nullptr)),
+                                                 decltype(tInterface::pollBusy())>> : std::true_type {
+};
+
 template<typename tInterface>
 class FlashCommon {
 protected:
@@ -90,7 +209,147 @@ protected:
   static constexpr uint8_t  cChecksumPrimeCount = cChecksumPrimeMask + 1u;
   static constexpr uint16_t cChecksumPrimeTable[cChecksumPrimeCount] = {0x049D, 0x0C07, 0x1591, 0x1ACF, 0x1D4B, 0x202D, 0x2507, 0x2B4B, 0x34A5, 0x38C5, 0x3D3F, 0x4445, 0x4D0F, 0x538F, 0x5FB3, 0x6BBF};
 
+#if defined(__SSE2__) || defined(__ARM_NEON)
+  static constexpr ChecksumKernel cChecksumKernel = (cPageSizeInBytes % cChecksumPrimeCount == 0u ? ChecksumKernel::cSimd : ChecksumKernel::cScalar);
+#else
+  static constexpr ChecksumKernel cChecksumKernel = (cPageSizeInBytes % cChecksumPrimeCount == 0u ? ChecksumKernel::cWord : ChecksumKernel::cScalar);
+#endif
+  static constexpr uint32_t cChecksumBlockCount      = cPageSizeInBytes / cChecksumPrimeCount;
+  static constexpr uint32_t cChecksumWordFlushBlocks = 256u; // 16-bit lanes in 32-bit words take at most this many 0xff bytes without carry
+
+  static constexpr bool     cNonBlocking             = HasNonBlockingApi<tInterface>::value;
+
+  /// These fall back to the blocking calls if the interface lacks the non-blocking extension.
+  /// The operation started must be waited for using waitWhileBusy before any other flash access.
+  static SpiResult startEraseSector(uint32_t const aSector) noexcept {
+    SpiResult result;
+    if constexpr(cNonBlocking) {
+      result = tInterface::startEraseSector(aSector);
+    }
+    else {
+      result = tInterface::eraseSector(aSector);
+    }
+    return result;
+  }
+
+  static SpiResult startWritePage(uint32_t const aPage, uint8_t const * const aData) noexcept {
+    SpiResult result;
+    if constexpr(cNonBlocking) {
+      result = tInterface::startWritePage(aPage, aData);
+    }
+    else {
+      result = tInterface::writePage(aPage, aData);
+    }
+    return result;
+  }
+
+  static SpiResult waitWhileBusy() noexcept {
+    SpiResult result = SpiResult::cOk;
+    if constexpr(cNonBlocking) {
+      do {
+        result = tInterface::pollBusy();
+      } while(result == SpiResult::cBusy);
+    }
+    else { // nothing to do
+    }
+    return result;
+  }
+
+  /// Returns the prime multiplier of the byte at aOffset in the page. The checksum field itself is skipped, so the
+  /// primes of the bytes after it are shifted by its size.
+  static constexpr uint16_t getChecksumPrime(uint32_t const aOffset) noexcept {
+    return cChecksumPrimeTable[(aOffset < cOffsetPageChecksum ? aOffset : aOffset - sizeof(uint16_t)) & cChecksumPrimeMask];
+  }
+
+  /// All kernels yield the same result. The wide ones rely on the prime table period being 16 bytes, so from the
+  /// second 16-byte block on every byte column has a fixed prime. Columns of XORed bytes are summed modulo 2^16 and
+  /// multiplied only once at the end, which is the same modulo 2^16 as multiplying each byte.
+  template<ChecksumKernel tKernel = cChecksumKernel>
   static uint16_t calculateChecksum(uint8_t const * const aData) noexcept {
+    uint16_t result;
+    if constexpr(tKernel == ChecksumKernel::cScalar) {
+      result = calculateChecksumScalar(aData);
+    }
+    else {
+      static_assert(cPageSizeInBytes % cChecksumPrimeCount == 0u, "Wide checksum kernels need whole 16-byte blocks.");
+      uint16_t columns[cChecksumPrimeCount];
+      if constexpr(tKernel == ChecksumKernel::cSimd) {
+        sumColumnsSimd(aData + cChecksumPrimeCount, cChecksumBlockCount - 1u, columns);
+      }
+      else {
+        sumColumnsWord(aData + cChecksumPrimeCount, cChecksumBlockCount - 1u, columns);
+      }
+      result = 0u;
+      for(uint32_t arrayIndex = 0u; arrayIndex < cChecksumPrimeCount; ++arrayIndex) {
+        if(arrayIndex < cOffsetPageChecksum || arrayIndex >= cOffsetPageChecksum + sizeof(uint16_t)) {
+          result += (aData[arrayIndex] ^ cChecksumXorValue) * getChecksumPrime(arrayIndex);
+        }
+        else { // nothing to do
+        }
+        result += static_cast<uint32_t>(columns[arrayIndex]) * getChecksumPrime(arrayIndex + cChecksumPrimeCount);
+      }
+    }
+    return result;
+  }
+
+  /// Checksum contribution of the bytes [aBegin, aEnd) of the page, so that the sum of the contributions of a
+  /// partition of the page yields calculateChecksum.
+  static uint16_t calculateChecksumPart(uint8_t const * const aData, uint32_t const aBegin, uint32_t const aEnd) noexcept {
+    uint16_t result = 0u;
+    for(uint32_t arrayIndex = aBegin; arrayIndex < aEnd; ++arrayIndex) {
+      if(arrayIndex < cOffsetPageChecksum || arrayIndex >= cOffsetPageChecksum + sizeof(uint16_t)) {
+        result += (aData[arrayIndex] ^ cChecksumXorValue) * getChecksumPrime(arrayIndex);
+      }
+      else { // nothing to do
+      }
+    }
+    return result;
+  }
+
+  /// Checksum contribution of the bytes [aBegin, aEnd) if all of them were aValue.
+  static constexpr uint16_t calculateChecksumFill(uint8_t const aValue, uint32_t const aBegin, uint32_t const aEnd) noexcept {
+    uint32_t primeSum = 0u;
+    uint32_t arrayIndex = aBegin;
+    for(; arrayIndex < aEnd && arrayIndex < cChecksumPrimeCount; ++arrayIndex) {
+      if(arrayIndex < cOffsetPageChecksum || arrayIndex >= cOffsetPageChecksum + sizeof(uint16_t)) {
+        primeSum += getChecksumPrime(arrayIndex);
+      }
+      else { // nothing to do
+      }
+    }
+    uint32_t periodSum = 0u;
+    for(uint32_t primeIndex = 0u; primeIndex < cChecksumPrimeCount; ++primeIndex) {
+      periodSum += cChecksumPrimeTable[primeIndex];
+    }
+    for(; arrayIndex + cChecksumPrimeCount <= aEnd; arrayIndex += cChecksumPrimeCount) {
+      primeSum += periodSum;
+    }
+    for(; arrayIndex < aEnd; ++arrayIndex) {
+      primeSum += getChecksumPrime(arrayIndex);
+    }
+    return static_cast<uint16_t>(primeSum * static_cast<uint32_t>(aValue ^ cChecksumXorValue));
+  }
+
+  /// Returns aChecksum updated by replacing aCount bytes at page offset aOffset from aOld to aNew.
+  /// The checksum field must not be among them.
+  static uint16_t updateChecksum(uint16_t const aChecksum, uint32_t const aOffset, uint8_t const * const aOld, uint8_t const * const aNew, uint32_t const aCount) noexcept {
+    uint16_t result = aChecksum;
+    for(uint32_t i = 0u; i < aCount; ++i) {
+      result += ((aNew[i] ^ cChecksumXorValue) - (aOld[i] ^ cChecksumXorValue)) * getChecksumPrime(aOffset + i);
+    }
+    return result;
+  }
+
+  /// Returns aChecksum updated by replacing aCount bytes at page offset aOffset, all being aOld, to aNew.
+  static uint16_t updateChecksum(uint16_t const aChecksum, uint32_t const aOffset, uint8_t const aOld, uint8_t const * const aNew, uint32_t const aCount) noexcept {
+    uint16_t result = aChecksum;
+    for(uint32_t i = 0u; i < aCount; ++i) {
+      result += ((aNew[i] ^ cChecksumXorValue) - (aOld ^ cChecksumXorValue)) * getChecksumPrime(aOffset + i);
+    }
+    return result;
+  }
+
+  static uint16_t calculateChecksumScalar(uint8_t const * const aData) noexcept {
     uint16_t result     = 0u;
     uint16_t primeIndex = 0u;
     for(uint32_t arrayIndex = 0u; arrayIndex < cOffsetPageChecksum; ++arrayIndex) {
@@ -103,6 +362,76 @@ protected:
     }
     return result;
   }
+
+  /// Sums the XORed bytes of aBlockCount 16-byte blocks column-wise into aColumns, modulo 2^16.
+  static void sumColumnsWord(uint8_t const * const aData, uint32_t const aBlockCount, uint16_t * const aColumns) noexcept {
+    static constexpr uint32_t cWordCount    = cChecksumPrimeCount / sizeof(uint32_t);
+    static constexpr uint32_t cXorWord      = 0x01010101u * cChecksumXorValue;
+    static constexpr uint32_t cLaneMask     = 0x00ff00ffu;
+    std::fill_n(aColumns, cChecksumPrimeCount, 0u);
+    uint32_t blockIndex = 0u;
+    while(blockIndex < aBlockCount) {
+      uint32_t const endBlockIndex = std::min(aBlockCount, blockIndex + cChecksumWordFlushBlocks);
+      uint32_t evenLanes[cWordCount] = {};
+      uint32_t oddLanes[cWordCount] = {};
+      for(; blockIndex < endBlockIndex; ++blockIndex) {
+        for(uint32_t wordIndex = 0u; wordIndex < cWordCount; ++wordIndex) {
+          uint32_t word;
+          std::memcpy(&word, aData + blockIndex * cChecksumPrimeCount + wordIndex * sizeof(uint32_t), sizeof(uint32_t));
+          word ^= cXorWord;
+          evenLanes[wordIndex] += word & cLaneMask;
+          oddLanes[wordIndex]  += (word >> 8u) & cLaneMask;
+        }
+      }
+      for(uint32_t wordIndex = 0u; wordIndex < cWordCount; ++wordIndex) {
+        uint16_t * const columns = aColumns + wordIndex * sizeof(uint32_t);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        columns[0u] += oddLanes[wordIndex] >> 16u;
+        columns[1u] += evenLanes[wordIndex] >> 16u;
+        columns[2u] += oddLanes[wordIndex];
+        columns[3u] += evenLanes[wordIndex];
+#else
+        columns[0u] += evenLanes[wordIndex];
+        columns[1u] += oddLanes[wordIndex];
+        columns[2u] += evenLanes[wordIndex] >> 16u;
+        columns[3u] += oddLanes[wordIndex] >> 16u;
+#endif
+      }
+    }
+  }
+
+#if defined(__SSE2__)
+  static void sumColumnsSimd(uint8_t const * const aData, uint32_t const aBlockCount, uint16_t * const aColumns) noexcept {
+    __m128i const xorValue = _mm_set1_epi8(static_cast<char>(cChecksumXorValue));
+    __m128i const zero     = _mm_setzero_si128();
+    __m128i low            = zero;
+    __m128i high           = zero;
+    for(uint32_t blockIndex = 0u; blockIndex < aBlockCount; ++blockIndex) {
+      __m128i const bytes = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<__m128i const *>(aData + blockIndex * cChecksumPrimeCount)), xorValue);
+      low  = _mm_add_epi16(low,  _mm_unpacklo_epi8(bytes, zero));
+      high = _mm_add_epi16(high, _mm_unpackhi_epi8(bytes, zero));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(aColumns), low);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(aColumns + cChecksumPrimeCount / 2u), high);
+  }
+#elif defined(__ARM_NEON)
+  static void sumColumnsSimd(uint8_t const * const aData, uint32_t const aBlockCount, uint16_t * const aColumns) noexcept {
+    uint8x16_t const xorValue = vdupq_n_u8(cChecksumXorValue);
+    uint16x8_t low            = vdupq_n_u16(0u);
+    uint16x8_t high           = vdupq_n_u16(0u);
+    for(uint32_t blockIndex = 0u; blockIndex < aBlockCount; ++blockIndex) {
+      uint8x16_t const bytes = veorq_u8(vld1q_u8(aData + blockIndex * cChecksumPrimeCount), xorValue);
+      low  = vaddw_u8(low,  vget_low_u8(bytes));
+      high = vaddw_u8(high, vget_high_u8(bytes));
+    }
+    vst1q_u16(aColumns, low);
+    vst1q_u16(aColumns + cChecksumPrimeCount / 2u, high);
+  }
+#else
+  static void sumColumnsSimd(uint8_t const * const aData, uint32_t const aBlockCount, uint16_t * const aColumns) noexcept {
+    sumColumnsWord(aData, aBlockCount, aColumns);
+  }
+#endif
 };
 
 template<typename tInterface>
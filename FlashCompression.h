@@ -0,0 +1,236 @@
+#ifndef NOWTECH_FLASHCOMPRESSION
+#define NOWTECH_FLASHCOMPRESSION
+
+#include <cstdint>
+#include <algorithm>
+
+namespace nowtech::memory {
+
+/// Streaming LZSS codec for bulk items. The encoded data consists of groups of 8 tokens, each group starting with a
+/// flag byte, whose bits from the LSB on tell if the next token is a literal byte (1) or a match (0). A match has 2
+/// bytes: the low 8 bits of its offset, then the high 4 bits of the offset and the length - cMinMatch in the low 4
+/// bits. Neither direction allocates after init. The encoder needs 4 bytes of RAM for each byte of the window, as
+/// it finds the matches using hash chains, and the decoder needs only the window. Window size 0 disables the codec.
+template<typename tInterface, uint32_t tWindowSize>
+class LzssCodec final {
+  static_assert(tWindowSize == 0u || (tWindowSize >= 256u && tWindowSize <= 4096u && (tWindowSize & (tWindowSize - 1u)) == 0u), "The window size must be 0 or a power of 2 between 256 and 4096.");
+
+public:
+  static constexpr uint32_t cMinMatch = 3u;
+  static constexpr uint32_t cMaxMatch = cMinMatch + 15u;
+
+private:
+  static constexpr uint32_t getLog2(uint32_t const aValue) noexcept {
+    uint32_t result = 0u;
+    while((1u << result) < aValue) {
+      ++result;
+    }
+    return result;
+  }
+
+  static constexpr uint32_t cWindowMask     = tWindowSize - 1u;
+  static constexpr uint32_t cMaxOffset      = tWindowSize - cMaxMatch; // so the lookahead never overwrites the matches
+  static constexpr uint32_t cHashSize       = tWindowSize / 4u;
+  static constexpr uint32_t cHashShift      = 32u - getLog2(cHashSize);
+  static constexpr uint32_t cHashFactor     = 2654435761u;
+  static constexpr uint32_t cMaxChainLength = 8u;
+  static constexpr uint32_t cNoPosition     = 0xffffffffu;
+  static constexpr uint32_t cGroupSize      = 8u;
+  static constexpr uint32_t cMaxGroupBytes  = 1u + cGroupSize * 2u;
+
+  uint8_t*  mWindow;
+  uint16_t* mPrevious;   // distance to the previous position having the same hash, 0 if none
+  uint32_t* mHead;       // the last position having the hash
+  uint32_t  mPosition;   // encoder: the next byte to encode, decoder: the next byte to decode into
+  uint32_t  mEnd;        // encoder: the end of the received data, decoder: the end of the emitted data
+  uint8_t   mGroup[cMaxGroupBytes];
+  uint32_t  mGroupCount; // encoder: the bytes in mGroup, decoder: 1 if the first byte of a match is in mGroup[1]
+  uint32_t  mTokenCount; // in the current group
+
+public:
+  void init() {
+    mWindow = tInterface::template _newArray<uint8_t>(tWindowSize);
+    mPrevious = tInterface::template _newArray<uint16_t>(tWindowSize);
+    mHead = tInterface::template _newArray<uint32_t>(cHashSize);
+  }
+
+  void done() {
+    tInterface::template _deleteArray<uint8_t>(mWindow);
+    tInterface::template _deleteArray<uint16_t>(mPrevious);
+    tInterface::template _deleteArray<uint32_t>(mHead);
+  }
+
+  void beginEncode() noexcept {
+    std::fill_n(mHead, cHashSize, cNoPosition);
+    mPosition = 0u;
+    mEnd = 0u;
+    mGroup[0u] = 0u;
+    mGroupCount = 1u;
+    mTokenCount = 0u;
+  }
+
+  /// Calls aSink(uint8_t const * const aData, uint32_t const aCount) returning bool with each complete group.
+  /// Returns false if aSink did so.
+  template<typename tSink>
+  bool encode(uint8_t const * const aData, uint32_t const aCount, tSink &aSink) noexcept {
+    bool ok = true;
+    for(uint32_t i = 0u; ok && i < aCount; ++i) {
+      if(mEnd - mPosition == cMaxMatch) {
+        ok = encodeToken(aSink);
+      }
+      else { // nothing to do
+      }
+      mWindow[mEnd & cWindowMask] = aData[i];
+      ++mEnd;
+    }
+    return ok;
+  }
+
+  template<typename tSink>
+  bool finishEncode(tSink &aSink) noexcept {
+    bool ok = true;
+    while(ok && mPosition < mEnd) {
+      ok = encodeToken(aSink);
+    }
+    if(ok && mTokenCount > 0u) {
+      ok = aSink(static_cast<uint8_t const *>(mGroup), mGroupCount);
+    }
+    else { // nothing to do
+    }
+    return ok;
+  }
+
+  void beginDecode() noexcept {
+    mPosition = 0u;
+    mEnd = 0u;
+    mGroupCount = 0u;
+    mTokenCount = cGroupSize;
+  }
+
+  /// Calls aSink(uint8_t const * const aData, uint32_t const aCount) with the decoded data in the window, at most
+  /// up to its end, and with the rest before returning. The encoded data may be split anywhere.
+  template<typename tSink>
+  void decode(uint8_t const * const aData, uint32_t const aCount, tSink &aSink) noexcept {
+    for(uint32_t i = 0u; i < aCount; ++i) {
+      uint8_t const byte = aData[i];
+      if(mTokenCount == cGroupSize) {
+        mGroup[0u] = byte;
+        mTokenCount = 0u;
+      }
+      else if((mGroup[0u] & (1u << mTokenCount)) != 0u) {
+        put(byte, aSink);
+        ++mTokenCount;
+      }
+      else if(mGroupCount == 0u) {
+        mGroup[1u] = byte;
+        mGroupCount = 1u;
+      }
+      else {
+        uint32_t const offset = mGroup[1u] | (static_cast<uint32_t>(byte >> 4u) << 8u);
+        uint32_t const length = (byte & 0x0fu) + cMinMatch;
+        for(uint32_t j = 0u; j < length; ++j) {
+          put(mWindow[(mPosition - offset) & cWindowMask], aSink);
+        }
+        mGroupCount = 0u;
+        ++mTokenCount;
+      }
+    }
+    emit(aSink);
+  }
+
+private:
+  uint32_t getHash(uint32_t const aPosition) const noexcept {
+    uint32_t const value = (static_cast<uint32_t>(mWindow[aPosition & cWindowMask]) << 16u)
+                         | (static_cast<uint32_t>(mWindow[(aPosition + 1u) & cWindowMask]) << 8u)
+                         | mWindow[(aPosition + 2u) & cWindowMask];
+    return (value * cHashFactor) >> cHashShift;
+  }
+
+  void insert(uint32_t const aPosition) noexcept {
+    if(mEnd - aPosition >= cMinMatch) {
+      uint32_t const hash = getHash(aPosition);
+      uint32_t const last = mHead[hash];
+      mPrevious[aPosition & cWindowMask] = (last != cNoPosition && aPosition - last < tWindowSize ? static_cast<uint16_t>(aPosition - last) : 0u);
+      mHead[hash] = aPosition;
+    }
+    else { // nothing to do
+    }
+  }
+
+  /// Emits a literal or the longest match found in the hash chain at mPosition.
+  template<typename tSink>
+  bool encodeToken(tSink &aSink) noexcept {
+    uint32_t const available = std::min(cMaxMatch, mEnd - mPosition);
+    uint32_t bestLength = 0u;
+    uint32_t bestOffset = 0u;
+    if(available >= cMinMatch) {
+      uint32_t candidate = mHead[getHash(mPosition)];
+      for(uint32_t chain = 0u; candidate != cNoPosition && mPosition - candidate <= cMaxOffset && chain < cMaxChainLength; ++chain) {
+        uint32_t length = 0u;
+        while(length < available && mWindow[(candidate + length) & cWindowMask] == mWindow[(mPosition + length) & cWindowMask]) {
+          ++length;
+        }
+        if(length > bestLength) {
+          bestLength = length;
+          bestOffset = mPosition - candidate;
+        }
+        else { // nothing to do
+        }
+        uint16_t const distance = mPrevious[candidate & cWindowMask];
+        candidate = (distance == 0u || distance > candidate ? cNoPosition : candidate - distance);
+      }
+    }
+    else { // nothing to do
+    }
+    uint32_t tokenLength;
+    if(bestLength >= cMinMatch) {
+      mGroup[mGroupCount++] = static_cast<uint8_t>(bestOffset);
+      mGroup[mGroupCount++] = static_cast<uint8_t>(((bestOffset >> 8u) << 4u) | (bestLength - cMinMatch));
+      tokenLength = bestLength;
+    }
+    else {
+      mGroup[0u] |= static_cast<uint8_t>(1u << mTokenCount);
+      mGroup[mGroupCount++] = mWindow[mPosition & cWindowMask];
+      tokenLength = 1u;
+    }
+    for(uint32_t i = 0u; i < tokenLength; ++i) {
+      insert(mPosition++);
+    }
+    bool ok = true;
+    if(++mTokenCount == cGroupSize) {
+      ok = aSink(static_cast<uint8_t const *>(mGroup), mGroupCount);
+      mGroup[0u] = 0u;
+      mGroupCount = 1u;
+      mTokenCount = 0u;
+    }
+    else { // nothing to do
+    }
+    return ok;
+  }
+
+  /// Emitting at the end of the window keeps the emitted data contiguous.
+  template<typename tSink>
+  void put(uint8_t const aByte, tSink &aSink) noexcept {
+    mWindow[mPosition & cWindowMask] = aByte;
+    ++mPosition;
+    if((mPosition & cWindowMask) == 0u) {
+      emit(aSink);
+    }
+    else { // nothing to do
+    }
+  }
+
+  template<typename tSink>
+  void emit(tSink &aSink) noexcept {
+    if(mPosition > mEnd) {
+      aSink(static_cast<uint8_t const *>(mWindow + (mEnd & cWindowMask)), mPosition - mEnd);
+      mEnd = mPosition;
+    }
+    else { // nothing to do
+    }
+  }
+};
+
+}
+
+#endif
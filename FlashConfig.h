@@ -5,13 +5,17 @@
 #include "PoolAllocator.h"
 #include <cstdint>
 #include <algorithm>
+#include <atomic>
+#include <type_traits>
 
 namespace nowtech::memory {
 
-template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize = sizeof(float)>
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize = sizeof(float), uint32_t tJournalSizeInPages = 0u, ConfigStorage tStorage = ConfigStorage::cInline, ConfigBoot tBoot = ConfigBoot::cFull, ConfigConcurrency tConcurrency = ConfigConcurrency::cExclusive, ConfigPacking tPacking = ConfigPacking::cWhole, ConfigPlacement tPlacement = ConfigPlacement::cIdOrder>
 class FlashConfig final : FlashCommon<tInterface> {
   template<typename tInterfaceOther, typename tPlugin1, typename tPlugin2, typename tPlugin3>
   friend class FlashPartitioner;
+  template<typename tInterfaceOther, typename tConfig, typename ...tFields>
+  friend class FlashConfigSchema;
 
   using FlashCommon<tInterface>::cPageSizeInBytes;
   using FlashCommon<tInterface>::cSectorSizeInPages;
@@ -22,6 +26,12 @@ class FlashConfig final : FlashCommon<tInterface> {
   using FlashCommon<tInterface>::cOffsetPageItems;
   using FlashCommon<tInterface>::cUnusedValue;
   using FlashCommon<tInterface>::calculateChecksum;
+  using FlashCommon<tInterface>::calculateChecksumPart;
+  using FlashCommon<tInterface>::calculateChecksumFill;
+  using FlashCommon<tInterface>::updateChecksum;
+  using FlashCommon<tInterface>::startEraseSector;
+  using FlashCommon<tInterface>::startWritePage;
+  using FlashCommon<tInterface>::waitWhileBusy;
 
 private:
   static constexpr uint16_t cOffsetItemId = 0u;
@@ -29,13 +39,64 @@ private:
   static constexpr uint16_t cOffsetItemData  = cOffsetItemCount + sizeof(uint16_t);
   static constexpr uint16_t cPageItemSpace   = cPageSizeInBytes - cOffsetPageItems;
   static constexpr uint16_t cMaxItemDataSize = cPageItemSpace - cOffsetItemData;
-  static constexpr uint32_t cCopySizeInPages = (tPagesNeeded / (tCopies == FlashCopies::c2 ? 2u : 1u));
+  static constexpr bool     cSpanning        = (tPacking == ConfigPacking::cSpanning);
+  static constexpr uint16_t cMaxItemSize     = (cSpanning ? cUnusedValue - 1u : cMaxItemDataSize);
+  static constexpr bool     cAlternating     = (tCopies == FlashCopies::c2Alternating);
+  static constexpr uint32_t cCopySizeInPages = (tPagesNeeded / (tCopies == FlashCopies::c1 ? 1u : 2u));
+  static constexpr uint32_t cCopySizeInSectors = cCopySizeInPages / cSectorSizeInPages;
+  static constexpr uint32_t cCopyCount       = (tCopies == FlashCopies::c1 ? 1u : 2u);
+  static constexpr uint32_t cSealSizeInPages = (cAlternating ? cSectorSizeInPages : 0u);
+  static constexpr uint32_t cBaseSizeInPages = cCopySizeInPages - tJournalSizeInPages - cSealSizeInPages; // the journal or the seal sector is at the end of each copy
+  static constexpr bool     cJournal         = (tJournalSizeInPages > 0u);
+  static constexpr uint32_t cDigestFactor    = 31u;
+  static constexpr uint16_t cOffsetSealKind       = cOffsetPageItems;
+  static constexpr uint16_t cOffsetSealGeneration = cOffsetSealKind + sizeof(uint8_t);
+  static constexpr uint16_t cOffsetSealPageCount  = cOffsetSealGeneration + sizeof(uint32_t);
+  static constexpr uint16_t cOffsetSealDigest     = cOffsetSealPageCount + sizeof(uint32_t);
+  static constexpr uint16_t cOffsetSealWritten    = cOffsetSealDigest + sizeof(uint32_t); // bitset of the pages written by the commit, if it fits
+  static constexpr bool     cSealHasWritten       = (cBaseSizeInPages <= (cPageSizeInBytes - cOffsetSealWritten) * 8u);
+  static constexpr uint32_t cDirtyWordCount  = getBitWordCount(cBaseSizeInPages);
+  static constexpr uint32_t cMaxItemCount    = tMaxItemCount;
+  static constexpr uint32_t cItemWordCount   = getBitWordCount(tMaxItemCount);
+  static constexpr uint32_t cSectorSizeInBytes = cSectorSizeInPages * cPageSizeInBytes;
+  static constexpr uint32_t cSlotCount       = tReadAheadSizeInPages / cSectorSizeInPages; // sector-sized slots in the read ahead buffer for commit
+  static constexpr uint8_t  cErasedByte      = static_cast<uint8_t>(Magic::cErased);
+  // serialize fills the unused bytes with cErasedByte, so the checksum of a page depends only on its items
+  static constexpr uint16_t cEmptyPageChecksum = static_cast<uint16_t>(FlashCommon<tInterface>::calculateChecksumFill(static_cast<uint8_t>(Magic::cConfig), cOffsetPageMagic, cOffsetPageCount)
+                                                                     + FlashCommon<tInterface>::calculateChecksumFill(0u, cOffsetPageCount, cOffsetPageChecksum)
+                                                                     + FlashCommon<tInterface>::calculateChecksumFill(cErasedByte, cOffsetPageItems, cPageSizeInBytes));
+  // the same for a page where no item starts, having ffff as item count
+  static constexpr uint16_t cContinuationPageChecksum = static_cast<uint16_t>(cEmptyPageChecksum - FlashCommon<tInterface>::calculateChecksumFill(0u, cOffsetPageCount, cOffsetPageChecksum)
+                                                                            + FlashCommon<tInterface>::calculateChecksumFill(cErasedByte, cOffsetPageCount, cOffsetPageChecksum));
 
-  static_assert(tCopies == FlashCopies::c1 || tCopies == FlashCopies::c2, "Illegal FlashCopies value");
+  static constexpr bool     cArena           = (tStorage == ConfigStorage::cArena);
+  static constexpr bool     cLazy            = (tBoot == ConfigBoot::cLazy);
+  static constexpr bool     cSeqlock         = (tConcurrency == ConfigConcurrency::cSeqlock);
+  static constexpr bool     cHotTail         = (tPlacement == ConfigPlacement::cHotTail);
+  static constexpr uint16_t cMaxUpdateCount  = cUnusedValue - 1u; // so that the default of compact makes no item hot
+  static constexpr uint32_t cUncommittedSequence = ~0u; // odd, so differs from the sequence of any unchanging page
+  static constexpr uint32_t cArenaMaxSize    = cBaseSizeInPages * cPageItemSpace; // the values can't take more than the pages
+  static constexpr uint32_t cArenaInitialSize = std::min(cArenaMaxSize, tMaxItemCount * tValueBufferSize);
+
+  static_assert(tCopies == FlashCopies::c1 || tCopies == FlashCopies::c2 || tCopies == FlashCopies::c2Alternating, "Illegal FlashCopies value");
+  static_assert(tStorage == ConfigStorage::cInline || tStorage == ConfigStorage::cArena, "Illegal ConfigStorage value");
+  static_assert(!cArena || cBaseSizeInPages <= cUnusedValue, "FlashConfig arena storage needs at most ffff pages.");
+  static_assert(!cAlternating || !cJournal, "FlashConfig journal is not supported with alternating copies.");
+  static_assert(tBoot == ConfigBoot::cFull || tBoot == ConfigBoot::cLazy, "Illegal ConfigBoot value");
+  static_assert(!cLazy || (!cJournal && !cAlternating), "FlashConfig lazy boot is not supported with journal or alternating copies.");
+  static_assert(tConcurrency == ConfigConcurrency::cExclusive || tConcurrency == ConfigConcurrency::cSeqlock, "Illegal ConfigConcurrency value");
+  static_assert(!cSeqlock || (!cJournal && !cAlternating && !cLazy), "FlashConfig seqlock is not supported with journal, alternating copies or lazy boot.");
+  static_assert(tPacking == ConfigPacking::cWhole || tPacking == ConfigPacking::cSpanning, "Illegal ConfigPacking value");
+  static_assert(!cSpanning || (!cJournal && !cLazy && !cSeqlock), "FlashConfig spanning items are not supported with journal, lazy boot or seqlock.");
+  static_assert(tPlacement == ConfigPlacement::cIdOrder || tPlacement == ConfigPlacement::cHotTail, "Illegal ConfigPlacement value");
+  static_assert(!cHotTail || !cLazy, "FlashConfig hot-tail placement is not supported with lazy boot.");
   static_assert(tReadAheadSizeInPages > 1u, "FlashConfig needs read ahead buffer");
   static_assert(tReadAheadSizeInPages % cSectorSizeInPages == 0u, "FlashConfig read ahead buffer must be a multiply of sector size.");
   static_assert(cCopySizeInPages % cSectorSizeInPages == 0u, "FlashConfig copies must be a multiply of the sector size.");
-  static_assert(cCopySizeInPages * (tCopies == FlashCopies::c2 ? 2u : 1u) == tPagesNeeded, "Sum of copies must yield the partition size.");
+  static_assert(cCopySizeInPages * cCopyCount == tPagesNeeded, "Sum of copies must yield the partition size.");
+  static_assert(cSectorSizeInPages < cUnusedValue, "FlashConfig sector states need sector size below ffff pages.");
+  static_assert(tJournalSizeInPages % cSectorSizeInPages == 0u, "FlashConfig journal must be a multiply of the sector size.");
+  static_assert(tJournalSizeInPages + cSealSizeInPages < cCopySizeInPages, "FlashConfig journal or seal sector must leave room for the items.");
 
   class ConfigItem final {
   private:
@@ -76,10 +137,19 @@ private:
     }
 
     void init(uint32_t const aStartPage, uint16_t const aDataOffsetInFirstPage, uint16_t const aCount) {
+      mPageIndex = aStartPage;
+      mDataOffsetInFirstPage = aDataOffsetInFirstPage;
+      if(mStatus == Status::cMany && aCount != mCount) {
+        tInterface::template _deleteArray<uint8_t>(mDataMany);
+        mStatus = Status::cVoid;
+      }
+      else if(mStatus == Status::cFew && aCount > tValueBufferSize) {
+        mStatus = Status::cVoid;
+      }
+      else { // nothing to do
+      }
+      mCount = aCount;
       if(mStatus == Status::cVoid) {
-        mPageIndex = aStartPage;
-        mDataOffsetInFirstPage = aDataOffsetInFirstPage;
-        mCount = aCount;
         mStatus = (mCount > tValueBufferSize ? Status::cMany : Status::cFew);
         if(mCount > tValueBufferSize) {
           mDataMany = tInterface::template _newArray<uint8_t>(mCount);
@@ -91,6 +161,11 @@ private:
       }
     }
 
+    void move(uint32_t const aPageIndex, uint16_t const aDataOffsetInFirstPage) noexcept {
+      mPageIndex = aPageIndex;
+      mDataOffsetInFirstPage = aDataOffsetInFirstPage;
+    }
+
     uint32_t getPageIndex() const noexcept {
       return mPageIndex;
     }
@@ -128,8 +203,87 @@ private:
       }
       std::copy_n(aData, mCount, destination);
     }
+
+    bool doesMatch(uint8_t const * const aData, uint32_t const aOffset, uint32_t const aCount) const noexcept {
+      uint8_t const * const destination = getData() + aOffset;
+      return std::mismatch(aData, aData + aCount, destination).first == aData + aCount;
+    }
+
+    void setData(uint8_t const * const aData, uint32_t const aOffset, uint32_t const aCount) noexcept {
+      std::copy_n(aData, aCount, const_cast<uint8_t*>(getData()) + aOffset);
+    }
+  };
+
+  typedef std::conditional_t<(cArenaMaxSize <= 0x10000u), uint16_t, uint32_t> ArenaOffset;
+
+  /// Holds only the place of the value in sArena.
+  class ArenaItem final {
+  private:
+    ArenaOffset mArenaOffset;
+    uint16_t    mPageIndex;             // relative to start of this copy
+    uint16_t    mDataOffsetInFirstPage; // the first real item data address just after the item header
+    uint16_t    mCount;
+
+  public:
+    ArenaItem() noexcept : mArenaOffset(0u), mPageIndex(0u), mDataOffsetInFirstPage(0u), mCount(0u) {
+    }
+
+    ArenaItem(ArenaItem const &aOther) = delete;
+    ArenaItem(ArenaItem &&aOther) = delete;
+    ArenaItem& operator=(ArenaItem const &aOther) = delete;
+    ArenaItem& operator=(ArenaItem &&aOther) = delete;
+
+    bool isValid() noexcept {
+      return mCount > 0u;
+    }
+
+    void init(uint32_t const aStartPage, uint16_t const aDataOffsetInFirstPage, uint16_t const aCount) {
+      mPageIndex = aStartPage;
+      mDataOffsetInFirstPage = aDataOffsetInFirstPage;
+      mCount = aCount;
+      mArenaOffset = allocateValue(aCount);
+    }
+
+    void move(uint32_t const aPageIndex, uint16_t const aDataOffsetInFirstPage) noexcept {
+      mPageIndex = aPageIndex;
+      mDataOffsetInFirstPage = aDataOffsetInFirstPage;
+    }
+
+    uint32_t getPageIndex() const noexcept {
+      return mPageIndex;
+    }
+
+    uint32_t getDataOffsetInFirstPage() const noexcept {
+      return mDataOffsetInFirstPage;
+    }
+
+    uint32_t getCount() const noexcept {
+      return mCount;
+    }
+
+    uint8_t const * getData() const noexcept {
+      return sArena + mArenaOffset;
+    }
+
+    bool doesMatch(uint8_t const * const aData) const noexcept {
+      return std::mismatch(aData, aData + mCount, sArena + mArenaOffset).first == aData + mCount;
+    }
+
+    void setData(uint8_t const * const aData) noexcept {
+      std::copy_n(aData, mCount, sArena + mArenaOffset);
+    }
+
+    bool doesMatch(uint8_t const * const aData, uint32_t const aOffset, uint32_t const aCount) const noexcept {
+      return std::mismatch(aData, aData + aCount, sArena + mArenaOffset + aOffset).first == aData + aCount;
+    }
+
+    void setData(uint8_t const * const aData, uint32_t const aOffset, uint32_t const aCount) noexcept {
+      std::copy_n(aData, aCount, sArena + mArenaOffset + aOffset);
+    }
   };
 
+  typedef std::conditional_t<tStorage == ConfigStorage::cArena, ArenaItem, ConfigItem> CacheItem;
+
   class NewDeleteOccupier final {
   public:
     NewDeleteOccupier() noexcept = default;
@@ -158,8 +312,21 @@ private:
 
   enum class Task : uint8_t {
     cCopy    = 0u,
-    cCheck   = 1u,
-    cCheckFf = 2u
+    cCheck   = 1u
+  };
+
+  enum class SealKind : uint8_t {
+    cStarted = 0u,  // written before the first page of the commit
+    cDone    = 1u   // written after the last page of the commit
+  };
+
+  struct Seal final {
+    uint32_t mGeneration;
+    uint32_t mPageCount;
+    uint32_t mDigest;
+    uint16_t mPageIndex;  // relative to seal sector start
+    bool     mValid;      // the last seal is cDone, so the copy was completely written
+    bool     mErased;     // the seal sector is erased, the copy has never been written
   };
 
   enum class Modified : uint8_t {
@@ -169,12 +336,41 @@ private:
   };
   
   static uint32_t          sStartPage;
-  static ConfigItem*       sCache;                // index is id
-  static bool*             sDirtyPages;           // index relative to copy start
+  static CacheItem*        sCache;                // index is id
+  static uint32_t*         sDirtyPages;           // bitset, index relative to copy start
+  static uint16_t*         sPageChecksums;        // index relative to copy start, the checksum serialize will write
+  static uint16_t*         sPageFirstSlots;       // index relative to copy start, the slot of the first item having data in the page, see getSlotId
+  static uint16_t*         sPageItemCounts;       // index relative to copy start, items starting in the page, valid up to and including sFirstUsablePage
+  static uint16_t*         sSectorStates;         // index is copy offset in sectors + sector, see getSectorStates
   static uint8_t*          sReadAheadBuffer;
+  static uint32_t*         sDirtyItems;           // bitset, journal mode only: items changed by setConfig since the last commit
+  static uint32_t*         sJournaledItems;       // bitset, journal mode only: items having a record in the journal
+  static uint32_t          sJournalNextPage;      // the first erased journal page, relative to journal start
+  static uint32_t          sJournalDigest;        // of the journal page checksums, to compare the journals of the copies
+  static bool              sJournalObsolete;      // the journal may hold records not reflected in the cache, and must be folded before appending
+  static uint32_t*         sPendingPages;         // bitset, alternating mode only: pages written by the last commit in the newest copy, but not in the older one
+  static uint16_t          sSealNextPages[cCopyCount]; // alternating mode only: the first erased page in the seal sector of each copy, cSectorSizeInPages if it needs erase
+  static uint32_t          sGeneration;           // alternating mode only: of the newest copy
+  static uint32_t          sNewestCopy;           // alternating mode only: index of the newest copy
+  static uint8_t*          sArena;                // arena storage only: the values of all items
+  static uint32_t          sArenaSize;            // arena storage only
+  static uint32_t          sArenaUsed;            // arena storage only: the next value is allocated here
+  static uint32_t*         sLoadedPages;          // bitset, lazy boot only: pages with values already read
+  static uint32_t          sLazyCopyOffset;       // lazy boot only: of the copy the values are read from
+  static uint32_t          sLazyPageCount;        // lazy boot only: pages found on boot, the ones after hold only new items
+  static std::atomic<uint32_t>* sPageSequences;   // seqlock only: odd while a page is being changed, incremented by 2 on each change
+  static uint32_t*         sCommittedSequences;   // seqlock only: the page sequences last serialized by commit
+  static uint16_t*         sSlotIds;              // hot-tail placement only: the ids in the order of their places in the pages, index is slot
+  static uint32_t*         sPlacedItems;          // bitset, hot-tail placement only: items already found during boot
+  static uint16_t          sPlacedCount;          // hot-tail placement only: items already found during boot
+  static uint16_t*         sUpdateCounts;         // hot-tail placement only: changes of each item by setConfig since init, saturating
+  static CommitStatistics  sStatistics;
+  static std::atomic<uint32_t> sRetriedReadCount; // seqlock only: reads repeated because a setConfig changed the page meanwhile
   static uint32_t          sFirstUsablePage;      // the first usable (at least partially free) page, relative to copy start
   static uint16_t          sFirstUsableByteIndex; // the first free byte in the first usable page
   static uint16_t          sNextId;               // the next id to use when adding a new item
+  static uint16_t          sSpanningId;           // spanning packing only: the last item read during boot
+  static uint16_t          sSpanningLeft;         // spanning packing only: bytes of sSpanningId still to come in the next pages
 
   FlashConfig() = delete;
 
@@ -184,45 +380,159 @@ private:
 
   static void init(uint32_t const aStartPage) {
     sStartPage = aStartPage;
-    sCache = tInterface::template _newArray<ConfigItem>(tMaxItemCount);
-    sDirtyPages = tInterface::template _newArray<bool>(cCopySizeInPages);
+    sCache = tInterface::template _newArray<CacheItem>(tMaxItemCount);
+    sArena = (cArena ? tInterface::template _newArray<uint8_t>(cArenaInitialSize) : nullptr);
+    sArenaSize = cArenaInitialSize;
+    sDirtyPages = tInterface::template _newArray<uint32_t>(cDirtyWordCount);
+    sPageChecksums = tInterface::template _newArray<uint16_t>(cCopySizeInPages);
+    sPageFirstSlots = tInterface::template _newArray<uint16_t>(cCopySizeInPages);
+    sPageItemCounts = tInterface::template _newArray<uint16_t>(cCopySizeInPages);
+    sSectorStates = tInterface::template _newArray<uint16_t>(cCopySizeInSectors * cCopyCount);
     sReadAheadBuffer = tInterface::template _newArray<uint8_t>(tReadAheadSizeInPages * cPageSizeInBytes);
+    sDirtyItems = (cJournal ? tInterface::template _newArray<uint32_t>(cItemWordCount) : nullptr);
+    sJournaledItems = (cJournal ? tInterface::template _newArray<uint32_t>(cItemWordCount) : nullptr);
+    sPendingPages = (cAlternating ? tInterface::template _newArray<uint32_t>(cDirtyWordCount) : nullptr);
+    sLoadedPages = (cLazy ? tInterface::template _newArray<uint32_t>(cDirtyWordCount) : nullptr);
+    sPageSequences = (cSeqlock ? tInterface::template _newArray<std::atomic<uint32_t>>(cBaseSizeInPages) : nullptr);
+    sCommittedSequences = (cSeqlock ? tInterface::template _newArray<uint32_t>(cBaseSizeInPages) : nullptr);
+    sSlotIds = (cHotTail ? tInterface::template _newArray<uint16_t>(tMaxItemCount) : nullptr);
+    sPlacedItems = (cHotTail ? tInterface::template _newArray<uint32_t>(cItemWordCount) : nullptr);
+    sUpdateCounts = (cHotTail ? tInterface::template _newArray<uint16_t>(tMaxItemCount) : nullptr);
+    clearStatistics();
+    if(cSeqlock) {
+      for(uint32_t i = 0u; i < cBaseSizeInPages; ++i) {
+        sPageSequences[i].store(0u, std::memory_order_relaxed);
+      }
+      std::fill_n(sCommittedSequences, cBaseSizeInPages, 0u);
+    }
+    else { // nothing to do
+    }
     readAll();
   }
 
   static void done() {
-    tInterface::template _deleteArray<ConfigItem>(sCache);
-    tInterface::template _deleteArray<bool>(sDirtyPages);
+    tInterface::template _deleteArray<CacheItem>(sCache);
+    if(cArena) {
+      tInterface::template _deleteArray<uint8_t>(sArena);
+    }
+    else { // nothing to do
+    }
+    tInterface::template _deleteArray<uint32_t>(sDirtyPages);
+    tInterface::template _deleteArray<uint16_t>(sPageChecksums);
+    tInterface::template _deleteArray<uint16_t>(sPageFirstSlots);
+    tInterface::template _deleteArray<uint16_t>(sPageItemCounts);
+    tInterface::template _deleteArray<uint16_t>(sSectorStates);
     tInterface::template _deleteArray<uint8_t>(sReadAheadBuffer);
+    if(cJournal) {
+      tInterface::template _deleteArray<uint32_t>(sDirtyItems);
+      tInterface::template _deleteArray<uint32_t>(sJournaledItems);
+    }
+    else { // nothing to do
+    }
+    if(cAlternating) {
+      tInterface::template _deleteArray<uint32_t>(sPendingPages);
+    }
+    else { // nothing to do
+    }
+    if(cLazy) {
+      tInterface::template _deleteArray<uint32_t>(sLoadedPages);
+    }
+    else { // nothing to do
+    }
+    if(cSeqlock) {
+      tInterface::template _deleteArray<std::atomic<uint32_t>>(sPageSequences);
+      tInterface::template _deleteArray<uint32_t>(sCommittedSequences);
+    }
+    else { // nothing to do
+    }
+    if(cHotTail) {
+      tInterface::template _deleteArray<uint16_t>(sSlotIds);
+      tInterface::template _deleteArray<uint32_t>(sPlacedItems);
+      tInterface::template _deleteArray<uint16_t>(sUpdateCounts);
+    }
+    else { // nothing to do
+    }
   }
 
 public:
+  /// Not available in seqlock mode, where the value may change while being read through the pointer.
   static uint8_t const * getConfig(uint16_t const aId) {
+    static_assert(!cSeqlock, "FlashConfig seqlock values may change meanwhile, use readConfig.");
     uint8_t const * result = nullptr;
     if(aId >= sNextId) {
       tInterface::fatalError(FlashException::cConfigInvalidId);
     }
     else {
+      ensureLoaded(sCache[aId].getPageIndex());
       result = sCache[aId].getData();
     }
     return result;
   }
 
+  /// Copies the value into aData. In seqlock mode, this is the way to read a consistent value while setConfig or
+  /// commit may run in other threads. It never blocks, but retries while the page of the item is being changed.
+  static void readConfig(uint16_t const aId, uint8_t * const aData) {
+    if(aId >= sNextId) {
+      tInterface::fatalError(FlashException::cConfigInvalidId);
+    }
+    else {
+      CacheItem const &item = sCache[aId];
+      ensureLoaded(item.getPageIndex());
+      readPage(item.getPageIndex(), [&item, aData](){
+        copyShared(item.getData(), item.getCount(), aData);
+      });
+    }
+  }
+
   static uint16_t addConfig(uint8_t const * const aData, uint16_t const aCount);
   static void setConfig(uint16_t const aId, uint8_t const * const aData);
 
   static void makeAllDirty() noexcept {
-    std::fill_n(sDirtyPages, cCopySizeInPages, true);
+    std::fill_n(sDirtyPages, cDirtyWordCount, ~0u);
   }
 
   static void commit() {
-    bool ok = commit(0u);
-    if(ok && tCopies == FlashCopies::c2) {
-      ok = commit(cCopySizeInPages);
+    if(!commitChanges()) {
+      tInterface::fatalError(FlashException::cFlashTransferError);
     }
     else { // nothing to do
     }
-    if(ok) {
+  }
+
+  /// Lays out the items again in id order to occupy the fewest pages with the packing policy, and commits. Useful
+  /// when the pages were written with an other packing. Only the sectors from the first moved item on are rewritten,
+  /// and the ones holding no items any more are erased. Needs mutual exclusion with any other method.
+  /// With hot-tail placement, the items changed at least aHotUpdateCount times since init go after the others from
+  /// the start of a new sector, so that changing only them needs erasing only those sectors.
+  static void compact(uint16_t const aHotUpdateCount = cUnusedValue) {
+    uint32_t const oldPageCount = countPagesWithItems();
+    for(uint32_t page = 0u; page < oldPageCount; ++page) {
+      ensureLoaded(page);
+    }
+    sLazyPageCount = 0u; // everything is in the cache now
+    if(countCompactPages(aHotUpdateCount) > cBaseSizeInPages) {
+      tInterface::fatalError(FlashException::cConfigFull);
+    }
+    else {
+      uint32_t const firstMovedPage = relayout(aHotUpdateCount);
+      for(uint32_t page = firstMovedPage; page < countPagesWithItems(); ++page) {
+        serialize(page, sReadAheadBuffer);
+        sPageChecksums[page] = calculateChecksum(sReadAheadBuffer);
+        setBit(sDirtyPages, page);
+      }
+      sJournalObsolete = (sJournalObsolete || firstMovedPage < cBaseSizeInPages); // appending would not write the pages
+      if(!(commitChanges() && eraseUnusedSectors(countPagesWithItems(), oldPageCount))) {
+        tInterface::fatalError(FlashException::cFlashTransferError);
+      }
+      else { // nothing to do
+      }
+    }
+  }
+
+  /// Journal mode only. Commits everything and empties the journal. Meant to be called when getJournalFreePages
+  /// runs low and a longer commit is acceptable, so that a later commit need not do it.
+  static void compactJournal() {
+    if(foldJournal() && commitCopies()) {
       makeAllClean();
     }
     else {
@@ -230,219 +540,1080 @@ public:
     }
   }
 
-  static void clear() noexcept {
-    sNextId = 0u; // do not wipe cache, as its lengths are already correct, and no need to repeat allocation
-    makeAllClean();
+  static uint32_t getJournalFreePages() noexcept {
+    return sJournalObsolete ? 0u : tJournalSizeInPages - sJournalNextPage;
   }
 
-  // TODO remove
-  static void readAllDebugTodoRemove() {
-    readAll();
+  /// Returns the number of pages in a copy holding items, which is the amount read on boot.
+  static uint32_t getUsedPageCount() noexcept {
+    return countPagesWithItems();
   }
 
-private:
-  static void makeAllClean() noexcept {
-    std::fill_n(sDirtyPages, cCopySizeInPages, false);
+  /// Hot-tail placement only. Returns how many times setConfig changed the item since init, at most fffe.
+  static uint16_t getUpdateCount(uint16_t const aId) noexcept {
+    static_assert(cHotTail, "FlashConfig update counts need hot-tail placement.");
+    return aId < sNextId ? sUpdateCounts[aId] : 0u;
   }
 
-  static void readAll();
-  static ReadResult readAcopy(uint32_t const aCopyOffsetInPages, Task const aTask);
-  static ReadResult processPage(uint8_t const * const aPage, uint32_t const aPageIndexRelCopy, Task const aTask) noexcept;
-  static bool commit(uint32_t const aCopyOffsetInPages) noexcept;
-  static void serialize(uint32_t const aReadAheadStartPage, uint32_t const aPageInReadAhead) noexcept;
-};
+  /// Returns the commits and the sector operations since init or the last clearStatistics.
+  static CommitStatistics getCommitStatistics() noexcept {
+    return sStatistics;
+  }
 
-template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize>
-uint16_t FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize>::addConfig(uint8_t const * const aData, uint16_t const aCount) {
-  uint16_t id = cUnusedValue;
-  if(aCount > cMaxItemDataSize) {
-    tInterface::fatalError(FlashException::cConfigItemTooBig);
+  /// Seqlock only. Returns the readConfig calls and the page serializations of commit since init or the last
+  /// clearStatistics that had to read again, because a setConfig was changing the page. Commit never causes it.
+  static uint32_t getRetriedReadCount() noexcept {
+    return sRetriedReadCount.load(std::memory_order_relaxed);
   }
-  else if(sNextId >= cUnusedValue) {
-    tInterface::fatalError(FlashException::cConfigInvalidId);
+
+  static void clearStatistics() noexcept {
+    sStatistics = CommitStatistics { 0u, 0u, 0u };
+    sRetriedReadCount.store(0u, std::memory_order_relaxed);
+    if(cHotTail) {
+      std::fill_n(sUpdateCounts, tMaxItemCount, 0u);
+    }
+    else { // nothing to do
+    }
   }
-  else {
-    id = sNextId++;
-    uint16_t totalLeftover = cPageSizeInBytes - sFirstUsableByteIndex;
-    if(totalLeftover < aCount) {
-      ++sFirstUsablePage;
-      sFirstUsableByteIndex = cOffsetPageItems;
+
+  static void clear() noexcept {
+    sNextId = 0u; // do not wipe cache, as its lengths are already correct, and no need to repeat allocation
+    sArenaUsed = 0u;
+    sFirstUsablePage = 0u;
+    sFirstUsableByteIndex = cOffsetPageItems;
+    sLazyPageCount = 0u; // no value is needed from the flash any more
+    if(cHotTail) {
+      std::fill_n(sPlacedItems, cItemWordCount, 0u);
+      sPlacedCount = 0u;
     }
     else { // nothing to do
     }
-    if(sFirstUsablePage < cCopySizeInPages) {
-      ConfigItem& item = sCache[id];
-      item.init(sFirstUsablePage, sFirstUsableByteIndex + cOffsetItemData, aCount);
-      sFirstUsableByteIndex += cOffsetItemData + aCount;
-      sDirtyPages[item.getPageIndex()] = true;
-      item.setData(aData);
+    if(cJournal) {
+      std::fill_n(sJournaledItems, cItemWordCount, 0u);
+      sJournalNextPage = 0u;
+      sJournalDigest = 0u;
+      sJournalObsolete = true; // the journal on flash belongs to the old items
     }
-    else {
-      tInterface::fatalError(FlashException::cConfigFull);
+    else { // nothing to do
     }
+    makeAllClean();
   }
-  return id;
-}
-  
-template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize>
-void FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize>::setConfig(uint16_t const aId, uint8_t const * const aData) {
-  if(aId >= sNextId) {
-    tInterface::fatalError(FlashException::cConfigInvalidId);
+
+  // TODO remove
+  static void readAllDebugTodoRemove() {
+    readAll();
   }
-  else {
-    ConfigItem& item = sCache[aId];
-    if(!item.doesMatch(aData)) {  
-      sDirtyPages[item.getPageIndex()] = true;
-      item.setData(aData);
+
+private:
+  static void makeAllClean() noexcept {
+    std::fill_n(sDirtyPages, cDirtyWordCount, 0u);
+    if(cJournal) {
+      std::fill_n(sDirtyItems, cItemWordCount, 0u);
     }
     else { // nothing to do
     }
   }
-}
 
-template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize>
-void FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize>::readAll() {
-  clear();
-  ReadResult result1 = readAcopy(0u, Task::cCopy);
-  uint32_t firstUsablePage1 = sFirstUsablePage;
-  uint16_t firstUsableByteIndex1 = sFirstUsableByteIndex;
-  if(tCopies == FlashCopies::c2) {
-    ReadResult result2;
-    if(result1 != ReadResult::cOk) {
-      clear();
-      result2 = readAcopy(cCopySizeInPages, Task::cCopy);
+  /// Commits the dirty pages, or in journal mode the dirty items, without reporting a failure.
+  static bool commitChanges() {
+    bool ok = true;
+    ++sStatistics.mCommitCount;
+    if(cLazy) {
+      loadDirtySectors();
     }
     else { // nothing to do
-      result2 = readAcopy(cCopySizeInPages, Task::cCheck);
-    }
-
-    if(result1 == ReadResult::cOk && result2 == ReadResult::cErrorMismatch) {
-      sFirstUsablePage = 0u;
-      sFirstUsableByteIndex = cOffsetPageItems;
-      clear();
-      tInterface::fatalError(FlashException::cConfigCopiesMismatch);
     }
-    else if(result1 == ReadResult::cOk && result2 != ReadResult::cOk) {
-      sFirstUsablePage = firstUsablePage1;
-      sFirstUsableByteIndex = firstUsableByteIndex1;
-      tInterface::fatalError(FlashException::cConfigBadCopy2);
+    if(cSeqlock) {
+      markChangedPagesDirty();
     }
-    else if(result1 != ReadResult::cOk && result2 == ReadResult::cOk) {
-      tInterface::fatalError(FlashException::cConfigBadCopy1);
+    else { // nothing to do
     }
-    else if(result1 != ReadResult::cOk && result2 != ReadResult::cOk) {
-      sFirstUsablePage = 0u;
-      sFirstUsableByteIndex = cOffsetPageItems;
-      clear();
-      tInterface::fatalError(FlashException::cConfigBadCopies);
+    if(cJournal) {
+      ok = (sJournalObsolete || sJournalNextPage + countJournalPages() > tJournalSizeInPages ? foldJournal() : appendJournal());
     }
     else { // nothing to do
     }
-  }
-  else {
-    if(result1 != ReadResult::cOk) {
-      sFirstUsablePage = 0u;
-      sFirstUsableByteIndex = cOffsetPageItems;
-      clear();
-      tInterface::fatalError(FlashException::cConfigBadCopies);
+    if constexpr(cAlternating) {
+      ok = (ok && commitOlderCopy());
+    }
+    else {
+      ok = (ok && commitCopies());
+    }
+    if(ok) {
+      makeAllClean();
+    }
+    else if(cSeqlock) {
+      std::fill_n(sCommittedSequences, cBaseSizeInPages, cUncommittedSequence);
     }
     else { // nothing to do
     }
+    return ok;
   }
-}
 
-template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize>
-typename FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize>::ReadResult FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize>::readAcopy(uint32_t const aCopyOffsetInPages, Task const aTask) {
-  uint32_t pagesRead = 0u;
-  uint32_t pagesLeftInBuffer = 0u;
-  uint32_t pageIndex;
-  sFirstUsablePage = 0u;
-  sFirstUsableByteIndex = cOffsetPageItems;
-  ReadResult result = ReadResult::cOk; 
-  while(result == ReadResult::cOk) {
-    if(pagesLeftInBuffer == 0u) {
-      pagesLeftInBuffer = std::min(tReadAheadSizeInPages, cCopySizeInPages - pagesRead);
-      if(tInterface::readPages(sStartPage + aCopyOffsetInPages + pagesRead, pagesLeftInBuffer, sReadAheadBuffer) != SpiResult::cOk) {
-        result = ReadResult::cTransferError;
-        break;
-      }
-      else { // nothing to do
-      }
-      pagesRead += pagesLeftInBuffer;
-      pageIndex = 0u;
+  /// Writes the second copy only after the first one is complete, so while one copy is being written, the other one
+  /// holds the whole image before or after the commit, and never a mix of the two. In seqlock mode the values may
+  /// change meanwhile, so the second copy is read back from the first one to keep them identical.
+  static bool commitCopies() noexcept {
+    bool ok = commitSectors(0u, cCopySizeInPages);
+    if(cCopyCount == 2u) {
+      ok = (ok && commitSectors(cCopySizeInPages, tPagesNeeded, cSeqlock));
     }
     else { // nothing to do
     }
-    if(pagesLeftInBuffer > 0u) {
-      while(result == ReadResult::cOk && pagesLeftInBuffer > 0u) {
-        ReadResult tmp = processPage(sReadAheadBuffer + pageIndex * cPageSizeInBytes, pagesRead + pageIndex, aTask);
-        result = (result == ReadResult::cOk ? tmp : result);
-        --pagesLeftInBuffer;
-        ++pageIndex;
-      }
+    return ok;
+  }
+
+  static bool hasItems(uint32_t const aPageIndex) noexcept {
+    return aPageIndex < sFirstUsablePage || (aPageIndex == sFirstUsablePage && sFirstUsableByteIndex > cOffsetPageItems);
+  }
+
+  static bool isErased(uint8_t const * const aStart, uint32_t const aPageCount) noexcept {
+    return std::all_of(aStart, aStart + aPageCount * cPageSizeInBytes, [](uint8_t const aValue) {
+      return aValue == cErasedByte; } );
+  }
+
+  /// The state of a sector is the count of pages programmed from its start, the rest being erased. So 0 means
+  /// erased, cSectorSizeInPages means full or to be erased before any write, and cUnusedValue means unknown.
+  static uint16_t* getSectorStates(uint32_t const aCopyOffsetInPages) noexcept {
+    return sSectorStates + aCopyOffsetInPages / cSectorSizeInPages;
+  }
+
+  static uint16_t countProgrammedPages(uint8_t const * const aSector) noexcept {
+    uint16_t result = cSectorSizeInPages;
+    while(result > 0u && isErased(aSector + (result - 1u) * cPageSizeInBytes, 1u)) {
+      --result;
     }
-    else {
-      break;
+    return result;
+  }
+
+  static void initSectorStates(uint32_t const aCopyOffsetInPages, uint32_t const aStopPage, uint32_t const aBufferStartPage, uint32_t const aBufferPageCount, bool const aErased) noexcept;
+  static bool needsErase(uint32_t const aCopyOffsetInPages, uint32_t const aFirstDirtyPage) noexcept {
+    uint32_t const sector = aFirstDirtyPage / cSectorSizeInPages;
+    return aFirstDirtyPage < sector * cSectorSizeInPages + getSectorStates(aCopyOffsetInPages)[sector];
+  }
+
+  static bool areSectorStatesKnown(uint32_t const aCopyOffsetBegin, uint32_t const aCopyOffsetEnd, uint32_t const aSector) noexcept {
+    bool result = true;
+    for(uint32_t copyOffsetInPages = aCopyOffsetBegin; copyOffsetInPages < aCopyOffsetEnd; copyOffsetInPages += cCopySizeInPages) {
+      result = (result && getSectorStates(copyOffsetInPages)[aSector] != cUnusedValue);
     }
+    return result;
   }
-  return result == ReadResult::cErased ? ReadResult::cOk : result;
-}
 
-template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize>
-typename FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize>::ReadResult FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize>::processPage(uint8_t const * const aPage, uint32_t const aPageIndexRelCopy, Task const aTask) noexcept {
-  ReadResult result = ReadResult::cOk;
-  if(is<Magic::cErased>(aPage[cOffsetPageMagic])) {
-    if(aTask == Task::cCheckFf) {
-      result = std::all_of(aPage, aPage + cPageSizeInBytes, [](uint8_t const aValue) {
-        return aValue == static_cast<uint8_t>(Magic::cErased); } ) ? ReadResult::cErased : ReadResult::cErrorConsistency;
+  /// Calls aFunction for the pages to write in the sector of aFirstDirtyPage: after an erase, all of them holding
+  /// items, otherwise only the dirty ones.
+  template<typename tFunction>
+  static bool forPagesToWrite(uint32_t const aFirstDirtyPage, uint32_t const aEndPage, bool const aAll, tFunction aFunction) noexcept {
+    bool ok = true;
+    uint32_t pageIndex = (aAll ? aFirstDirtyPage / cSectorSizeInPages * cSectorSizeInPages : aFirstDirtyPage);
+    while(ok && pageIndex < aEndPage && hasItems(pageIndex)) {
+      ok = aFunction(pageIndex);
+      pageIndex = (aAll ? pageIndex + 1u : findNextSetBit(sDirtyPages, pageIndex + 1u, aEndPage));
     }
-    else {
-      result = ReadResult::cErased;
+    return ok;
+  }
+
+  static bool readSectorStates(uint32_t const aCopyOffsetBegin, uint32_t const aCopyOffsetEnd, uint32_t const aSector, uint8_t * const aBuffer) noexcept;
+  static void serializeSector(uint32_t const aCopyOffsetBegin, uint32_t const aCopyOffsetEnd, uint32_t const aFirstDirtyPage, uint32_t const aEndPage, uint8_t * const aSlot) noexcept;
+  static bool programSector(uint32_t const aCopyOffsetInPages, uint32_t const aFirstDirtyPage, uint32_t const aEndPage, bool const aAll, uint8_t const * const aSlot) noexcept;
+
+  /// Calls aFunction(pageIndex, offsetInPage, offsetInItem, count) for the part of the item data in each page.
+  /// Without spanning packing, there is only one part.
+  template<typename tFunction>
+  static void forItemParts(uint32_t const aPageIndex, uint32_t const aDataOffsetInFirstPage, uint32_t const aCount, tFunction aFunction) noexcept {
+    uint32_t pageIndex = aPageIndex;
+    uint32_t offsetInPage = aDataOffsetInFirstPage;
+    uint32_t offsetInItem = 0u;
+    do {
+      uint32_t const count = std::min(aCount - offsetInItem, cPageSizeInBytes - offsetInPage);
+      aFunction(pageIndex, offsetInPage, offsetInItem, count);
+      offsetInItem += count;
+      offsetInPage = cOffsetPageItems;
+      ++pageIndex;
+    } while(offsetInItem < aCount);
+  }
+
+  /// Moves aPageIndex and aByteIndex from the end of the previous item to the header of an item of aCount bytes.
+  /// With spanning packing, the item starts in the current page if its header and at least one data byte fit.
+  static void placeItem(uint16_t const aCount, uint32_t &aPageIndex, uint32_t &aByteIndex) noexcept {
+    if(cPageSizeInBytes - aByteIndex < cOffsetItemData + (cSpanning ? std::min<uint32_t>(aCount, 1u) : aCount)) {
+      ++aPageIndex;
+      aByteIndex = cOffsetPageItems;
+    }
+    else { // nothing to do
     }
   }
-  else if(is<Magic::cConfig>(aPage[cOffsetPageMagic])) {
-    uint16_t newItemStart = cOffsetPageItems;
-    uint16_t itemCount = getValue<uint16_t>(aPage + cOffsetPageCount);
-    if(calculateChecksum(aPage) != getValue<uint16_t>(aPage + cOffsetPageChecksum)) {
-      result = ReadResult::cErrorChecksum;
+
+  /// Moves aPageIndex and aByteIndex from the header of an item of aCount bytes to its end.
+  static void skipItem(uint16_t const aCount, uint32_t &aPageIndex, uint32_t &aByteIndex) noexcept {
+    aByteIndex += cOffsetItemData + aCount;
+    while(aByteIndex > cPageSizeInBytes) {
+      ++aPageIndex;
+      aByteIndex = aByteIndex - cPageSizeInBytes + cOffsetPageItems;
     }
-    else if(itemCount == 0u || itemCount == cUnusedValue) {
-      result = ReadResult::cErrorConsistency;
+  }
+
+  /// The id of the item in the given place of the item order, which is the id itself with id order placement.
+  static uint16_t getSlotId(uint16_t const aSlot) noexcept {
+    return cHotTail ? sSlotIds[aSlot] : aSlot;
+  }
+
+  static void countUpdate(uint16_t const aId) noexcept {
+    if(cHotTail && sUpdateCounts[aId] < cMaxUpdateCount) {
+      ++sUpdateCounts[aId];
     }
-    else {
-      sFirstUsablePage = (aTask == Task::cCheckFf ? sFirstUsablePage : aPageIndexRelCopy);
-      while(itemCount > 0u) {
-        uint8_t const * rawItemPointer = aPage + newItemStart;
-        uint16_t id = getValue<uint16_t>(rawItemPointer + cOffsetItemId);
-        uint16_t count = getValue<uint16_t>(rawItemPointer + cOffsetItemCount);
-        newItemStart += cOffsetItemData;
-        rawItemPointer = aPage + newItemStart;
-        if(newItemStart + count > cPageSizeInBytes || id > sNextId) {
-          result = ReadResult::cErrorConsistency;
+    else { // nothing to do
+    }
+  }
+
+  static bool isHot(uint16_t const aId, uint16_t const aHotUpdateCount) noexcept {
+    return cHotTail && sUpdateCounts[aId] >= aHotUpdateCount;
+  }
+
+  /// Lays out the items from the start, and calls aFunction(id, pageIndex, byteIndex) with the place of each item
+  /// header. The hot ones come after the others from the start of a new sector, and the pages skipped before them
+  /// hold no items. Returns the end of the last item in aPageIndex and aByteIndex.
+  template<typename tFunction>
+  static void layOut(uint16_t const aHotUpdateCount, uint32_t &aPageIndex, uint32_t &aByteIndex, tFunction aFunction) noexcept {
+    aPageIndex = 0u;
+    aByteIndex = cOffsetPageItems;
+    for(uint32_t pass = 0u; pass < (cHotTail ? 2u : 1u); ++pass) {
+      bool const hotPass = (pass == 1u);
+      bool firstHot = hotPass;
+      for(uint16_t id = 0u; id < sNextId; ++id) {
+        if(isHot(id, aHotUpdateCount) == hotPass) {
+          uint16_t const count = sCache[id].getCount();
+          placeItem(count, aPageIndex, aByteIndex);
+          if(firstHot && (aByteIndex > cOffsetPageItems || aPageIndex % cSectorSizeInPages != 0u)) {
+            aPageIndex = (aPageIndex / cSectorSizeInPages + 1u) * cSectorSizeInPages;
+            aByteIndex = cOffsetPageItems;
+          }
+          else { // nothing to do
+          }
+          firstHot = false;
+          aFunction(id, aPageIndex, aByteIndex);
+          skipItem(count, aPageIndex, aByteIndex);
+        }
+        else { // nothing to do
+        }
+      }
+    }
+  }
+
+  /// Returns the number of pages the items would occupy if laid out from the start.
+  static uint32_t countCompactPages(uint16_t const aHotUpdateCount) noexcept {
+    uint32_t pageIndex;
+    uint32_t byteIndex;
+    layOut(aHotUpdateCount, pageIndex, byteIndex, [](uint16_t, uint32_t, uint32_t){});
+    return byteIndex > cOffsetPageItems ? pageIndex + 1u : pageIndex;
+  }
+
+  /// Lays out the items one after the other from the start. Returns the first page whose contents changed, or
+  /// cBaseSizeInPages if none. The checksums of the changed pages must be recalculated.
+  static uint32_t relayout(uint16_t const aHotUpdateCount) noexcept {
+    uint32_t result = cBaseSizeInPages;
+    uint16_t slot = 0u;
+    uint32_t nextPageIndex = 0u; // the first page not laid out yet
+    uint32_t endPageIndex;
+    uint32_t endByteIndex;
+    layOut(aHotUpdateCount, endPageIndex, endByteIndex, [&result, &slot, &nextPageIndex](uint16_t const aId, uint32_t const aPageIndex, uint32_t const aByteIndex){
+      CacheItem& item = sCache[aId];
+      for(; nextPageIndex <= aPageIndex; ++nextPageIndex) { // the page of the item, and the empty ones before the hot items
+        sPageFirstSlots[nextPageIndex] = slot;
+        sPageItemCounts[nextPageIndex] = 0u;
+      }
+      ++sPageItemCounts[aPageIndex];
+      if(result == cBaseSizeInPages && (item.getPageIndex() != aPageIndex || item.getDataOffsetInFirstPage() != aByteIndex + cOffsetItemData)) {
+        result = std::min(item.getPageIndex(), aPageIndex); // the item leaves its old page and enters the new one
+      }
+      else { // nothing to do
+      }
+      item.move(aPageIndex, aByteIndex + cOffsetItemData);
+      if(cHotTail) {
+        sSlotIds[slot] = aId;
+      }
+      else { // nothing to do
+      }
+      uint32_t lastPageIndex = aPageIndex;
+      uint32_t endByteIndex = aByteIndex;
+      skipItem(item.getCount(), lastPageIndex, endByteIndex);
+      for(; nextPageIndex <= lastPageIndex; ++nextPageIndex) { // the pages the item continues in
+        sPageFirstSlots[nextPageIndex] = slot;
+        sPageItemCounts[nextPageIndex] = 0u;
+      }
+      ++slot;
+    });
+    sFirstUsablePage = endPageIndex;
+    sFirstUsableByteIndex = endByteIndex;
+    return result;
+  }
+
+  /// Erases the sectors of each copy from the one after aPageCount up to aOldPageCount, if not erased yet, so that
+  /// boot does not find items there.
+  static bool eraseUnusedSectors(uint32_t const aPageCount, uint32_t const aOldPageCount) noexcept {
+    bool ok = true;
+    uint32_t const endSector = (aOldPageCount + cSectorSizeInPages - 1u) / cSectorSizeInPages;
+    for(uint32_t copyOffsetInPages = 0u; ok && copyOffsetInPages < tPagesNeeded; copyOffsetInPages += cCopySizeInPages) {
+      uint16_t * const sectorStates = getSectorStates(copyOffsetInPages);
+      for(uint32_t sector = (aPageCount + cSectorSizeInPages - 1u) / cSectorSizeInPages; ok && sector < endSector; ++sector) {
+        if(sectorStates[sector] != 0u) {
+          ok = (waitWhileBusy() == SpiResult::cOk && startEraseSector((sStartPage + copyOffsetInPages) / cSectorSizeInPages + sector) == SpiResult::cOk);
+          sectorStates[sector] = (ok ? 0u : cUnusedValue);
+          ++sStatistics.mSectorEraseCount;
+        }
+        else { // nothing to do
+        }
+      }
+    }
+    return waitWhileBusy() == SpiResult::cOk && ok;
+  }
+
+  /// The item count stored in the page header, where ffff means that no item starts in the page.
+  static uint16_t getStoredItemCount(uint16_t const aItemCount) noexcept {
+    return (cSpanning && aItemCount == 0u ? cUnusedValue : aItemCount);
+  }
+
+  static void setDirtyPages(CacheItem const &aItem) noexcept {
+    forItemParts(aItem.getPageIndex(), aItem.getDataOffsetInFirstPage(), aItem.getCount(), [](uint32_t const aPageIndex, uint32_t, uint32_t, uint32_t){
+      setBit(sDirtyPages, aPageIndex);
+    });
+  }
+
+  static void updateValue(CacheItem &aItem, uint8_t const * const aData) noexcept {
+    forItemParts(aItem.getPageIndex(), aItem.getDataOffsetInFirstPage(), aItem.getCount(), [&aItem, aData](uint32_t const aPageIndex, uint32_t const aOffsetInPage, uint32_t const aOffsetInItem, uint32_t const aCount){
+      storeShared(sPageChecksums[aPageIndex], updateChecksum(sPageChecksums[aPageIndex], aOffsetInPage, aItem.getData() + aOffsetInItem, aData + aOffsetInItem, aCount));
+    });
+    copyShared(aData, aItem.getCount(), const_cast<uint8_t*>(aItem.getData()));
+  }
+
+  static void readAll() {
+    if constexpr(cLazy) {
+      readIndex();
+    }
+    else if constexpr(cAlternating) {
+      readNewestCopy();
+    }
+    else {
+      readCopies();
+    }
+    if(cArena) {
+      resizeArena(sArenaUsed + cPageSizeInBytes - sFirstUsableByteIndex); // room for the items fitting the last page
+    }
+    else { // nothing to do
+    }
+  }
+
+  /// Arena storage only. Bump-allocates, and grows the arena when needed, moving all the values.
+  static ArenaOffset allocateValue(uint16_t const aCount) {
+    ArenaOffset const result = sArenaUsed;
+    if(sArenaUsed + aCount > sArenaSize) {
+      resizeArena(std::min(cArenaMaxSize, std::max(sArenaUsed + aCount, sArenaSize * 2u)));
+    }
+    else { // nothing to do
+    }
+    sArenaUsed += aCount;
+    return result;
+  }
+
+  static void resizeArena(uint32_t const aSize) {
+    uint32_t const size = std::min(cArenaMaxSize, std::max(aSize, 1u));
+    if(size != sArenaSize) {
+      uint8_t * const arena = tInterface::template _newArray<uint8_t>(size);
+      std::copy_n(sArena, sArenaUsed, arena);
+      tInterface::template _deleteArray<uint8_t>(sArena);
+      sArena = arena;
+      sArenaSize = size;
+    }
+    else { // nothing to do
+    }
+  }
+
+  /// Lazy boot only. Reads the values of the page if not yet done, together with the following ones fitting the
+  /// read ahead buffer. Must be called before the page is modified or serialized.
+  static void ensureLoaded(uint32_t const aPageIndex) {
+    if constexpr(cLazy) {
+      if(aPageIndex < sLazyPageCount && !isBitSet(sLoadedPages, aPageIndex)) {
+        loadPages(aPageIndex);
+      }
+      else { // nothing to do
+      }
+    }
+    else { // nothing to do
+    }
+  }
+
+  /// Seqlock only. The writer side: waits for the other writer of the page, if any, and makes the sequence odd.
+  static uint32_t lockPage(uint32_t const aPageIndex) noexcept {
+    std::atomic<uint32_t> &sequence = sPageSequences[aPageIndex];
+    uint32_t expected = sequence.load(std::memory_order_relaxed);
+    do {
+      while((expected & 1u) != 0u) {
+        expected = sequence.load(std::memory_order_relaxed);
+      }
+    } while(!sequence.compare_exchange_weak(expected, expected + 1u, std::memory_order_acquire, std::memory_order_relaxed));
+    std::atomic_thread_fence(std::memory_order_release);
+    return expected;
+  }
+
+  /// Seqlock only. The sequence is restored if the page did not change, so that commit won't write it.
+  static void unlockPage(uint32_t const aPageIndex, uint32_t const aSequence, bool const aChanged) noexcept {
+    sPageSequences[aPageIndex].store(aChanged ? aSequence + 2u : aSequence, std::memory_order_release);
+  }
+
+  /// The reader side: repeats aFunction until the page did not change during it. Returns the sequence read.
+  template<typename tFunction>
+  static uint32_t readPage(uint32_t const aPageIndex, tFunction aFunction) noexcept {
+    uint32_t result = 0u;
+    if constexpr(cSeqlock) {
+      std::atomic<uint32_t> &sequence = sPageSequences[aPageIndex];
+      uint32_t after;
+      uint32_t attemptCount = 0u;
+      do {
+        ++attemptCount;
+        result = sequence.load(std::memory_order_acquire);
+        if((result & 1u) == 0u) {
+          aFunction();
+        }
+        else { // nothing to do
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = sequence.load(std::memory_order_relaxed);
+      } while((result & 1u) != 0u || result != after);
+      if(attemptCount > 1u) {
+        sRetriedReadCount.fetch_add(1u, std::memory_order_relaxed);
+      }
+      else { // nothing to do
+      }
+    }
+    else {
+      aFunction();
+    }
+    return result;
+  }
+
+  /// In seqlock mode, readConfig and commit copy the values and page checksums while setConfig may change them, so
+  /// both sides access them with relaxed atomics. A torn copy is then discarded by the sequence check without a data
+  /// race. Before C++20 std::atomic_ref, this relies on the GCC / Clang atomic builtins working on plain objects.
+  template<typename tValue>
+  static tValue loadShared(tValue const &aValue) noexcept {
+    if constexpr(cSeqlock) {
+#if defined(__cpp_lib_atomic_ref)
+      return std::atomic_ref<tValue>(const_cast<tValue&>(aValue)).load(std::memory_order_relaxed);
+#elif defined(__GNUC__) || defined(__clang__)
+      return __atomic_load_n(&aValue, __ATOMIC_RELAXED);
+#else
+      static_assert(!cSeqlock, "FlashConfig seqlock needs std::atomic_ref or the GCC atomic builtins.");
+      return aValue;
+#endif
+    }
+    else {
+      return aValue;
+    }
+  }
+
+  template<typename tValue>
+  static void storeShared(tValue &aValue, tValue const aNew) noexcept {
+    if constexpr(cSeqlock) {
+#if defined(__cpp_lib_atomic_ref)
+      std::atomic_ref<tValue>(aValue).store(aNew, std::memory_order_relaxed);
+#elif defined(__GNUC__) || defined(__clang__)
+      __atomic_store_n(&aValue, aNew, __ATOMIC_RELAXED);
+#else
+      static_assert(!cSeqlock, "FlashConfig seqlock needs std::atomic_ref or the GCC atomic builtins.");
+      aValue = aNew;
+#endif
+    }
+    else {
+      aValue = aNew;
+    }
+  }
+
+  static void copyShared(uint8_t const * const aSource, uint32_t const aCount, uint8_t * const aDestination) noexcept {
+    if constexpr(cSeqlock) {
+      for(uint32_t i = 0u; i < aCount; ++i) {
+        storeShared(aDestination[i], loadShared(aSource[i]));
+      }
+    }
+    else {
+      std::copy_n(aSource, aCount, aDestination);
+    }
+  }
+
+  /// Seqlock only. setConfig doesn't touch the dirty bitset, as it belongs to commit. Instead, the pages changed
+  /// since their last serialization are found here.
+  static void markChangedPagesDirty() noexcept {
+    uint32_t const endPage = std::min(cBaseSizeInPages, sFirstUsablePage + 1u);
+    for(uint32_t page = 0u; page < endPage; ++page) {
+      if(sPageSequences[page].load(std::memory_order_acquire) != sCommittedSequences[page]) {
+        setBit(sDirtyPages, page);
+      }
+      else { // nothing to do
+      }
+    }
+  }
+
+  /// Lazy boot only. A sector needing erase is serialized completely, so all its pages must be loaded.
+  static void loadDirtySectors() {
+    uint32_t const endPage = std::min(cBaseSizeInPages, sLazyPageCount);
+    uint32_t dirtyPage = findNextSetBit(sDirtyPages, 0u, endPage);
+    while(dirtyPage != endPage) {
+      uint32_t const sectorEndPage = std::min(endPage, (dirtyPage / cSectorSizeInPages + 1u) * cSectorSizeInPages);
+      for(uint32_t page = dirtyPage / cSectorSizeInPages * cSectorSizeInPages; page < sectorEndPage; ++page) {
+        ensureLoaded(page);
+      }
+      dirtyPage = findNextSetBit(sDirtyPages, sectorEndPage, endPage);
+    }
+  }
+
+  /// Lazy boot only. Reads the page and item headers with short reads in mapped mode if possible, otherwise the page
+  /// holding them into the read ahead buffer, one page at a time so that nothing after the last used page is read.
+  /// So without mapped mode, the boot still reads every used page, and saves only verifying and copying the values.
+  class HeaderReader final {
+  private:
+    bool     mMapped;
+    uint32_t mBufferPage; // absolute
+
+  public:
+    HeaderReader() noexcept : mMapped(tInterface::canMapMemory() && tInterface::setMappedMode(true) == SpiResult::cOk), mBufferPage(cFlashSizeInPages) {
+    }
+
+    ~HeaderReader() {
+      if(mMapped) {
+        tInterface::setMappedMode(false);
+      }
+      else { // nothing to do
+      }
+    }
+
+    bool read(uint32_t const aPage, uint16_t const aOffset, uint16_t const aCount, uint8_t * const aData) noexcept {
+      bool ok = true;
+      if(mMapped) {
+        ok = (tInterface::readMapped(aPage * cPageSizeInBytes + aOffset, static_cast<uint8_t>(aCount), aData) == SpiResult::cOk);
+      }
+      else {
+        if(aPage != mBufferPage) {
+          ok = (tInterface::readPages(aPage, 1u, sReadAheadBuffer) == SpiResult::cOk);
+          mBufferPage = (ok ? aPage : cFlashSizeInPages);
+        }
+        else { // nothing to do
+        }
+        if(ok) {
+          std::copy_n(sReadAheadBuffer + aOffset, aCount, aData);
+        }
+        else { // nothing to do
+        }
+      }
+      return ok;
+    }
+  };
+
+  static void readIndex();
+  static ReadResult readIndexOfCopy(HeaderReader &aReader, uint32_t const aCopyOffsetInPages, Task const aTask, uint32_t &aDigest);
+  static void loadPages(uint32_t const aPageIndex);
+  static void readCopies();
+  static void readNewestCopy();
+  static void readSeal(uint32_t const aCopyIndex, Seal &aSeal);
+  static ReadResult readSealedCopy(uint32_t const aCopyIndex, Seal const &aSeal);
+  static void loadPendingPages(uint32_t const aCopyIndex, Seal const &aSeal);
+  static bool writeSeal(uint32_t const aCopyIndex, SealKind const aKind) noexcept;
+  static bool commitOlderCopy() noexcept;
+  static ReadResult readAcopy(uint32_t const aCopyOffsetInPages, Task const aTask);
+  static ReadResult processPage(uint8_t const * const aPage, uint32_t const aPageIndexRelCopy, Task const aTask) noexcept;
+  static ReadResult readJournal(uint32_t const aCopyOffsetInPages, Task const aTask);
+  static ReadResult processJournalPage(uint8_t const * const aPage, Task const aTask) noexcept;
+  static bool commitSectors(uint32_t const aCopyOffsetBegin, uint32_t const aCopyOffsetEnd, bool const aFromFirstCopy = false) noexcept;
+  static void serialize(uint32_t const aPageIndex, uint8_t * const aPage) noexcept;
+  static uint32_t countJournalPages() noexcept;
+  static uint32_t countPagesWithItems() noexcept {
+    return sFirstUsableByteIndex > cOffsetPageItems ? sFirstUsablePage + 1u : sFirstUsablePage;
+  }
+
+  static uint32_t calculateDigest(uint32_t const aPageCount) noexcept {
+    uint32_t result = 0u;
+    for(uint32_t i = 0u; i < aPageCount; ++i) {
+      result = result * cDigestFactor + sPageChecksums[i];
+    }
+    return result;
+  }
+
+  static uint16_t serializeJournalPage(uint16_t const aFirstId, uint8_t * const aPage) noexcept;
+  static bool appendJournal() noexcept;
+  static bool foldJournal() noexcept;
+};
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint16_t FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::addConfig(uint8_t const * const aData, uint16_t const aCount) {
+  uint16_t id = cUnusedValue;
+  if(aCount > cMaxItemSize) {
+    tInterface::fatalError(FlashException::cConfigItemTooBig);
+  }
+  else if(sNextId >= cUnusedValue) {
+    tInterface::fatalError(FlashException::cConfigInvalidId);
+  }
+  else {
+    uint32_t page = sFirstUsablePage;
+    uint32_t byteIndex = sFirstUsableByteIndex;
+    placeItem(aCount, page, byteIndex);
+    uint32_t lastPage = page;
+    uint32_t endByteIndex = byteIndex;
+    skipItem(aCount, lastPage, endByteIndex);
+    if(lastPage < cBaseSizeInPages) {
+      ensureLoaded(page);
+      bool const newPage = (byteIndex == cOffsetPageItems);
+      uint16_t const oldItemCount = (newPage ? 0u : sPageItemCounts[page]);
+      id = sNextId++;
+      if(cHotTail) {
+        sSlotIds[id] = id; // all the items before have a slot
+      }
+      else { // nothing to do
+      }
+      if(newPage) {
+        sPageFirstSlots[page] = id;
+      }
+      else { // nothing to do
+      }
+      sPageItemCounts[page] = oldItemCount + 1u;
+      CacheItem& item = sCache[id];
+      item.init(page, byteIndex + cOffsetItemData, aCount);
+      uint16_t checksum = (newPage ? cEmptyPageChecksum : sPageChecksums[page]);
+      uint8_t header[cOffsetItemData];
+      setValue<uint16_t>(header + cOffsetItemId, id);
+      setValue<uint16_t>(header + cOffsetItemCount, aCount);
+      checksum = updateChecksum(checksum, byteIndex, cErasedByte, header, cOffsetItemData);
+      uint8_t oldPageCount[sizeof(uint16_t)];
+      uint8_t newPageCount[sizeof(uint16_t)];
+      setValue<uint16_t>(oldPageCount, newPage ? 0u : getStoredItemCount(oldItemCount));
+      setValue<uint16_t>(newPageCount, oldItemCount + 1u);
+      sPageChecksums[page] = updateChecksum(checksum, cOffsetPageCount, oldPageCount, newPageCount, sizeof(uint16_t));
+      forItemParts(page, byteIndex + cOffsetItemData, aCount, [page, id, aData](uint32_t const aPageIndex, uint32_t const aOffsetInPage, uint32_t const aOffsetInItem, uint32_t const aPartCount){
+        if(aPageIndex != page) {
+          sPageChecksums[aPageIndex] = cContinuationPageChecksum;
+          sPageFirstSlots[aPageIndex] = id;
+          sPageItemCounts[aPageIndex] = 0u;
+        }
+        else { // nothing to do
+        }
+        sPageChecksums[aPageIndex] = updateChecksum(sPageChecksums[aPageIndex], aOffsetInPage, cErasedByte, aData + aOffsetInItem, aPartCount);
+        setBit(sDirtyPages, aPageIndex);
+      });
+      sFirstUsablePage = lastPage;
+      sFirstUsableByteIndex = endByteIndex;
+      item.setData(aData);
+    }
+    else {
+      tInterface::fatalError(FlashException::cConfigFull);
+    }
+  }
+  return id;
+}
+  
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+void FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::setConfig(uint16_t const aId, uint8_t const * const aData) {
+  if(aId >= sNextId) {
+    tInterface::fatalError(FlashException::cConfigInvalidId);
+  }
+  else {
+    CacheItem& item = sCache[aId];
+    ensureLoaded(item.getPageIndex());
+    if constexpr(cSeqlock) {
+      uint32_t const sequence = lockPage(item.getPageIndex());
+      bool const changed = !item.doesMatch(aData);
+      if(changed) {
+        countUpdate(aId); // under the lock of the page
+        updateValue(item, aData);
+      }
+      else { // nothing to do
+      }
+      unlockPage(item.getPageIndex(), sequence, changed);
+    }
+    else if(!item.doesMatch(aData)) {  
+      if(cJournal) {
+        setBit(sDirtyItems, aId);
+      }
+      else {
+        setDirtyPages(item);
+      }
+      countUpdate(aId);
+      updateValue(item, aData);
+    }
+    else { // nothing to do
+    }
+  }
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+void FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::readIndex() {
+  // Only the page and item headers are read, and the copies are compared by the digest of their stored page
+  // checksums. The values are read and the checksums verified by loadPages on first access.
+  clear();
+  std::fill_n(sSectorStates, cCopySizeInSectors * cCopyCount, cUnusedValue);
+  std::fill_n(sLoadedPages, cDirtyWordCount, 0u);
+  sLazyCopyOffset = 0u;
+  uint32_t digest1;
+  uint32_t digest2 = 0u;
+  ReadResult result1;
+  ReadResult result2 = ReadResult::cOk;
+  {
+    HeaderReader reader;
+    result1 = readIndexOfCopy(reader, 0u, Task::cCopy, digest1);
+    if(cCopyCount == 2u && result1 != ReadResult::cOk) {
+      clear();
+      result2 = readIndexOfCopy(reader, cCopySizeInPages, Task::cCopy, digest2);
+    }
+    else if(cCopyCount == 2u) {
+      result2 = readIndexOfCopy(reader, cCopySizeInPages, Task::cCheck, digest2);
+    }
+    else { // nothing to do
+    }
+  }
+  if(cCopyCount == 2u && result1 == ReadResult::cOk && result2 == ReadResult::cOk && digest1 != digest2) {
+    clear();
+    tInterface::fatalError(FlashException::cConfigCopiesMismatch);
+  }
+  else if(result1 == ReadResult::cOk && result2 != ReadResult::cOk) {
+    tInterface::fatalError(FlashException::cConfigBadCopy2);
+  }
+  else if(result1 != ReadResult::cOk && result2 == ReadResult::cOk && cCopyCount == 2u) {
+    sLazyCopyOffset = cCopySizeInPages;
+    tInterface::fatalError(FlashException::cConfigBadCopy1);
+  }
+  else if(result1 != ReadResult::cOk) {
+    clear();
+    tInterface::fatalError(FlashException::cConfigBadCopies);
+  }
+  else { // nothing to do
+  }
+  sLazyPageCount = countPagesWithItems();
+  if(result1 == ReadResult::cOk) {
+    std::fill_n(getSectorStates(0u), sLazyPageCount / cSectorSizeInPages, cSectorSizeInPages);
+  }
+  else { // nothing to do
+  }
+  if(cCopyCount == 2u && result2 == ReadResult::cOk) {
+    std::fill_n(getSectorStates(cCopySizeInPages), sLazyPageCount / cSectorSizeInPages, cSectorSizeInPages);
+  }
+  else { // nothing to do
+  }
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+typename FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::ReadResult FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::readIndexOfCopy(HeaderReader &aReader, uint32_t const aCopyOffsetInPages, Task const aTask, uint32_t &aDigest) {
+  // With cCheck, only the page headers are read for the digest.
+  ReadResult result = ReadResult::cOk;
+  aDigest = 0u;
+  for(uint32_t page = 0u; result == ReadResult::cOk && page < cBaseSizeInPages; ++page) {
+    uint32_t const absolutePage = sStartPage + aCopyOffsetInPages + page;
+    uint8_t header[cOffsetPageItems];
+    if(!aReader.read(absolutePage, cOffsetPageMagic, cOffsetPageItems, header)) {
+      result = ReadResult::cTransferError;
+    }
+    else if(is<Magic::cErased>(header[cOffsetPageMagic])) {
+      break;
+    }
+    else {
+      uint16_t itemCount = getValue<uint16_t>(header + cOffsetPageCount);
+      uint16_t const checksum = getValue<uint16_t>(header + cOffsetPageChecksum);
+      aDigest = aDigest * cDigestFactor + checksum;
+      if(!is<Magic::cConfig>(header[cOffsetPageMagic]) || itemCount == 0u || itemCount == cUnusedValue) {
+        result = ReadResult::cErrorConsistency;
+      }
+      else if(aTask == Task::cCopy) {
+        sPageChecksums[page] = checksum;
+        sPageFirstSlots[page] = sNextId;
+        sPageItemCounts[page] = itemCount;
+        sFirstUsablePage = page;
+        uint16_t itemStart = cOffsetPageItems;
+        for(; result == ReadResult::cOk && itemCount > 0u; --itemCount) {
+          uint8_t itemHeader[cOffsetItemData];
+          if(!aReader.read(absolutePage, itemStart, cOffsetItemData, itemHeader)) {
+            result = ReadResult::cTransferError;
+          }
+          else {
+            uint16_t const id = getValue<uint16_t>(itemHeader + cOffsetItemId);
+            uint16_t const count = getValue<uint16_t>(itemHeader + cOffsetItemCount);
+            if(id != sNextId || id >= tMaxItemCount || static_cast<uint32_t>(itemStart + cOffsetItemData + count) > cPageSizeInBytes) {
+              result = ReadResult::cErrorConsistency;
+            }
+            else {
+              itemStart += cOffsetItemData;
+              sCache[id].init(page, itemStart, count);
+              ++sNextId;
+              itemStart += count;
+              sFirstUsableByteIndex = itemStart;
+            }
+          }
+        }
+      }
+      else { // nothing to do
+      }
+    }
+  }
+  return result;
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+void FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::loadPages(uint32_t const aPageIndex) {
+  // processPage verifies the checksum and copies the values, but it also updates some fields only valid during boot.
+  uint32_t const firstUsablePage = sFirstUsablePage;
+  uint16_t const firstUsableByteIndex = sFirstUsableByteIndex;
+  uint16_t const nextId = sNextId;
+  uint32_t const pageCount = std::min(tReadAheadSizeInPages, sLazyPageCount - aPageIndex);
+  bool ok = (tInterface::readPages(sStartPage + sLazyCopyOffset + aPageIndex, pageCount, sReadAheadBuffer) == SpiResult::cOk);
+  for(uint32_t i = 0u; ok && i < pageCount; ++i) {
+    uint32_t const pageIndex = aPageIndex + i;
+    uint8_t * const page = sReadAheadBuffer + i * cPageSizeInBytes;
+    if(!isBitSet(sLoadedPages, pageIndex)) {
+      ReadResult result = processPage(page, pageIndex, Task::cCopy);
+      if(result != ReadResult::cOk && cCopyCount == 2u) {
+        ok = (tInterface::readPages(sStartPage + cCopySizeInPages - sLazyCopyOffset + pageIndex, 1u, page) == SpiResult::cOk);
+        result = (ok ? processPage(page, pageIndex, Task::cCopy) : result);
+        tInterface::fatalError(result != ReadResult::cOk ? FlashException::cConfigBadCopies : (sLazyCopyOffset == 0u ? FlashException::cConfigBadCopy1 : FlashException::cConfigBadCopy2));
+      }
+      else if(result != ReadResult::cOk) {
+        tInterface::fatalError(FlashException::cConfigBadCopies);
+      }
+      else { // nothing to do
+      }
+      if(ok && result != ReadResult::cOk) {
+        // The values are taken as they are, and the checksum will match them, so that the application can correct
+        // them and commit. Unlike on full boot, the other items are already in use and can't be cleared.
+        for(uint16_t id = sPageFirstSlots[pageIndex]; id < sPageFirstSlots[pageIndex] + sPageItemCounts[pageIndex]; ++id) {
+          sCache[id].setData(page + sCache[id].getDataOffsetInFirstPage());
+        }
+        serialize(pageIndex, page);
+        sPageChecksums[pageIndex] = calculateChecksum(page);
+      }
+      else { // nothing to do
+      }
+      setBit(sLoadedPages, pageIndex); // even if bad, so that the error is reported only once
+    }
+    else { // nothing to do
+    }
+  }
+  sFirstUsablePage = firstUsablePage;
+  sFirstUsableByteIndex = firstUsableByteIndex;
+  sNextId = nextId;
+  if(!ok) {
+    tInterface::fatalError(FlashException::cFlashTransferError);
+  }
+  else { // nothing to do
+  }
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+void FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::readCopies() {
+  clear();
+  ReadResult result1 = readAcopy(0u, Task::cCopy);
+  uint32_t firstUsablePage1 = sFirstUsablePage;
+  uint16_t firstUsableByteIndex1 = sFirstUsableByteIndex;
+  if(cCopyCount == 2u) {
+    ReadResult result2;
+    if(result1 != ReadResult::cOk) {
+      clear();
+      result2 = readAcopy(cCopySizeInPages, Task::cCopy);
+    }
+    else { // nothing to do
+      result2 = readAcopy(cCopySizeInPages, Task::cCheck);
+      // a copy ending elsewhere is as different as other values, as the copies are written one after the other
+      result2 = (result2 == ReadResult::cOk && (sFirstUsablePage != firstUsablePage1 || sFirstUsableByteIndex != firstUsableByteIndex1) ? ReadResult::cErrorMismatch : result2);
+    }
+
+    if(result1 == ReadResult::cOk && result2 == ReadResult::cErrorMismatch) {
+      sFirstUsablePage = 0u;
+      sFirstUsableByteIndex = cOffsetPageItems;
+      clear();
+      tInterface::fatalError(FlashException::cConfigCopiesMismatch);
+    }
+    else if(result1 == ReadResult::cOk && result2 != ReadResult::cOk) {
+      sFirstUsablePage = firstUsablePage1;
+      sFirstUsableByteIndex = firstUsableByteIndex1;
+      tInterface::fatalError(FlashException::cConfigBadCopy2);
+    }
+    else if(result1 != ReadResult::cOk && result2 == ReadResult::cOk) {
+      tInterface::fatalError(FlashException::cConfigBadCopy1);
+    }
+    else if(result1 != ReadResult::cOk && result2 != ReadResult::cOk) {
+      sFirstUsablePage = 0u;
+      sFirstUsableByteIndex = cOffsetPageItems;
+      clear();
+      tInterface::fatalError(FlashException::cConfigBadCopies);
+    }
+    else { // nothing to do
+    }
+    sJournalObsolete = (sJournalObsolete || result1 != ReadResult::cOk || result2 != ReadResult::cOk);
+  }
+  else {
+    if(result1 != ReadResult::cOk) {
+      sFirstUsablePage = 0u;
+      sFirstUsableByteIndex = cOffsetPageItems;
+      clear();
+      tInterface::fatalError(FlashException::cConfigBadCopies);
+    }
+    else { // nothing to do
+    }
+    sJournalObsolete = (sJournalObsolete || result1 != ReadResult::cOk);
+  }
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+typename FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::ReadResult FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::readAcopy(uint32_t const aCopyOffsetInPages, Task const aTask) {
+  uint32_t pagesRead = 0u;
+  uint32_t pagesLeftInBuffer = 0u;
+  uint32_t bufferStartPage;
+  uint32_t pageIndex;
+  sFirstUsablePage = 0u;
+  sFirstUsableByteIndex = cOffsetPageItems;
+  sSpanningLeft = 0u;
+  std::fill_n(getSectorStates(aCopyOffsetInPages), cCopySizeInSectors, cUnusedValue);
+  ReadResult result = ReadResult::cOk; 
+  while(result == ReadResult::cOk) {
+    if(pagesLeftInBuffer == 0u) {
+      pagesLeftInBuffer = std::min(tReadAheadSizeInPages, cBaseSizeInPages - pagesRead);
+      if(tInterface::readPages(sStartPage + aCopyOffsetInPages + pagesRead, pagesLeftInBuffer, sReadAheadBuffer) != SpiResult::cOk) {
+        result = ReadResult::cTransferError;
+        break;
+      }
+      else { // nothing to do
+      }
+      bufferStartPage = pagesRead;
+      pagesRead += pagesLeftInBuffer;
+      pageIndex = 0u;
+    }
+    else { // nothing to do
+    }
+    if(pagesLeftInBuffer > 0u) {
+      while(result == ReadResult::cOk && pagesLeftInBuffer > 0u) {
+        ReadResult tmp = processPage(sReadAheadBuffer + pageIndex * cPageSizeInBytes, bufferStartPage + pageIndex, aTask);
+        result = (result == ReadResult::cOk ? tmp : result);
+        if(result != ReadResult::cOk) {
+          initSectorStates(aCopyOffsetInPages, bufferStartPage + pageIndex, bufferStartPage, pageIndex + pagesLeftInBuffer, result == ReadResult::cErased);
+        }
+        else { // nothing to do
+        }
+        --pagesLeftInBuffer;
+        ++pageIndex;
+      }
+    }
+    else {
+      initSectorStates(aCopyOffsetInPages, cBaseSizeInPages, cBaseSizeInPages, 0u, false);
+      break;
+    }
+  }
+  result = (result == ReadResult::cErased ? ReadResult::cOk : result);
+  result = (result == ReadResult::cOk && sSpanningLeft > 0u ? ReadResult::cErrorConsistency : result); // the last item was cut
+  result = (result == ReadResult::cOk && cHotTail && aTask == Task::cCopy && sPlacedCount != sNextId ? ReadResult::cErrorConsistency : result); // an id is missing
+  if(cJournal && result == ReadResult::cOk) {
+    result = readJournal(aCopyOffsetInPages, aTask);
+  }
+  else { // nothing to do
+  }
+  return result;
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+typename FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::ReadResult FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::processPage(uint8_t const * const aPage, uint32_t const aPageIndexRelCopy, Task const aTask) noexcept {
+  ReadResult result = ReadResult::cOk;
+  if(is<Magic::cErased>(aPage[cOffsetPageMagic])) {
+    result = ReadResult::cErased;
+  }
+  else if(is<Magic::cConfig>(aPage[cOffsetPageMagic])) {
+    uint16_t newItemStart = cOffsetPageItems;
+    uint16_t itemCount = getValue<uint16_t>(aPage + cOffsetPageCount);
+    bool const continuation = (cSpanning && sSpanningLeft > 0u); // the page starts with the rest of the last item
+    itemCount = ((continuation || cHotTail) && itemCount == cUnusedValue ? 0u : itemCount); // hot-tail placement may have pages without items
+    uint16_t const pageItemCount = itemCount;
+    uint16_t const firstId = (continuation ? sSpanningId : getValue<uint16_t>(aPage + cOffsetPageItems + cOffsetItemId));
+    uint16_t const firstSlot = (cHotTail ? (continuation ? sPlacedCount - 1u : sPlacedCount) : firstId);
+    uint16_t const checksum = calculateChecksum(aPage);
+    if(checksum != getValue<uint16_t>(aPage + cOffsetPageChecksum)) {
+      result = ReadResult::cErrorChecksum;
+    }
+    else if((itemCount == 0u && !continuation && !cHotTail) || itemCount == cUnusedValue) {
+      result = ReadResult::cErrorConsistency;
+    }
+    else {
+      sFirstUsablePage = aPageIndexRelCopy;
+      if(continuation) {
+        CacheItem& item = sCache[firstId];
+        uint16_t const count = std::min<uint16_t>(sSpanningLeft, cPageItemSpace);
+        uint32_t const offsetInItem = item.getCount() - sSpanningLeft;
+        if(aTask == Task::cCopy) {
+          item.setData(aPage + newItemStart, offsetInItem, count);
+        }
+        else if(!item.doesMatch(aPage + newItemStart, offsetInItem, count)) {
+          result = ReadResult::cErrorMismatch;
+        }
+        else { // nothing to do
+        }
+        sSpanningLeft -= count;
+        newItemStart += count;
+        sFirstUsableByteIndex = newItemStart;
+        result = (sSpanningLeft > 0u && itemCount > 0u ? ReadResult::cErrorConsistency : result);
+      }
+      else {
+        sFirstUsableByteIndex = newItemStart; // remains for a page without items
+      }
+      while(result == ReadResult::cOk && itemCount > 0u) {
+        uint8_t const * rawItemPointer = aPage + newItemStart;
+        if(static_cast<uint32_t>(newItemStart + cOffsetItemData) > cPageSizeInBytes) {
+          result = ReadResult::cErrorConsistency;
+          break;
+        }
+        else { // nothing to do
+        }
+        uint16_t id = getValue<uint16_t>(rawItemPointer + cOffsetItemId);
+        uint16_t count = getValue<uint16_t>(rawItemPointer + cOffsetItemCount);
+        newItemStart += cOffsetItemData;
+        rawItemPointer = aPage + newItemStart;
+        if((newItemStart + count > cPageSizeInBytes && (!cSpanning || itemCount > 1u)) || (!cHotTail && id > sNextId) || id >= tMaxItemCount) {
+          result = ReadResult::cErrorConsistency;
           break;
         }
         else { // nothing to do
         }
-        if(id == sNextId && aTask == Task::cCopy) {
+        uint16_t const partCount = std::min<uint16_t>(count, cPageSizeInBytes - newItemStart); // only the last one may continue
+        sSpanningId = id;
+        sSpanningLeft = count - partCount;
+        if(aTask == Task::cCopy && (cHotTail ? !isBitSet(sPlacedItems, id) : id == sNextId)) {
           sCache[id].init(aPageIndexRelCopy, newItemStart, count);
-          ++sNextId;
+          if(cHotTail) {
+            setBit(sPlacedItems, id);
+            sSlotIds[sPlacedCount] = id;
+            ++sPlacedCount;
+            sNextId = std::max<uint16_t>(sNextId, id + 1u);
+          }
+          else {
+            ++sNextId;
+          }
         }
-        else if(id > sNextId || sCache[id].getCount() != count ) {
-          result = ReadResult::cErrorConsistency;
+        else if(id >= sNextId || sCache[id].getCount() != count || sCache[id].getPageIndex() != aPageIndexRelCopy || sCache[id].getDataOffsetInFirstPage() != newItemStart) {
+          // a copy with an other layout, like one left behind by an interrupted commit, is as different as other values
+          result = (aTask == Task::cCheck ? ReadResult::cErrorMismatch : ReadResult::cErrorConsistency);
+          break;
         }
         else { // nothing to do
         }
-        ConfigItem& item = sCache[id];
+        CacheItem& item = sCache[id];
         if(aTask == Task::cCopy) {
-          item.setData(rawItemPointer);
+          item.setData(rawItemPointer, 0u, partCount);
         }
-        else {
-          result = (item.doesMatch(rawItemPointer) ? ReadResult::cOk : ReadResult::cErrorMismatch);
+        else if(!(cJournal && isBitSet(sJournaledItems, id)) && !item.doesMatch(rawItemPointer, 0u, partCount)) { // journaled values were replayed from copy 1
+          result = ReadResult::cErrorMismatch;
         }
-        newItemStart += count;
-        sFirstUsableByteIndex = (aTask == Task::cCheckFf ? sFirstUsableByteIndex : newItemStart);
+        else { // nothing to do
+        }
+        newItemStart += partCount;
+        sFirstUsableByteIndex = newItemStart;
         --itemCount;
       }     
+      if(result == ReadResult::cOk && aTask == Task::cCopy) {
+        // the verified checksum turned into the one serialize would write, which has erased unused bytes
+        sPageChecksums[aPageIndexRelCopy] = checksum - calculateChecksumPart(aPage, newItemStart, cPageSizeInBytes) + calculateChecksumFill(cErasedByte, newItemStart, cPageSizeInBytes);
+        sPageFirstSlots[aPageIndexRelCopy] = firstSlot;
+        sPageItemCounts[aPageIndexRelCopy] = pageItemCount;
+      }
+      else { // nothing to do
+      }
     }
   }
   else {
@@ -451,125 +1622,626 @@ typename FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, t
   return result;
 }
 
-template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize>
-bool FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize>::commit(uint32_t const aCopyOffsetInPages) noexcept {
-  uint32_t const copySizeInPages = cCopySizeInPages;
-  uint32_t const globalEndPageIndex = std::min(copySizeInPages, sFirstUsablePage + 1u);
-  auto dirtyEnd = sDirtyPages + std::min(copySizeInPages, sFirstUsablePage + 1u);
-  auto dirtyIter = std::find(sDirtyPages, dirtyEnd, true);
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+void FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::initSectorStates(uint32_t const aCopyOffsetInPages, uint32_t const aStopPage, uint32_t const aBufferStartPage, uint32_t const aBufferPageCount, bool const aErased) noexcept {
+  // Sectors before the stop page are certainly programmed. The ones still in the read ahead buffer are examined,
+  // and the rest were not read and remain unknown.
+  uint16_t * const sectorStates = getSectorStates(aCopyOffsetInPages);
+  uint32_t const stopSector = aStopPage / cSectorSizeInPages;
+  std::fill_n(sectorStates, stopSector, cSectorSizeInPages);
+  uint32_t const bufferEndSector = (aBufferStartPage + aBufferPageCount) / cSectorSizeInPages;
+  for(uint32_t sector = stopSector; sector < bufferEndSector; ++sector) {
+    if(sector > stopSector || aErased) {
+      sectorStates[sector] = countProgrammedPages(sReadAheadBuffer + (sector * cSectorSizeInPages - aBufferStartPage) * cPageSizeInBytes);
+    }
+    else {
+      sectorStates[sector] = cSectorSizeInPages;
+    }
+  }
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+bool FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::readSectorStates(uint32_t const aCopyOffsetBegin, uint32_t const aCopyOffsetEnd, uint32_t const aSector, uint8_t * const aBuffer) noexcept {
   bool ok = true;
-  while(ok && dirtyIter != dirtyEnd) {
-    uint32_t const startSector = (dirtyIter - sDirtyPages) / cSectorSizeInPages;
-    uint32_t const startPage = startSector * cSectorSizeInPages;
-    uint32_t const endPage = std::min<uint32_t>(globalEndPageIndex, startPage + tReadAheadSizeInPages);
-    uint32_t const pageCount = endPage - startPage;
-    uint32_t const sectorCount = (pageCount + cSectorSizeInPages - 1u) / cSectorSizeInPages;
-    dirtyIter = std::find(sDirtyPages + endPage, dirtyEnd, true);
-    if(tInterface::readPages(sStartPage + aCopyOffsetInPages + startPage, pageCount, sReadAheadBuffer) != SpiResult::cOk) {
-      ok = false;
-      break;
+  for(uint32_t copyOffsetInPages = aCopyOffsetBegin; ok && copyOffsetInPages < aCopyOffsetEnd; copyOffsetInPages += cCopySizeInPages) {
+    uint16_t& sectorState = getSectorStates(copyOffsetInPages)[aSector];
+    if(sectorState == cUnusedValue) {
+      ok = (tInterface::readPages(sStartPage + copyOffsetInPages + aSector * cSectorSizeInPages, cSectorSizeInPages, aBuffer) == SpiResult::cOk);
+      sectorState = (ok ? countProgrammedPages(aBuffer) : cUnusedValue);
     }
     else { // nothing to do
     }
-    for(uint32_t sectorIndex = 0; ok && sectorIndex < sectorCount; ++sectorIndex) {
-      bool allErased = true;
-      bool somethingChanged = false;  
-      for(uint32_t pageIndex = 0; pageIndex < cSectorSizeInPages; ++pageIndex) {
-        uint32_t pageInReadAhead = pageIndex + sectorIndex * cSectorSizeInPages;
-        ReadResult result = processPage(sReadAheadBuffer + pageInReadAhead * cPageSizeInBytes, startPage + pageInReadAhead, Task::cCheckFf);
-        somethingChanged = (somethingChanged || result != ReadResult::cOk);
-        allErased =        (allErased        && result == ReadResult::cErased);
-      }
-      if(somethingChanged) {
-        if(allErased) {
-          for(uint32_t pageIndex = 0; ok && pageIndex < cSectorSizeInPages; ++pageIndex) {
-            uint32_t pageInReadAhead = pageIndex + sectorIndex * cSectorSizeInPages;
-            if(sDirtyPages[startPage + pageInReadAhead]) {
-              serialize(startPage, pageInReadAhead);
-              if(tInterface::writePage(sStartPage + aCopyOffsetInPages + startPage + pageInReadAhead, sReadAheadBuffer + pageInReadAhead * cPageSizeInBytes) != SpiResult::cOk) {
-                ok = false;
-              }
-              else { // nothing to do
-              }
-            }
-            else { // nothing to do
-            }
-          }
+  }
+  return ok;
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+void FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::serializeSector(uint32_t const aCopyOffsetBegin, uint32_t const aCopyOffsetEnd, uint32_t const aFirstDirtyPage, uint32_t const aEndPage, uint8_t * const aSlot) noexcept {
+  // must be called before the sector states change due to an erase
+  bool all = false;
+  for(uint32_t copyOffsetInPages = aCopyOffsetBegin; copyOffsetInPages < aCopyOffsetEnd; copyOffsetInPages += cCopySizeInPages) {
+    all = (all || needsErase(copyOffsetInPages, aFirstDirtyPage));
+  }
+  uint32_t const sectorStartPage = aFirstDirtyPage / cSectorSizeInPages * cSectorSizeInPages;
+  forPagesToWrite(aFirstDirtyPage, aEndPage, all, [aSlot, sectorStartPage](uint32_t const aPageIndex){
+    uint8_t * const page = aSlot + (aPageIndex - sectorStartPage) * cPageSizeInBytes;
+    uint32_t const sequence = readPage(aPageIndex, [aPageIndex, page](){
+      serialize(aPageIndex, page);
+    });
+    if(cSeqlock) {
+      sCommittedSequences[aPageIndex] = sequence;
+    }
+    else { // nothing to do
+    }
+    return true;
+  });
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+bool FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::programSector(uint32_t const aCopyOffsetInPages, uint32_t const aFirstDirtyPage, uint32_t const aEndPage, bool const aAll, uint8_t const * const aSlot) noexcept {
+  uint32_t const sector = aFirstDirtyPage / cSectorSizeInPages;
+  uint32_t const sectorStartPage = sector * cSectorSizeInPages;
+  uint16_t& sectorState = getSectorStates(aCopyOffsetInPages)[sector];
+  bool ok = forPagesToWrite(aFirstDirtyPage, aEndPage, aAll, [aCopyOffsetInPages, aSlot, sectorStartPage, &sectorState](uint32_t const aPageIndex){
+    sectorState = aPageIndex + 1u - sectorStartPage;
+    return waitWhileBusy() == SpiResult::cOk && startWritePage(sStartPage + aCopyOffsetInPages + aPageIndex, aSlot + (aPageIndex - sectorStartPage) * cPageSizeInBytes) == SpiResult::cOk;
+  });
+  if(!ok) {
+    sectorState = cUnusedValue;
+  }
+  else { // nothing to do
+  }
+  return ok;
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+bool FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::commitSectors(uint32_t const aCopyOffsetBegin, uint32_t const aCopyOffsetEnd, bool const aFromFirstCopy) noexcept {
+  // Sectors are committed one after the other. The callers pass a single copy, see commitCopies. A sector is serialized
+  // while its erase is in progress, and if the read ahead buffer has room for it, the next sector is serialized while
+  // the current one is written. With aFromFirstCopy, the sector is read from the first copy before the erase instead.
+  uint32_t const endPage = std::min(cBaseSizeInPages, sFirstUsablePage + 1u);
+  uint32_t dirtyPage = findNextSetBit(sDirtyPages, 0u, endPage);
+  uint32_t slotIndex = 0u;
+  bool serialized = false;
+  bool ok = true;
+  while(ok && dirtyPage != endPage) {
+    uint32_t const sector = dirtyPage / cSectorSizeInPages;
+    uint32_t const sectorEndPage = std::min(endPage, (sector + 1u) * cSectorSizeInPages);
+    uint32_t const nextDirtyPage = findNextSetBit(sDirtyPages, sectorEndPage, endPage);
+    uint32_t const nextSlotIndex = (slotIndex + 1u) % cSlotCount;
+    bool nextSerialized = false;
+    if(!serialized) {
+      ok = (waitWhileBusy() == SpiResult::cOk && readSectorStates(aCopyOffsetBegin, aCopyOffsetEnd, sector, sReadAheadBuffer + slotIndex * cSectorSizeInBytes));
+      if(ok && aFromFirstCopy) {
+        uint32_t const sectorStartPage = sector * cSectorSizeInPages;
+        ok = (tInterface::readPages(sStartPage + sectorStartPage, sectorEndPage - sectorStartPage, sReadAheadBuffer + slotIndex * cSectorSizeInBytes) == SpiResult::cOk);
+        serialized = true;
+      }
+      else { // nothing to do
+      }
+    }
+    else { // nothing to do
+    }
+    for(uint32_t copyOffsetInPages = aCopyOffsetBegin; ok && copyOffsetInPages < aCopyOffsetEnd; copyOffsetInPages += cCopySizeInPages) {
+      bool const erase = needsErase(copyOffsetInPages, dirtyPage);
+      ok = (waitWhileBusy() == SpiResult::cOk);
+      if(ok && erase) {
+        ok = (startEraseSector((sStartPage + copyOffsetInPages) / cSectorSizeInPages + sector) == SpiResult::cOk);
+        ++sStatistics.mSectorEraseCount;
+      }
+      else { // nothing to do
+      }
+      if(ok && !serialized) {
+        serializeSector(aCopyOffsetBegin, aCopyOffsetEnd, dirtyPage, sectorEndPage, sReadAheadBuffer + slotIndex * cSectorSizeInBytes);
+        serialized = true;
+      }
+      else { // nothing to do
+      }
+      if(ok && erase) {
+        getSectorStates(copyOffsetInPages)[sector] = 0u;
+      }
+      else { // nothing to do
+      }
+      if(ok && cSlotCount > 1u && !aFromFirstCopy && copyOffsetInPages + cCopySizeInPages == aCopyOffsetEnd && nextDirtyPage != endPage && areSectorStatesKnown(aCopyOffsetBegin, aCopyOffsetEnd, nextDirtyPage / cSectorSizeInPages)) {
+        serializeSector(aCopyOffsetBegin, aCopyOffsetEnd, nextDirtyPage, std::min(endPage, (nextDirtyPage / cSectorSizeInPages + 1u) * cSectorSizeInPages), sReadAheadBuffer + nextSlotIndex * cSectorSizeInBytes);
+        nextSerialized = true;
+      }
+      else { // nothing to do
+      }
+      if(ok) {
+        ok = programSector(copyOffsetInPages, dirtyPage, sectorEndPage, erase, sReadAheadBuffer + slotIndex * cSectorSizeInBytes);
+        ++sStatistics.mSectorWriteCount;
+      }
+      else {
+        getSectorStates(copyOffsetInPages)[sector] = cUnusedValue;
+      }
+    }
+    dirtyPage = nextDirtyPage;
+    slotIndex = (nextSerialized ? nextSlotIndex : slotIndex);
+    serialized = nextSerialized;
+  }
+  return waitWhileBusy() == SpiResult::cOk && ok;
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+void FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::readNewestCopy() {
+  // Only the seal sectors are read to find the newest completely written copy, and only that one is parsed. The older
+  // copy is parsed only if the newest one turns out to be bad.
+  clear();
+  Seal seals[cCopyCount];
+  for(uint32_t copyIndex = 0u; copyIndex < cCopyCount; ++copyIndex) {
+    readSeal(copyIndex, seals[copyIndex]);
+  }
+  std::fill_n(sSectorStates, cCopySizeInSectors * cCopyCount, cUnusedValue);
+  std::fill_n(sPendingPages, cDirtyWordCount, ~0u);
+  sGeneration = std::max(seals[0].mGeneration, seals[1].mGeneration);
+  uint32_t newest = (seals[1].mValid && (!seals[0].mValid || seals[1].mGeneration > seals[0].mGeneration) ? 1u : 0u);
+  uint32_t const older = 1u - newest;
+  ReadResult result = (seals[newest].mValid ? readSealedCopy(newest, seals[newest]) : ReadResult::cErrorConsistency);
+  if(result == ReadResult::cOk) {
+    if(seals[older].mValid && seals[older].mGeneration + 1u == seals[newest].mGeneration) {
+      loadPendingPages(newest, seals[newest]);
+    }
+    else if(!seals[older].mValid && !seals[older].mErased) {
+      tInterface::fatalError(older == 0u ? FlashException::cConfigBadCopy1 : FlashException::cConfigBadCopy2);
+    }
+    else { // nothing to do
+    }
+  }
+  else {
+    clear();
+    result = (seals[older].mValid ? readSealedCopy(older, seals[older]) : ReadResult::cErrorConsistency);
+    if(result == ReadResult::cOk) {
+      tInterface::fatalError(newest == 0u ? FlashException::cConfigBadCopy1 : FlashException::cConfigBadCopy2);
+      newest = older;
+    }
+    else {
+      clear();
+      if(!seals[0].mErased || !seals[1].mErased) {
+        tInterface::fatalError(FlashException::cConfigBadCopies);
+      }
+      else { // nothing to do
+      }
+    }
+  }
+  sNewestCopy = newest;
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+void FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::readSeal(uint32_t const aCopyIndex, Seal &aSeal) {
+  // The seal sector is written one page after the other, so the first erased page ends it. Anything else than seals
+  // makes it unusable until the next erase.
+  aSeal.mGeneration = 0u;
+  aSeal.mValid = false;
+  aSeal.mErased = false;
+  uint16_t& nextPage = sSealNextPages[aCopyIndex];
+  nextPage = cSectorSizeInPages;
+  if(tInterface::readPages(sStartPage + aCopyIndex * cCopySizeInPages + cCopySizeInPages - cSealSizeInPages, cSectorSizeInPages, sReadAheadBuffer) == SpiResult::cOk) {
+    bool broken = false;
+    for(uint16_t pageIndex = 0u; !broken && nextPage == cSectorSizeInPages && pageIndex < cSectorSizeInPages; ++pageIndex) {
+      uint8_t const * const page = sReadAheadBuffer + pageIndex * cPageSizeInBytes;
+      if(is<Magic::cErased>(page[cOffsetPageMagic])) {
+        nextPage = pageIndex;
+      }
+      else if(is<Magic::cConfigSeal>(page[cOffsetPageMagic]) && calculateChecksum(page) == getValue<uint16_t>(page + cOffsetPageChecksum)) {
+        aSeal.mGeneration = getValue<uint32_t>(page + cOffsetSealGeneration);
+        aSeal.mPageCount = getValue<uint32_t>(page + cOffsetSealPageCount);
+        aSeal.mDigest = getValue<uint32_t>(page + cOffsetSealDigest);
+        aSeal.mPageIndex = pageIndex;
+        aSeal.mValid = (static_cast<SealKind>(page[cOffsetSealKind]) == SealKind::cDone);
+      }
+      else {
+        broken = true;
+      }
+    }
+    aSeal.mValid = (aSeal.mValid && !broken);
+    aSeal.mErased = (nextPage == 0u);
+  }
+  else { // nothing to do
+  }
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+typename FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::ReadResult FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::readSealedCopy(uint32_t const aCopyIndex, Seal const &aSeal) {
+  ReadResult result = readAcopy(aCopyIndex * cCopySizeInPages, Task::cCopy);
+  if(result == ReadResult::cOk && (countPagesWithItems() != aSeal.mPageCount || calculateDigest(aSeal.mPageCount) != aSeal.mDigest)) {
+    result = ReadResult::cErrorConsistency;
+  }
+  else { // nothing to do
+  }
+  return result;
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+void FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::loadPendingPages(uint32_t const aCopyIndex, Seal const &aSeal) {
+  if(cSealHasWritten && tInterface::readPages(sStartPage + aCopyIndex * cCopySizeInPages + cCopySizeInPages - cSealSizeInPages + aSeal.mPageIndex, 1u, sReadAheadBuffer) == SpiResult::cOk) {
+    std::fill_n(sPendingPages, cDirtyWordCount, 0u);
+    for(uint32_t pageIndex = 0u; pageIndex < cBaseSizeInPages; ++pageIndex) {
+      if((sReadAheadBuffer[cOffsetSealWritten + pageIndex / 8u] & (1u << (pageIndex % 8u))) != 0u) {
+        setBit(sPendingPages, pageIndex);
+      }
+      else { // nothing to do
+      }
+    }
+  }
+  else { // nothing to do, all pages remain pending
+  }
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+bool FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::writeSeal(uint32_t const aCopyIndex, SealKind const aKind) noexcept {
+  uint32_t const sealStartPage = sStartPage + aCopyIndex * cCopySizeInPages + cCopySizeInPages - cSealSizeInPages;
+  uint16_t& nextPage = sSealNextPages[aCopyIndex];
+  bool ok = (waitWhileBusy() == SpiResult::cOk);
+  if(ok && nextPage == cSectorSizeInPages) {
+    ok = (startEraseSector(sealStartPage / cSectorSizeInPages) == SpiResult::cOk);
+    nextPage = 0u;
+  }
+  else { // nothing to do
+  }
+  uint8_t * const page = sReadAheadBuffer;
+  uint32_t const pageCount = countPagesWithItems();
+  std::fill_n(page, cPageSizeInBytes, 0u);
+  page[cOffsetPageMagic] = static_cast<uint8_t>(Magic::cConfigSeal);
+  setValue<uint16_t>(page + cOffsetPageCount, 1u);
+  page[cOffsetSealKind] = static_cast<uint8_t>(aKind);
+  setValue<uint32_t>(page + cOffsetSealGeneration, sGeneration + 1u);
+  setValue<uint32_t>(page + cOffsetSealPageCount, pageCount);
+  setValue<uint32_t>(page + cOffsetSealDigest, calculateDigest(pageCount));
+  if(cSealHasWritten) {
+    for(uint32_t pageIndex = findNextSetBit(sPendingPages, 0u, cBaseSizeInPages); pageIndex < cBaseSizeInPages; pageIndex = findNextSetBit(sPendingPages, pageIndex + 1u, cBaseSizeInPages)) {
+      page[cOffsetSealWritten + pageIndex / 8u] |= static_cast<uint8_t>(1u << (pageIndex % 8u));
+    }
+  }
+  else { // nothing to do
+  }
+  setValue<uint16_t>(page + cOffsetPageChecksum, calculateChecksum(page));
+  ok = (ok && waitWhileBusy() == SpiResult::cOk && startWritePage(sealStartPage + nextPage, page) == SpiResult::cOk && waitWhileBusy() == SpiResult::cOk);
+  nextPage = (ok ? nextPage + 1u : cSectorSizeInPages);
+  return ok;
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+bool FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::commitOlderCopy() noexcept {
+  // The older copy receives the pages dirty now and the ones written into the newest copy by the previous commit.
+  // The seal marks the start and the end of the commit, so a torn commit leaves the older copy invalid and the newest
+  // one intact.
+  bool ok = true;
+  if(findNextSetBit(sDirtyPages, 0u, cBaseSizeInPages) < cBaseSizeInPages) {
+    uint32_t const target = 1u - sNewestCopy;
+    for(uint32_t wordIndex = 0u; wordIndex < cDirtyWordCount; ++wordIndex) {
+      uint32_t const dirty = sDirtyPages[wordIndex];
+      sDirtyPages[wordIndex] |= sPendingPages[wordIndex];
+      sPendingPages[wordIndex] = dirty;
+    }
+    ok = writeSeal(target, SealKind::cStarted) && commitSectors(target * cCopySizeInPages, (target + 1u) * cCopySizeInPages) && writeSeal(target, SealKind::cDone);
+    if(ok) {
+      ++sGeneration;
+      sNewestCopy = target;
+    }
+    else {
+      std::fill_n(sPendingPages, cDirtyWordCount, ~0u);
+    }
+  }
+  else { // nothing to do
+  }
+  return ok;
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+typename FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::ReadResult FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::readJournal(uint32_t const aCopyOffsetInPages, Task const aTask) {
+  // The journal pages are programmed one after the other from the journal start, so the first erased one ends it.
+  // The copies are written alike, so their journals must have the same page count and checksums.
+  uint32_t pageIndex = 0u;
+  uint32_t digest = 0u;
+  bool erased = false;
+  ReadResult result = ReadResult::cOk;
+  while(result == ReadResult::cOk && !erased && pageIndex < tJournalSizeInPages) {
+    uint32_t const pageCount = std::min(tReadAheadSizeInPages, tJournalSizeInPages - pageIndex);
+    if(tInterface::readPages(sStartPage + aCopyOffsetInPages + cBaseSizeInPages + pageIndex, pageCount, sReadAheadBuffer) != SpiResult::cOk) {
+      result = ReadResult::cTransferError;
+    }
+    else {
+      for(uint32_t i = 0u; result == ReadResult::cOk && !erased && i < pageCount; ++i) {
+        uint8_t const * const page = sReadAheadBuffer + i * cPageSizeInBytes;
+        if(is<Magic::cErased>(page[cOffsetPageMagic])) {
+          erased = true;
         }
         else {
-          if(tInterface::eraseSector((sStartPage + aCopyOffsetInPages) / cSectorSizeInPages + startSector + sectorIndex) != SpiResult::cOk) {
-            ok = false;
-          }
-          else { // nothing to do
-          }
-          for(uint32_t pageIndex = 0; ok && pageIndex < cSectorSizeInPages; ++pageIndex) {
-            uint32_t pageInReadAhead = pageIndex + sectorIndex * cSectorSizeInPages;
-            if(startPage + pageInReadAhead < sFirstUsablePage || 
-              (startPage + pageInReadAhead == sFirstUsablePage && sFirstUsableByteIndex > cOffsetPageItems)) {
-              serialize(startPage, pageInReadAhead);
-              if(tInterface::writePage(sStartPage + aCopyOffsetInPages + startPage + pageInReadAhead, sReadAheadBuffer + pageInReadAhead * cPageSizeInBytes) != SpiResult::cOk) {
-                ok = false;
-              }
-              else { // nothing to do
-              }
-            }
-            else { // nothing to do
-            }
-          }
+          result = processJournalPage(page, aTask);
+          digest = digest * cDigestFactor + getValue<uint16_t>(page + cOffsetPageChecksum);
+          ++pageIndex;
         }
       }
+    }
+  }
+  if(aTask == Task::cCopy) {
+    sJournalNextPage = pageIndex;
+    sJournalDigest = digest;
+    sJournalObsolete = (result != ReadResult::cOk);
+  }
+  else if(result == ReadResult::cOk && (pageIndex != sJournalNextPage || digest != sJournalDigest)) {
+    result = ReadResult::cErrorConsistency;
+  }
+  else { // nothing to do
+  }
+  return result;
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+typename FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::ReadResult FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::processJournalPage(uint8_t const * const aPage, Task const aTask) noexcept {
+  ReadResult result = ReadResult::cOk;
+  uint16_t itemCount = getValue<uint16_t>(aPage + cOffsetPageCount);
+  if(!is<Magic::cConfigJournal>(aPage[cOffsetPageMagic])) {
+    result = ReadResult::cErrorConsistency;
+  }
+  else if(calculateChecksum(aPage) != getValue<uint16_t>(aPage + cOffsetPageChecksum)) {
+    result = ReadResult::cErrorChecksum;
+  }
+  else if(itemCount == 0u || itemCount == cUnusedValue) {
+    result = ReadResult::cErrorConsistency;
+  }
+  else {
+    uint32_t recordStart = cOffsetPageItems;
+    while(result == ReadResult::cOk && itemCount > 0u) {
+      uint16_t const id = getValue<uint16_t>(aPage + recordStart + cOffsetItemId);
+      uint16_t const count = getValue<uint16_t>(aPage + recordStart + cOffsetItemCount);
+      recordStart += cOffsetItemData;
+      if(recordStart + count > cPageSizeInBytes || id >= sNextId || sCache[id].getCount() != count) {
+        result = ReadResult::cErrorConsistency;
+      }
+      else if(aTask == Task::cCopy) {
+        updateValue(sCache[id], aPage + recordStart);
+        setBit(sJournaledItems, id);
+      }
       else { // nothing to do
       }
+      recordStart += count;
+      --itemCount;
     }
   }
-  return ok;
+  return result;
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+void FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::serialize(uint32_t const aPageIndex, uint8_t * const aPage) noexcept {
+  uint16_t const count = sPageItemCounts[aPageIndex];
+  uint16_t firstSlot = sPageFirstSlots[aPageIndex];
+  aPage[cOffsetPageMagic] = static_cast<uint8_t>(Magic::cConfig);
+  uint32_t newItemStart = cOffsetPageItems;
+  if(cSpanning && sCache[getSlotId(firstSlot)].getPageIndex() != aPageIndex) { // the rest of an item started in a previous page, if any
+    CacheItem& item = sCache[getSlotId(firstSlot)];
+    forItemParts(item.getPageIndex(), item.getDataOffsetInFirstPage(), item.getCount(), [aPageIndex, aPage, &item, &newItemStart](uint32_t const aPartPageIndex, uint32_t, uint32_t const aOffsetInItem, uint32_t const aPartCount){
+      if(aPartPageIndex == aPageIndex) {
+        std::copy_n(item.getData() + aOffsetInItem, aPartCount, aPage + cOffsetPageItems);
+        newItemStart += aPartCount;
+      }
+      else { // nothing to do
+      }
+    });
+    ++firstSlot;
+  }
+  else { // nothing to do
+  }
+  uint16_t const endSlot = firstSlot + count;
+  for(uint16_t slot = firstSlot; slot < endSlot; ++slot) {
+    uint16_t const id = getSlotId(slot);
+    CacheItem& item = sCache[id];
+    setValue<uint16_t>(aPage + newItemStart + cOffsetItemId, id);
+    setValue<uint16_t>(aPage + newItemStart + cOffsetItemCount, item.getCount());
+    newItemStart += cOffsetItemData;
+    uint32_t const partCount = std::min(item.getCount(), cPageSizeInBytes - newItemStart); // the last one may continue in the next page
+    copyShared(item.getData(), partCount, aPage + newItemStart);
+    newItemStart += partCount;
+  }
+  std::fill(aPage + newItemStart, aPage + cPageSizeInBytes, cErasedByte);
+  setValue<uint16_t>(aPage + cOffsetPageCount, getStoredItemCount(count));
+  setValue<uint16_t>(aPage + cOffsetPageChecksum, loadShared(sPageChecksums[aPageIndex]));
 }
 
-template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize>
-void FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize>::serialize(uint32_t const aReadAheadStartPage, uint32_t const aPageInReadAhead) noexcept {
-  uint8_t* page = sReadAheadBuffer + aPageInReadAhead * cPageSizeInBytes;
-  uint16_t pageIndex = aReadAheadStartPage + aPageInReadAhead;
-  uint16_t id = std::lower_bound(sCache, sCache + tMaxItemCount, pageIndex, [pageIndex](ConfigItem const &aItem, uint32_t const aIndex){
-    return aItem.getPageIndex() < aIndex;
-  }) - sCache;
-  page[cOffsetPageMagic] = static_cast<uint8_t>(Magic::cConfig);
-  int16_t count = 0u;
-  int16_t newItemStart = cOffsetPageItems;
-  while(id < sNextId && newItemStart < cPageSizeInBytes - cOffsetItemData - sCache[id].getCount()) {
-    ConfigItem& item = sCache[id];
-    setValue<uint16_t>(page + newItemStart + cOffsetItemId, id);
-    setValue<uint16_t>(page + newItemStart + cOffsetItemCount, item.getCount());
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint32_t FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::countJournalPages() noexcept {
+  uint32_t result = 0u;
+  uint32_t used = cPageItemSpace;
+  for(uint32_t id = findNextSetBit(sDirtyItems, 0u, sNextId); id < sNextId; id = findNextSetBit(sDirtyItems, id + 1u, sNextId)) {
+    uint32_t const size = cOffsetItemData + sCache[id].getCount();
+    if(used + size > cPageItemSpace) {
+      ++result;
+      used = 0u;
+    }
+    else { // nothing to do
+    }
+    used += size;
+  }
+  return result;
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint16_t FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::serializeJournalPage(uint16_t const aFirstId, uint8_t * const aPage) noexcept {
+  aPage[cOffsetPageMagic] = static_cast<uint8_t>(Magic::cConfigJournal);
+  uint16_t count = 0u;
+  uint32_t newItemStart = cOffsetPageItems;
+  uint16_t id = aFirstId;
+  while(id < sNextId && newItemStart + cOffsetItemData + sCache[id].getCount() <= cPageSizeInBytes) {
+    CacheItem& item = sCache[id];
+    setValue<uint16_t>(aPage + newItemStart + cOffsetItemId, id);
+    setValue<uint16_t>(aPage + newItemStart + cOffsetItemCount, item.getCount());
     newItemStart += cOffsetItemData;
-    std::copy_n(const_cast<uint8_t*>(item.getData()), item.getCount(), page + newItemStart);
+    std::copy_n(item.getData(), item.getCount(), aPage + newItemStart);
     newItemStart += item.getCount();
+    setBit(sJournaledItems, id);
     ++count;
-    ++id;
+    id = findNextSetBit(sDirtyItems, id + 1u, sNextId);
   }
-  // leave rubbish in the unused bytes, and calculate it into the checksum
-  setValue<uint16_t>(page + cOffsetPageCount, count);
-  setValue<uint16_t>(page + cOffsetPageChecksum, calculateChecksum(page));
+  std::fill(aPage + newItemStart, aPage + cPageSizeInBytes, cErasedByte);
+  setValue<uint16_t>(aPage + cOffsetPageCount, count);
+  setValue<uint16_t>(aPage + cOffsetPageChecksum, calculateChecksum(aPage));
+  return id;
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+bool FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::appendJournal() noexcept {
+  // Each journal page is written to every copy before the next one is serialized. Two pages of the read ahead
+  // buffer are used alternately, so serializing never touches a page being programmed.
+  uint32_t pageCount = 0u;
+  uint16_t id = findNextSetBit(sDirtyItems, 0u, sNextId);
+  bool ok = true;
+  while(ok && id < sNextId) {
+    uint8_t * const page = sReadAheadBuffer + (pageCount % 2u) * cPageSizeInBytes;
+    id = serializeJournalPage(id, page);
+    uint32_t const pageIndex = cBaseSizeInPages + sJournalNextPage + pageCount;
+    for(uint32_t copyOffsetInPages = 0u; ok && copyOffsetInPages < tPagesNeeded; copyOffsetInPages += cCopySizeInPages) {
+      ok = (waitWhileBusy() == SpiResult::cOk && startWritePage(sStartPage + copyOffsetInPages + pageIndex, page) == SpiResult::cOk);
+    }
+    sJournalDigest = sJournalDigest * cDigestFactor + getValue<uint16_t>(page + cOffsetPageChecksum);
+    ++pageCount;
+  }
+  sJournalNextPage += pageCount;
+  ok = (waitWhileBusy() == SpiResult::cOk && ok);
+  sJournalObsolete = !ok;
+  return ok;
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+bool FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::foldJournal() noexcept {
+  // Replaying the journal is idempotent, so it is erased only after the base is rewritten in all copies.
+  for(uint32_t wordIndex = 0u; wordIndex < cItemWordCount; ++wordIndex) {
+    sJournaledItems[wordIndex] |= sDirtyItems[wordIndex];
+  }
+  for(uint32_t id = findNextSetBit(sJournaledItems, 0u, sNextId); id < sNextId; id = findNextSetBit(sJournaledItems, id + 1u, sNextId)) {
+    setDirtyPages(sCache[id]);
+  }
+  bool ok = commitCopies();
+  if(ok) {
+    makeAllClean();
+  }
+  else { // nothing to do
+  }
+  for(uint32_t copyOffsetInPages = 0u; ok && copyOffsetInPages < tPagesNeeded; copyOffsetInPages += cCopySizeInPages) {
+    uint32_t const firstSector = (sStartPage + copyOffsetInPages + cBaseSizeInPages) / cSectorSizeInPages;
+    for(uint32_t sector = firstSector; ok && sector < firstSector + tJournalSizeInPages / cSectorSizeInPages; ++sector) {
+      ok = (waitWhileBusy() == SpiResult::cOk && startEraseSector(sector) == SpiResult::cOk);
+    }
+  }
+  ok = (waitWhileBusy() == SpiResult::cOk && ok);
+  if(ok) {
+    std::fill_n(sJournaledItems, cItemWordCount, 0u);
+    sJournalNextPage = 0u;
+    sJournalDigest = 0u;
+  }
+  else { // nothing to do
+  }
+  sJournalObsolete = !ok;
+  return ok;
 }
 
-template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize>
-uint32_t FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize>::sStartPage;
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint32_t FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sStartPage;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+typename FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::CacheItem* FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sCache;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint32_t* FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sDirtyPages;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint16_t* FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sPageChecksums;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint16_t* FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sPageFirstSlots;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint16_t* FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sPageItemCounts;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint16_t* FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sSectorStates;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint8_t* FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sReadAheadBuffer;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint32_t FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sFirstUsablePage;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint16_t FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sFirstUsableByteIndex;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint16_t FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sNextId;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint16_t FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sSpanningId;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint16_t FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sSpanningLeft;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint32_t* FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sDirtyItems;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint32_t* FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sJournaledItems;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint32_t FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sJournalNextPage;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint32_t FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sJournalDigest;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+bool FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sJournalObsolete;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint32_t* FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sPendingPages;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint16_t FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sSealNextPages[FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::cCopyCount];
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint32_t FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sGeneration;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint32_t FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sNewestCopy;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint8_t* FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sArena;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint32_t FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sArenaSize;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint32_t FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sArenaUsed;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint32_t* FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sLoadedPages;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint32_t FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sLazyCopyOffset;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint32_t FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sLazyPageCount;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+std::atomic<uint32_t>* FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sPageSequences;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint32_t* FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sCommittedSequences;
 
-template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize>
-typename FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize>::ConfigItem* FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize>::sCache;
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint16_t* FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sSlotIds;
 
-template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize>
-bool* FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize>::sDirtyPages;
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint32_t* FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sPlacedItems;
 
-template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize>
-uint8_t* FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize>::sReadAheadBuffer;
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint16_t FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sPlacedCount;
 
-template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize>
-uint32_t FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize>::sFirstUsablePage;
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+uint16_t* FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sUpdateCounts;
 
-template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize>
-uint16_t FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize>::sFirstUsableByteIndex;
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+CommitStatistics FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sStatistics;
 
-template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize>
-uint16_t FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize>::sNextId;
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tValueBufferSize, uint32_t tJournalSizeInPages, ConfigStorage tStorage, ConfigBoot tBoot, ConfigConcurrency tConcurrency, ConfigPacking tPacking, ConfigPlacement tPlacement>
+std::atomic<uint32_t> FlashConfig<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tValueBufferSize, tJournalSizeInPages, tStorage, tBoot, tConcurrency, tPacking, tPlacement>::sRetriedReadCount;
 
 }
 #endif
@@ -0,0 +1,465 @@
+#ifndef NOWTECH_FLASHCONFIGMAPPED
+#define NOWTECH_FLASHCONFIGMAPPED
+
+#include "FlashCommon.h"
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+namespace nowtech::memory {
+
+/// Config variant for the cases when RAM is scarcer than flash reads. It uses the same page format as FlashConfig
+/// with two copies, but keeps only an id -> flash address index in RAM, and getConfig points into the memory-mapped
+/// flash. setConfig and addConfig stage the values in a small write-back buffer, which is consulted by getConfig and
+/// written by commit, or when it gets full. Mapped mode is left only during commit. As the unchanged pages of a dirty
+/// sector are taken from the other copy, a single page buffer is enough for rewriting the sectors.
+template<typename tInterface, uint32_t tPagesNeeded, uint32_t tMaxItemCount, uint32_t tWriteBufferSizeInBytes>
+class FlashConfigMapped final : FlashCommon<tInterface> {
+  template<typename tInterfaceOther, typename tPlugin1, typename tPlugin2, typename tPlugin3>
+  friend class FlashPartitioner;
+
+  using FlashCommon<tInterface>::cPageSizeInBytes;
+  using FlashCommon<tInterface>::cSectorSizeInPages;
+  using FlashCommon<tInterface>::cOffsetPageMagic;
+  using FlashCommon<tInterface>::cOffsetPageCount;
+  using FlashCommon<tInterface>::cOffsetPageChecksum;
+  using FlashCommon<tInterface>::cOffsetPageItems;
+  using FlashCommon<tInterface>::cUnusedValue;
+  using FlashCommon<tInterface>::calculateChecksum;
+  using FlashCommon<tInterface>::startEraseSector;
+  using FlashCommon<tInterface>::startWritePage;
+  using FlashCommon<tInterface>::waitWhileBusy;
+
+private:
+  static constexpr uint16_t cOffsetItemId      = 0u;
+  static constexpr uint16_t cOffsetItemCount   = cOffsetItemId + sizeof(uint16_t);
+  static constexpr uint16_t cOffsetItemData    = cOffsetItemCount + sizeof(uint16_t);
+  static constexpr uint16_t cPageItemSpace     = cPageSizeInBytes - cOffsetPageItems;
+  static constexpr uint16_t cMaxItemDataSize   = cPageItemSpace - cOffsetItemData;
+  static constexpr uint32_t cCopyCount         = 2u;
+  static constexpr uint32_t cCopySizeInPages   = tPagesNeeded / cCopyCount;
+  static constexpr uint32_t cCopySizeInSectors = cCopySizeInPages / cSectorSizeInPages;
+  static constexpr uint8_t  cErasedByte        = static_cast<uint8_t>(Magic::cErased);
+  static constexpr uint32_t cDigestFactor      = 31u;
+
+  static_assert(tPagesNeeded % (cCopyCount * cSectorSizeInPages) == 0u, "Each config copy must consist of whole sectors.");
+  static_assert(tMaxItemCount > 0u && tMaxItemCount < cUnusedValue, "Item count must fit the item ids.");
+  static_assert(tWriteBufferSizeInBytes >= cPageItemSpace, "The write buffer must hold the biggest item.");
+
+  enum class ReadResult : uint8_t {
+    cOk               = 0u,
+    cErrorChecksum    = 1u,
+    cErrorConsistency = 2u,
+    cTransferError    = 3u
+  };
+
+  static uint32_t  sStartPage;
+  static uint32_t* sItemAddresses;        // of the item data, relative to copy start
+  static uint8_t*  sPageBuffer;
+  static uint8_t*  sWriteBuffer;          // staged items, in the same id - count - data format as in the pages
+  static uint32_t  sWriteBufferUsed;
+  static uint32_t  sServedCopy;           // index of the copy getConfig points into
+  static uint32_t  sFlashUsedPages;       // pages holding items in the flash, relative to copy start
+  static uint32_t  sFirstUsablePage;      // the first usable (at least partially free) page, relative to copy start
+  static uint16_t  sFirstUsableByteIndex; // the first free byte in the first usable page
+  static uint16_t  sNextId;               // the next id to use when adding a new item
+  static uint16_t  sFlashNextId;          // items from this id on are not yet in the flash
+  static bool      sAllDirty;
+
+  FlashConfigMapped() = delete;
+
+  static constexpr uint32_t getPagesNeeded() noexcept {
+    return tPagesNeeded;
+  }
+
+  static void init(uint32_t const aStartPage) {
+    sStartPage = aStartPage;
+    sItemAddresses = tInterface::template _newArray<uint32_t>(tMaxItemCount);
+    sPageBuffer = tInterface::template _newArray<uint8_t>(cPageSizeInBytes);
+    sWriteBuffer = tInterface::template _newArray<uint8_t>(tWriteBufferSizeInBytes);
+    readAll();
+  }
+
+  static void done() {
+    tInterface::setMappedMode(false);
+    tInterface::template _deleteArray<uint32_t>(sItemAddresses);
+    tInterface::template _deleteArray<uint8_t>(sPageBuffer);
+    tInterface::template _deleteArray<uint8_t>(sWriteBuffer);
+  }
+
+public:
+  /// The result points into the mapped flash or into the write buffer, and is valid until the next call of
+  /// setConfig, addConfig or commit.
+  static uint8_t const * getConfig(uint16_t const aId) noexcept {
+    uint8_t const * result = nullptr;
+    if(aId >= sNextId) {
+      tInterface::fatalError(FlashException::cConfigInvalidId);
+    }
+    else {
+      result = findStaged(aId);
+      if(result == nullptr) {
+        result = tInterface::getMappedAddress((sStartPage + sServedCopy * cCopySizeInPages) * cPageSizeInBytes + sItemAddresses[aId]);
+      }
+      else {
+        result += cOffsetItemData;
+      }
+    }
+    return result;
+  }
+
+  static uint16_t addConfig(uint8_t const * const aData, uint16_t const aCount);
+  static void setConfig(uint16_t const aId, uint8_t const * const aData);
+
+  /// The next commit will rewrite all the sectors holding items in both copies, which also repairs a bad copy.
+  static void makeAllDirty() noexcept {
+    sAllDirty = true;
+  }
+
+  static void commit();
+
+  static void clear() noexcept {
+    sNextId = 0u;
+    sFlashNextId = 0u;
+    sFirstUsablePage = 0u;
+    sFirstUsableByteIndex = cOffsetPageItems;
+    sWriteBufferUsed = 0u;
+    sAllDirty = true; // the old items must be removed from the flash
+  }
+
+private:
+  static uint32_t countPagesWithItems() noexcept {
+    return sFirstUsableByteIndex > cOffsetPageItems ? sFirstUsablePage + 1u : sFirstUsablePage;
+  }
+
+  static uint16_t getStagedCount(uint8_t const * const aStaged) noexcept {
+    return getValue<uint16_t>(aStaged + cOffsetItemCount);
+  }
+
+  static uint8_t* findStaged(uint16_t const aId) noexcept {
+    uint8_t* result = nullptr;
+    for(uint32_t i = 0u; i < sWriteBufferUsed; i += cOffsetItemData + getStagedCount(sWriteBuffer + i)) {
+      if(getValue<uint16_t>(sWriteBuffer + i + cOffsetItemId) == aId) {
+        result = sWriteBuffer + i;
+        break;
+      }
+      else { // nothing to do
+      }
+    }
+    return result;
+  }
+
+  static void makeRoom(uint16_t const aCount);
+  static void stage(uint16_t const aId, uint8_t const * const aData, uint16_t const aCount) noexcept;
+  static uint32_t findNextDirtySector(uint32_t const aSector) noexcept;
+  static void applyStaged(uint32_t const aPageIndexRelCopy) noexcept;
+  static bool commitCopy(uint32_t const aDestinationCopy, bool const aApply) noexcept;
+  static void readAll();
+  static ReadResult readAcopy(uint32_t const aCopy, bool const aIndex, uint32_t &aDigest) noexcept;
+};
+
+template<typename tInterface, uint32_t tPagesNeeded, uint32_t tMaxItemCount, uint32_t tWriteBufferSizeInBytes>
+uint16_t FlashConfigMapped<tInterface, tPagesNeeded, tMaxItemCount, tWriteBufferSizeInBytes>::addConfig(uint8_t const * const aData, uint16_t const aCount) {
+  uint16_t id = cUnusedValue;
+  if(aCount > cMaxItemDataSize) {
+    tInterface::fatalError(FlashException::cConfigItemTooBig);
+  }
+  else if(sNextId >= tMaxItemCount) {
+    tInterface::fatalError(FlashException::cConfigFull);
+  }
+  else {
+    uint32_t pageIndex = sFirstUsablePage;
+    uint16_t byteIndex = sFirstUsableByteIndex;
+    if(cPageSizeInBytes - byteIndex < static_cast<uint32_t>(cOffsetItemData + aCount)) {
+      ++pageIndex;
+      byteIndex = cOffsetPageItems;
+    }
+    else { // nothing to do
+    }
+    if(pageIndex < cCopySizeInPages) {
+      makeRoom(aCount);
+      id = sNextId++;
+      sFirstUsablePage = pageIndex;
+      sFirstUsableByteIndex = byteIndex + cOffsetItemData + aCount;
+      sItemAddresses[id] = pageIndex * cPageSizeInBytes + byteIndex + cOffsetItemData;
+      stage(id, aData, aCount);
+    }
+    else {
+      tInterface::fatalError(FlashException::cConfigFull);
+    }
+  }
+  return id;
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, uint32_t tMaxItemCount, uint32_t tWriteBufferSizeInBytes>
+void FlashConfigMapped<tInterface, tPagesNeeded, tMaxItemCount, tWriteBufferSizeInBytes>::setConfig(uint16_t const aId, uint8_t const * const aData) {
+  if(aId >= sNextId) {
+    tInterface::fatalError(FlashException::cConfigInvalidId);
+  }
+  else {
+    uint8_t * const staged = findStaged(aId);
+    if(staged != nullptr) {
+      std::memcpy(staged + cOffsetItemData, aData, getStagedCount(staged));
+    }
+    else {
+      uint8_t const * const mapped = tInterface::getMappedAddress((sStartPage + sServedCopy * cCopySizeInPages) * cPageSizeInBytes + sItemAddresses[aId]);
+      uint16_t const count = getValue<uint16_t>(mapped - cOffsetItemData + cOffsetItemCount);
+      if(std::memcmp(mapped, aData, count) != 0) {
+        makeRoom(count);
+        stage(aId, aData, count);
+      }
+      else { // nothing to do
+      }
+    }
+  }
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, uint32_t tMaxItemCount, uint32_t tWriteBufferSizeInBytes>
+void FlashConfigMapped<tInterface, tPagesNeeded, tMaxItemCount, tWriteBufferSizeInBytes>::commit() {
+  if(sWriteBufferUsed > 0u || sAllDirty) {
+    bool ok = (tInterface::setMappedMode(false) == SpiResult::cOk);
+    // the other copy gets the changes first, so an interrupted commit leaves at least one of them consistent
+    ok = (ok && commitCopy(cCopyCount - 1u - sServedCopy, true));
+    ok = (ok && commitCopy(sServedCopy, false));
+    if(ok) {
+      sFlashNextId = sNextId;
+      sFlashUsedPages = countPagesWithItems();
+      sWriteBufferUsed = 0u;
+      sAllDirty = false;
+    }
+    else { // nothing to do
+    }
+    ok = (tInterface::setMappedMode(true) == SpiResult::cOk && ok);
+    if(!ok) {
+      tInterface::fatalError(FlashException::cFlashTransferError);
+    }
+    else { // nothing to do
+    }
+  }
+  else { // nothing to do
+  }
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, uint32_t tMaxItemCount, uint32_t tWriteBufferSizeInBytes>
+void FlashConfigMapped<tInterface, tPagesNeeded, tMaxItemCount, tWriteBufferSizeInBytes>::makeRoom(uint16_t const aCount) {
+  if(sWriteBufferUsed + cOffsetItemData + aCount > tWriteBufferSizeInBytes) {
+    commit(); // empties the buffer, or reports the error and drops its contents
+    sWriteBufferUsed = 0u;
+  }
+  else { // nothing to do
+  }
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, uint32_t tMaxItemCount, uint32_t tWriteBufferSizeInBytes>
+void FlashConfigMapped<tInterface, tPagesNeeded, tMaxItemCount, tWriteBufferSizeInBytes>::stage(uint16_t const aId, uint8_t const * const aData, uint16_t const aCount) noexcept {
+  uint8_t * const staged = sWriteBuffer + sWriteBufferUsed;
+  setValue<uint16_t>(staged + cOffsetItemId, aId);
+  setValue<uint16_t>(staged + cOffsetItemCount, aCount);
+  std::memcpy(staged + cOffsetItemData, aData, aCount);
+  sWriteBufferUsed += cOffsetItemData + aCount;
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, uint32_t tMaxItemCount, uint32_t tWriteBufferSizeInBytes>
+uint32_t FlashConfigMapped<tInterface, tPagesNeeded, tMaxItemCount, tWriteBufferSizeInBytes>::findNextDirtySector(uint32_t const aSector) noexcept {
+  uint32_t result = cCopySizeInSectors;
+  if(sAllDirty) {
+    uint32_t const usedPages = std::max(sFlashUsedPages, countPagesWithItems());
+    result = (aSector * cSectorSizeInPages < usedPages ? aSector : cCopySizeInSectors);
+  }
+  else {
+    for(uint32_t i = 0u; i < sWriteBufferUsed; i += cOffsetItemData + getStagedCount(sWriteBuffer + i)) {
+      uint32_t const sector = sItemAddresses[getValue<uint16_t>(sWriteBuffer + i + cOffsetItemId)] / (cSectorSizeInPages * cPageSizeInBytes);
+      result = (sector >= aSector ? std::min(result, sector) : result);
+    }
+  }
+  return result;
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, uint32_t tMaxItemCount, uint32_t tWriteBufferSizeInBytes>
+void FlashConfigMapped<tInterface, tPagesNeeded, tMaxItemCount, tWriteBufferSizeInBytes>::applyStaged(uint32_t const aPageIndexRelCopy) noexcept {
+  bool changed = false;
+  for(uint32_t i = 0u; i < sWriteBufferUsed; i += cOffsetItemData + getStagedCount(sWriteBuffer + i)) {
+    uint8_t const * const staged = sWriteBuffer + i;
+    uint16_t const id = getValue<uint16_t>(staged + cOffsetItemId);
+    uint16_t const count = getStagedCount(staged);
+    if(sItemAddresses[id] / cPageSizeInBytes == aPageIndexRelCopy) {
+      uint16_t const dataOffset = sItemAddresses[id] % cPageSizeInBytes;
+      if(id >= sFlashNextId) {
+        if(dataOffset == cOffsetPageItems + cOffsetItemData) { // the page may hold old items after clear
+          std::fill_n(sPageBuffer, cPageSizeInBytes, cErasedByte);
+          sPageBuffer[cOffsetPageMagic] = static_cast<uint8_t>(Magic::cConfig);
+          setValue<uint16_t>(sPageBuffer + cOffsetPageCount, 0u);
+        }
+        else { // nothing to do
+        }
+        std::memcpy(sPageBuffer + dataOffset - cOffsetItemData, staged, cOffsetItemData);
+        setValue<uint16_t>(sPageBuffer + cOffsetPageCount, getValue<uint16_t>(sPageBuffer + cOffsetPageCount) + 1u);
+      }
+      else { // nothing to do
+      }
+      std::memcpy(sPageBuffer + dataOffset, staged + cOffsetItemData, count);
+      changed = true;
+    }
+    else { // nothing to do
+    }
+  }
+  if(changed) {
+    setValue<uint16_t>(sPageBuffer + cOffsetPageChecksum, calculateChecksum(sPageBuffer));
+  }
+  else { // nothing to do
+  }
+}
+
+/// Each erase and write is only started, and waited for before the next flash access, so with the non-blocking
+/// interface the last write of a sector completes while the next dirty sector is searched.
+template<typename tInterface, uint32_t tPagesNeeded, uint32_t tMaxItemCount, uint32_t tWriteBufferSizeInBytes>
+bool FlashConfigMapped<tInterface, tPagesNeeded, tMaxItemCount, tWriteBufferSizeInBytes>::commitCopy(uint32_t const aDestinationCopy, bool const aApply) noexcept {
+  uint32_t const destination = sStartPage + aDestinationCopy * cCopySizeInPages;
+  uint32_t const source = sStartPage + (cCopyCount - 1u - aDestinationCopy) * cCopySizeInPages;
+  uint32_t const pagesWithItems = countPagesWithItems();
+  bool ok = true;
+  for(uint32_t sector = findNextDirtySector(0u); ok && sector < cCopySizeInSectors; sector = findNextDirtySector(sector + 1u)) {
+    ok = (waitWhileBusy() == SpiResult::cOk && startEraseSector(destination / cSectorSizeInPages + sector) == SpiResult::cOk);
+    for(uint32_t page = sector * cSectorSizeInPages; ok && page < (sector + 1u) * cSectorSizeInPages && page < pagesWithItems; ++page) {
+      ok = (waitWhileBusy() == SpiResult::cOk && tInterface::readPages(source + page, 1u, sPageBuffer) == SpiResult::cOk);
+      if(ok && aApply) {
+        applyStaged(page);
+      }
+      else { // nothing to do
+      }
+      if(ok && !is<Magic::cErased>(sPageBuffer[cOffsetPageMagic])) {
+        ok = (startWritePage(destination + page, sPageBuffer) == SpiResult::cOk);
+      }
+      else { // nothing to do
+      }
+    }
+  }
+  return waitWhileBusy() == SpiResult::cOk && ok;
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, uint32_t tMaxItemCount, uint32_t tWriteBufferSizeInBytes>
+void FlashConfigMapped<tInterface, tPagesNeeded, tMaxItemCount, tWriteBufferSizeInBytes>::readAll() {
+  clear();
+  sAllDirty = false;
+  sServedCopy = 0u;
+  sFlashUsedPages = 0u;
+  uint32_t digest1;
+  uint32_t digest2;
+  ReadResult result1 = readAcopy(0u, true, digest1);
+  ReadResult result2 = readAcopy(1u, result1 != ReadResult::cOk, digest2);
+  if(result1 == ReadResult::cOk && result2 == ReadResult::cOk && digest1 != digest2) {
+    clear();
+    tInterface::fatalError(FlashException::cConfigCopiesMismatch);
+  }
+  else if(result1 == ReadResult::cOk && result2 != ReadResult::cOk) {
+    tInterface::fatalError(FlashException::cConfigBadCopy2);
+  }
+  else if(result1 != ReadResult::cOk && result2 == ReadResult::cOk) {
+    sServedCopy = 1u;
+    tInterface::fatalError(FlashException::cConfigBadCopy1);
+  }
+  else if(result1 != ReadResult::cOk && result2 != ReadResult::cOk) {
+    clear();
+    tInterface::fatalError(FlashException::cConfigBadCopies);
+  }
+  else { // nothing to do
+  }
+  sFlashNextId = sNextId;
+  sFlashUsedPages = std::max(sFlashUsedPages, countPagesWithItems());
+  if(!tInterface::canMapMemory() || tInterface::setMappedMode(true) != SpiResult::cOk) {
+    tInterface::fatalError(FlashException::cCommunication);
+  }
+  else { // nothing to do
+  }
+}
+
+/// Checks all the pages of the copy, and if aIndex, fills the item index. sFlashUsedPages gets the maximum of the
+/// pages found in the copies, so that the next commit erases everything after a clear.
+template<typename tInterface, uint32_t tPagesNeeded, uint32_t tMaxItemCount, uint32_t tWriteBufferSizeInBytes>
+typename FlashConfigMapped<tInterface, tPagesNeeded, tMaxItemCount, tWriteBufferSizeInBytes>::ReadResult FlashConfigMapped<tInterface, tPagesNeeded, tMaxItemCount, tWriteBufferSizeInBytes>::readAcopy(uint32_t const aCopy, bool const aIndex, uint32_t &aDigest) noexcept {
+  ReadResult result = ReadResult::cOk;
+  uint16_t nextId = 0u;
+  aDigest = 0u;
+  for(uint32_t page = 0u; result == ReadResult::cOk && page < cCopySizeInPages; ++page) {
+    if(tInterface::readPages(sStartPage + aCopy * cCopySizeInPages + page, 1u, sPageBuffer) != SpiResult::cOk) {
+      result = ReadResult::cTransferError;
+    }
+    else if(is<Magic::cErased>(sPageBuffer[cOffsetPageMagic])) {
+      break;
+    }
+    else if(!is<Magic::cConfig>(sPageBuffer[cOffsetPageMagic]) || calculateChecksum(sPageBuffer) != getValue<uint16_t>(sPageBuffer + cOffsetPageChecksum)) {
+      result = ReadResult::cErrorChecksum;
+    }
+    else {
+      uint16_t itemCount = getValue<uint16_t>(sPageBuffer + cOffsetPageCount);
+      uint16_t itemStart = cOffsetPageItems;
+      result = (itemCount == 0u || itemCount == cUnusedValue ? ReadResult::cErrorConsistency : result);
+      for(; result == ReadResult::cOk && itemCount > 0u; --itemCount) {
+        uint16_t const id = getValue<uint16_t>(sPageBuffer + itemStart + cOffsetItemId);
+        uint16_t const count = getValue<uint16_t>(sPageBuffer + itemStart + cOffsetItemCount);
+        if(id != nextId || id >= tMaxItemCount || static_cast<uint32_t>(itemStart + cOffsetItemData + count) > cPageSizeInBytes) {
+          result = ReadResult::cErrorConsistency;
+        }
+        else {
+          if(aIndex) {
+            sItemAddresses[id] = page * cPageSizeInBytes + itemStart + cOffsetItemData;
+            sNextId = id + 1u;
+            sFirstUsablePage = page;
+            sFirstUsableByteIndex = itemStart + cOffsetItemData + count;
+          }
+          else { // nothing to do
+          }
+          ++nextId;
+          itemStart += cOffsetItemData + count;
+        }
+      }
+      aDigest = aDigest * cDigestFactor + getValue<uint16_t>(sPageBuffer + cOffsetPageChecksum);
+      sFlashUsedPages = std::max(sFlashUsedPages, page + 1u);
+    }
+  }
+  if(aIndex && result != ReadResult::cOk) {
+    clear();
+  }
+  else { // nothing to do
+  }
+  return result;
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, uint32_t tMaxItemCount, uint32_t tWriteBufferSizeInBytes>
+uint32_t FlashConfigMapped<tInterface, tPagesNeeded, tMaxItemCount, tWriteBufferSizeInBytes>::sStartPage;
+
+template<typename tInterface, uint32_t tPagesNeeded, uint32_t tMaxItemCount, uint32_t tWriteBufferSizeInBytes>
+uint32_t* FlashConfigMapped<tInterface, tPagesNeeded, tMaxItemCount, tWriteBufferSizeInBytes>::sItemAddresses;
+
+template<typename tInterface, uint32_t tPagesNeeded, uint32_t tMaxItemCount, uint32_t tWriteBufferSizeInBytes>
+uint8_t* FlashConfigMapped<tInterface, tPagesNeeded, tMaxItemCount, tWriteBufferSizeInBytes>::sPageBuffer;
+
+template<typename tInterface, uint32_t tPagesNeeded, uint32_t tMaxItemCount, uint32_t tWriteBufferSizeInBytes>
+uint8_t* FlashConfigMapped<tInterface, tPagesNeeded, tMaxItemCount, tWriteBufferSizeInBytes>::sWriteBuffer;
+
+template<typename tInterface, uint32_t tPagesNeeded, uint32_t tMaxItemCount, uint32_t tWriteBufferSizeInBytes>
+uint32_t FlashConfigMapped<tInterface, tPagesNeeded, tMaxItemCount, tWriteBufferSizeInBytes>::sWriteBufferUsed;
+
+template<typename tInterface, uint32_t tPagesNeeded, uint32_t tMaxItemCount, uint32_t tWriteBufferSizeInBytes>
+uint32_t FlashConfigMapped<tInterface, tPagesNeeded, tMaxItemCount, tWriteBufferSizeInBytes>::sServedCopy;
+
+template<typename tInterface, uint32_t tPagesNeeded, uint32_t tMaxItemCount, uint32_t tWriteBufferSizeInBytes>
+uint32_t FlashConfigMapped<tInterface, tPagesNeeded, tMaxItemCount, tWriteBufferSizeInBytes>::sFlashUsedPages;
+
+template<typename tInterface, uint32_t tPagesNeeded, uint32_t tMaxItemCount, uint32_t tWriteBufferSizeInBytes>
+uint32_t FlashConfigMapped<tInterface, tPagesNeeded, tMaxItemCount, tWriteBufferSizeInBytes>::sFirstUsablePage;
+
+template<typename tInterface, uint32_t tPagesNeeded, uint32_t tMaxItemCount, uint32_t tWriteBufferSizeInBytes>
+uint16_t FlashConfigMapped<tInterface, tPagesNeeded, tMaxItemCount, tWriteBufferSizeInBytes>::sFirstUsableByteIndex;
+
+template<typename tInterface, uint32_t tPagesNeeded, uint32_t tMaxItemCount, uint32_t tWriteBufferSizeInBytes>
+uint16_t FlashConfigMapped<tInterface, tPagesNeeded, tMaxItemCount, tWriteBufferSizeInBytes>::sNextId;
+
+template<typename tInterface, uint32_t tPagesNeeded, uint32_t tMaxItemCount, uint32_t tWriteBufferSizeInBytes>
+uint16_t FlashConfigMapped<tInterface, tPagesNeeded, tMaxItemCount, tWriteBufferSizeInBytes>::sFlashNextId;
+
+template<typename tInterface, uint32_t tPagesNeeded, uint32_t tMaxItemCount, uint32_t tWriteBufferSizeInBytes>
+bool FlashConfigMapped<tInterface, tPagesNeeded, tMaxItemCount, tWriteBufferSizeInBytes>::sAllDirty;
+
+}
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef NOWTECH_FLASHCONFIGSCHEMA
+#define NOWTECH_FLASHCONFIGSCHEMA
+
+#include "FlashConfig.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace nowtech::memory {
+
+/// A field is a type like
+///   struct MotorGain final {
+///     typedef float Type;
+///     static constexpr Type cDefault = 1.5f;
+///   };
+/// The fields get the ids 0, 1, ... in the order of tFields, so they must be the first items of tConfig, and new
+/// fields may only be appended in later firmware versions. The place of each value in the flash is calculated the
+/// way addConfig lays them out, and the place in the cache too for arena storage.
+template<typename tInterface, typename tConfig, typename ...tFields>
+class FlashConfigSchema final {
+private:
+  static constexpr uint32_t cFieldCount = sizeof...(tFields);
+  static constexpr uint16_t cSizes[]    = { static_cast<uint16_t>(sizeof(typename tFields::Type))... };
+
+  struct Place final {
+    uint32_t mPageIndex;             // relative to start of the copy
+    uint16_t mDataOffsetInFirstPage;
+    uint32_t mArenaOffset;
+    uint32_t mLastPageIndex;         // differs from mPageIndex if the value spans pages
+  };
+
+  static constexpr Place calculatePlace(uint32_t const aIndex) noexcept {
+    Place result { 0u, 0u, 0u, 0u };
+    uint32_t pageIndex = 0u;
+    uint32_t byteIndex = tConfig::cOffsetPageItems;
+    uint32_t arenaOffset = 0u;
+    for(uint32_t i = 0u; i <= aIndex; ++i) {
+      uint32_t const neededInPage = (tConfig::cSpanning ? std::min<uint32_t>(cSizes[i], 1u) : cSizes[i]);
+      if(tConfig::cPageSizeInBytes - byteIndex < tConfig::cOffsetItemData + neededInPage) {
+        ++pageIndex;
+        byteIndex = tConfig::cOffsetPageItems;
+      }
+      else { // nothing to do
+      }
+      result = { pageIndex, static_cast<uint16_t>(byteIndex + tConfig::cOffsetItemData), arenaOffset, pageIndex };
+      byteIndex += tConfig::cOffsetItemData + cSizes[i];
+      while(byteIndex > tConfig::cPageSizeInBytes) {
+        ++pageIndex;
+        byteIndex = byteIndex - tConfig::cPageSizeInBytes + tConfig::cOffsetPageItems;
+      }
+      result.mLastPageIndex = pageIndex;
+      arenaOffset += cSizes[i];
+    }
+    return result;
+  }
+
+  template<typename tField>
+  static constexpr uint16_t calculateId() noexcept {
+    constexpr bool cMatches[] = { std::is_same_v<tField, tFields>... };
+    uint16_t result = cFieldCount;
+    for(uint16_t i = cFieldCount; i > 0u; --i) {
+      result = (cMatches[i - 1u] ? i - 1u : result);
+    }
+    return result;
+  }
+
+  static constexpr bool areFieldsUnique() noexcept {
+    constexpr uint16_t cIds[] = { calculateId<tFields>()... };
+    bool result = true;
+    for(uint16_t i = 0u; i < cFieldCount; ++i) {
+      result = (result && cIds[i] == i);
+    }
+    return result;
+  }
+
+  static_assert(cFieldCount > 0u, "FlashConfigSchema needs fields.");
+  static_assert(cFieldCount <= tConfig::cMaxItemCount, "FlashConfigSchema has more fields than the config items.");
+  static_assert(std::conjunction_v<std::is_trivially_copyable<typename tFields::Type>...>, "FlashConfigSchema field types must be trivially copyable.");
+  static_assert(((sizeof(typename tFields::Type) <= tConfig::cMaxItemSize) && ...), "FlashConfigSchema field is too big for a config item.");
+  static_assert(areFieldsUnique(), "FlashConfigSchema fields must be unique.");
+  static_assert(!tConfig::cHotTail, "FlashConfigSchema needs the id order placement for its compile-time layout.");
+  static_assert(calculatePlace(cFieldCount - 1u).mLastPageIndex < tConfig::cBaseSizeInPages, "FlashConfigSchema does not fit the config partition.");
+
+  template<typename tField>
+  static uint8_t* getData() {
+    constexpr uint16_t cId = calculateId<tField>();
+    static_assert(cId < cFieldCount, "Field is not in the FlashConfigSchema.");
+    tConfig::ensureLoaded(calculatePlace(cId).mPageIndex);
+    if constexpr(tConfig::cArena) {
+      return tConfig::sArena + calculatePlace(cId).mArenaOffset;
+    }
+    else {
+      return const_cast<uint8_t*>(tConfig::sCache[cId].getData());
+    }
+  }
+
+  template<typename tField>
+  static bool checkOrAdd() {
+    constexpr uint16_t cId = calculateId<tField>();
+    constexpr Place cPlace = calculatePlace(cId);
+    bool result;
+    if(cId < tConfig::sNextId) {
+      auto const &item = tConfig::sCache[cId];
+      result = (item.getCount() == sizeof(typename tField::Type) && item.getPageIndex() == cPlace.mPageIndex && item.getDataOffsetInFirstPage() == cPlace.mDataOffsetInFirstPage);
+    }
+    else {
+      typename tField::Type const value = tField::cDefault;
+      uint8_t bytes[sizeof(typename tField::Type)];
+      std::memcpy(bytes, &value, sizeof(typename tField::Type));
+      result = (tConfig::addConfig(bytes, sizeof(typename tField::Type)) == cId);
+    }
+    return result && (!tConfig::cArena || tConfig::sCache[cId].getData() == getData<tField>());
+  }
+
+public:
+  FlashConfigSchema() = delete;
+
+  /// To be called after tConfig was initialized by the partitioner or after tConfig::clear(). Adds the missing fields
+  /// with their defaults, which need a commit. Reports cConfigSchemaMismatch if the stored items can't be the fields.
+  static void init() {
+    if(!(checkOrAdd<tFields>() && ...)) {
+      tInterface::fatalError(FlashException::cConfigSchemaMismatch);
+    }
+    else { // nothing to do
+    }
+  }
+
+  template<typename tField>
+  static constexpr uint16_t getId() noexcept {
+    return calculateId<tField>();
+  }
+
+  template<typename tField>
+  static typename tField::Type get() {
+    typename tField::Type result;
+    if constexpr(tConfig::cSeqlock) {
+      uint8_t bytes[sizeof(typename tField::Type)];
+      tConfig::readConfig(calculateId<tField>(), bytes);
+      std::memcpy(&result, bytes, sizeof(typename tField::Type));
+    }
+    else {
+      std::memcpy(&result, getData<tField>(), sizeof(typename tField::Type));
+    }
+    return result;
+  }
+
+  /// The same as setConfig, but everything apart from the value comparison is known in compile time. In seqlock
+  /// mode, it falls back to setConfig for the locking, and for values spanning pages for their checksums.
+  template<typename tField>
+  static void set(typename tField::Type const &aValue) {
+    constexpr uint16_t cId = calculateId<tField>();
+    constexpr Place cPlace = calculatePlace(cId);
+    constexpr uint16_t cSize = sizeof(typename tField::Type);
+    uint8_t bytes[cSize];
+    std::memcpy(bytes, &aValue, cSize);
+    if constexpr(tConfig::cSeqlock || cPlace.mLastPageIndex != cPlace.mPageIndex) {
+      tConfig::setConfig(cId, bytes);
+    }
+    else {
+      uint8_t * const data = getData<tField>();
+      if(std::memcmp(bytes, data, cSize) != 0) {
+        tConfig::sPageChecksums[cPlace.mPageIndex] = tConfig::updateChecksum(tConfig::sPageChecksums[cPlace.mPageIndex], cPlace.mDataOffsetInFirstPage, data, bytes, cSize);
+        std::memcpy(data, bytes, cSize);
+        if constexpr(tConfig::cJournal) {
+          setBit(tConfig::sDirtyItems, cId);
+        }
+        else {
+          setBit(tConfig::sDirtyPages, cPlace.mPageIndex);
+        }
+      }
+      else { // nothing to do
+      }
+    }
+  }
+
+};
+
+}
+
+#endif
@@ -2,28 +2,152 @@
 #define NOWTECH_FLASHLOADBALANCING
 
 #include "FlashCommon.h"
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <numeric>
+#include <algorithm>
 
 namespace nowtech::memory {
 
-template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages>
+/// Displacements found by exhaustive search for common partition sizes, as { pagesNeeded, displacement }. Generated
+/// by test/probeschedule.cpp --table, which minimizes the worst ratio of the probes needed to hit a LEO set of any
+/// length to the possible minimum.
+inline constexpr uint32_t cProbeDisplacements[][2] = { { 512u, 225u }, { 1024u, 275u }, { 2048u, 599u }, { 4096u, 1557u }, { 8192u, 2431u }, { 16384u, 6253u }, { 32768u, 7425u }, { 61440u, 27089u }, { 65536u, 17561u } };
+
+/// Load-balancing partition. The log / error counter / on-time (LEO) pages form a consecutive series, which may wrap
+/// around the end of the partition. On boot, the series is found by probing the pages i * cDisplacement mod B, which
+/// hits a series of length L in about B / L reads, and then its ends are found using binary search. New LEO pages
+/// are written after the last one, erasing the sectors the series enters, and the oldest sectors are erased to keep
+/// the series at most tLeoMaxCount pages long. Log entries are collected in a lock-free queue and written in full
+/// pages, so the loggers never wait for the flash. Error counters live in an open-addressed table, and a flush writes
+/// only the changed ones. The on-time counter may tick by clearing bits in its last page.
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize = 0u, uint32_t tLogQueueSizeInEntries = 64u, uint32_t tLogMaxDelay = 0u, uint32_t tErrorCounterCount = 0u, uint32_t tOnTimeTickBytes = 0u>
 class FlashLoadBalancing final : public FlashCommon<tInterface> {
   static_assert(tReadAheadSizeInPages > 1u);
+  static_assert(tPagesNeeded > 0u, "Use NullPlugin to disable the load-balancing partition.");
+  static_assert(tLeoMaxCount > 0u && tLeoMaxCount <= tPagesNeeded, "The LEO series must fit the partition.");
+  static_assert(tLeoMaxCount % FlashCommon<tInterface>::cSectorSizeInPages == 0u, "The LEO series must consist of whole sectors.");
 
   template<typename tInterfaceOther, typename tPlugin1, typename tPlugin2, typename tPlugin3>
   friend class FlashPartitioner;
-  
+
   using FlashCommon<tInterface>::cPageSizeInBytes;
   using FlashCommon<tInterface>::cSectorSizeInPages;
   using FlashCommon<tInterface>::cFlashSizeInPages;
   using FlashCommon<tInterface>::cOffsetPageMagic;
   using FlashCommon<tInterface>::cOffsetPageCount;
   using FlashCommon<tInterface>::cOffsetPageChecksum;
+  using FlashCommon<tInterface>::cOffsetPageItems;
   using FlashCommon<tInterface>::cUnusedValue;
   using FlashCommon<tInterface>::calculateChecksum;
+  using FlashCommon<tInterface>::calculateChecksumPart;
+
+public:
+  /// Takes the displacement from cProbeDisplacements if it has tPagesNeeded, otherwise see README: gcd(B, d) = 1 and
+  /// B / 3 < d < B / 2 with d * d - 3 * n * d + n * n closest to 0, where n = min(m, d - m) and m = B mod d. This
+  /// divides the unprobed intervals roughly by the golden ratio.
+  static constexpr uint32_t calculateDisplacement() noexcept {
+    uint32_t result = 0u;
+    for(auto const &entry : cProbeDisplacements) {
+      result = (entry[0u] == tPagesNeeded ? entry[1u] : result);
+    }
+    return result > 0u ? result : calculateGoldenRatioDisplacement();
+  }
 
 private:
-  static uint32_t            sStartPage;
-  static uint8_t*          sReadAheadBuffer;
+  static constexpr uint32_t calculateGoldenRatioDisplacement() noexcept {
+    uint32_t result = 1u;
+    uint64_t bestValue = UINT64_MAX;
+    for(uint32_t d = tPagesNeeded / 3u + 1u; 2u * d < tPagesNeeded; ++d) {
+      if(std::gcd(d, tPagesNeeded) == 1u) {
+        int64_t const m = tPagesNeeded % d;
+        int64_t const n = std::min<int64_t>(m, d - m);
+        int64_t const signedValue = static_cast<int64_t>(d) * d - 3 * n * d + n * n;
+        uint64_t const value = static_cast<uint64_t>(signedValue < 0 ? -signedValue : signedValue);
+        if(value < bestValue) {
+          bestValue = value;
+          result = d;
+        }
+        else { // nothing to do
+        }
+      }
+      else { // nothing to do
+      }
+    }
+    return result;
+  }
+
+  /// At most half full.
+  static constexpr uint32_t calculateErrorTableBits() noexcept {
+    uint32_t result = 1u;
+    while((1u << result) < 2u * tErrorCounterCount) {
+      ++result;
+    }
+    return result;
+  }
+
+  static constexpr uint32_t cDisplacement = calculateDisplacement();
+  static constexpr uint32_t cNoPage       = 0xffffffffu;
+  static constexpr bool     cLeoBounded   = (2u * tLeoMaxCount <= tPagesNeeded); // the pages tLeoMaxCount away from a LEO page are not LEO
+  static constexpr uint16_t cOffsetOnTime         = cOffsetPageItems;
+  static constexpr uint16_t cOffsetLogEntries     = cOffsetOnTime + sizeof(uint32_t);
+  static constexpr bool     cLog                  = (tLogEntrySize > 0u);
+  static constexpr uint32_t cLogEntriesPerPage    = (cLog ? (cPageSizeInBytes - cOffsetLogEntries) / tLogEntrySize : 0u);
+  static constexpr uint32_t cWriteBurstSize       = tReadAheadSizeInPages - 1u; // the last buffer page is for reading
+  static constexpr uint32_t cReadSlot             = tReadAheadSizeInPages - 1u;
+  static constexpr uint8_t  cErasedByte           = static_cast<uint8_t>(Magic::cErased);
+  static constexpr uint16_t cOffsetErrorCounters  = cOffsetOnTime + sizeof(uint32_t);
+  static constexpr uint32_t cErrorCounterSize     = sizeof(uint16_t) + sizeof(uint32_t);
+  static constexpr uint32_t cErrorCountersPerPage = (cPageSizeInBytes - cOffsetErrorCounters) / cErrorCounterSize;
+  static constexpr bool     cErrorCounters        = (tErrorCounterCount > 0u);
+  static constexpr uint32_t cErrorTableBits       = calculateErrorTableBits();
+  static constexpr uint32_t cErrorTableSize       = (cErrorCounters ? 1u << cErrorTableBits : 0u);
+  static constexpr uint32_t cErrorHashFactor      = 2654435761u;
+  static constexpr uint16_t cOffsetOnTimeTicks    = cOffsetOnTime + sizeof(uint32_t);
+  static constexpr bool     cOnTimeTicks          = (tOnTimeTickBytes > 0u);
+  static constexpr uint32_t cOnTimeTicksPerPage   = tOnTimeTickBytes * 8u;
+
+  static_assert(std::gcd(cDisplacement, tPagesNeeded) == 1u, "The displacement must reach every page.");
+  static_assert(!cLog || cLogEntriesPerPage > 0u, "A log entry must fit a page.");
+  static_assert(!cLog || (tLogQueueSizeInEntries > 0u && (tLogQueueSizeInEntries & (tLogQueueSizeInEntries - 1u)) == 0u), "The log queue size must be a power of 2.");
+  static_assert(!cLog || std::atomic<uint32_t>::is_always_lock_free, "Logging from interrupts needs lock-free atomics.");
+  static_assert((tErrorCounterCount + cErrorCountersPerPage - 1u) / cErrorCountersPerPage + cSectorSizeInPages <= tLeoMaxCount / 2u, "The error counters must fit half of the LEO series.");
+  static_assert(tOnTimeTickBytes <= cPageSizeInBytes - cOffsetOnTimeTicks, "The on-time ticks must fit a page.");
+
+  /// A slot is free for the enqueue position p if its sequence is p, and holds the entry for the dequeue position p
+  /// if its sequence is p + 1.
+  struct LogSlot final {
+    std::atomic<uint32_t> mSequence;
+    uint8_t               mEntry[cLog ? tLogEntrySize : 1u];
+  };
+
+  /// mPage is the page holding the last written value, relative to the partition start, or tPagesNeeded + the buffer
+  /// page during a flush, or cNoPage if none.
+  struct ErrorCounter final {
+    uint16_t mId;
+    bool     mDirty;
+    uint32_t mCount;
+    uint32_t mPage;
+  };
+
+  static uint32_t              sStartPage;
+  static uint8_t*              sReadAheadBuffer;
+  static uint32_t              sLeoStartPage;  // relative to partition start
+  static uint32_t              sLeoPageCount;
+  static uint32_t              sProbeCount;    // page reads of the last discovery
+  static uint32_t              sOnTime;        // written in each LEO page
+  static LogSlot*              sLogSlots;
+  static std::atomic<uint32_t> sLogEnqueue;
+  static uint32_t              sLogDequeue;
+  static std::atomic<uint32_t> sLogDropCount;
+  static bool                  sLogWaiting;     // some entries were seen but not written
+  static uint32_t              sLogWaitingSince;
+  static ErrorCounter*         sErrorCounters;
+  static uint32_t              sErrorCounterCount;
+  static uint32_t              sTickPage;      // the cOnTimeOnly page being ticked, or cNoPage
+  static uint32_t              sTickBase;
+  static uint32_t              sTickCount;     // bits cleared in sTickPage
 
   FlashLoadBalancing() = delete;
 
@@ -33,19 +157,764 @@ private:
 
   static void init(uint32_t const aStartPage) noexcept {
     sStartPage = aStartPage;
-    sReadAheadBuffer = tInterface::_newArray<uint8_t>(tReadAheadSizeInPages * tInterface::getPageSizeInBytes());
+    sReadAheadBuffer = tInterface::template _newArray<uint8_t>(tReadAheadSizeInPages * cPageSizeInBytes);
+    sLogSlots = (cLog ? tInterface::template _newArray<LogSlot>(tLogQueueSizeInEntries) : nullptr);
+    for(uint32_t i = 0u; cLog && i < tLogQueueSizeInEntries; ++i) {
+      sLogSlots[i].mSequence.store(i, std::memory_order_relaxed);
+    }
+    sLogEnqueue.store(0u, std::memory_order_relaxed);
+    sLogDequeue = 0u;
+    sLogDropCount.store(0u, std::memory_order_relaxed);
+    sLogWaiting = false;
+    sErrorCounters = (cErrorCounters ? tInterface::template _newArray<ErrorCounter>(cErrorTableSize) : nullptr);
+    for(uint32_t i = 0u; i < cErrorTableSize; ++i) {
+      sErrorCounters[i] = ErrorCounter{ cUnusedValue, false, 0u, cNoPage };
+    }
+    sErrorCounterCount = 0u;
+    sTickPage = cNoPage;
+    findLeo();
+    if constexpr(cErrorCounters) {
+      loadErrorCounters();
+    }
+    else { // nothing to do
+    }
   }
 
   static void done() noexcept {
-    tInterface::_deleteArray<uint8_t>(tReadAheadBuffer);
+    tInterface::template _deleteArray<uint8_t>(sReadAheadBuffer);
+    if constexpr(cLog) {
+      tInterface::template _deleteArray<LogSlot>(sLogSlots);
+    }
+    else { // nothing to do
+    }
+    if constexpr(cErrorCounters) {
+      tInterface::template _deleteArray<ErrorCounter>(sErrorCounters);
+    }
+    else { // nothing to do
+    }
+  }
+
+public:
+  static uint32_t getLeoStartPage() noexcept {
+    return sLeoStartPage;
+  }
+
+  static uint32_t getLeoPageCount() noexcept {
+    return sLeoPageCount;
+  }
+
+  static uint32_t getProbeCount() noexcept {
+    return sProbeCount;
+  }
+
+  /// Restored on boot from the last LEO page.
+  static uint32_t getOnTime() noexcept {
+    return sOnTime;
+  }
+
+  /// The value written in the next LEO pages.
+  static void setOnTime(uint32_t const aOnTime) noexcept {
+    sOnTime = aOnTime;
+  }
+
+  /// Increments the on-time counter and saves it. If the last LEO page is the cOnTimeOnly page being ticked and it
+  /// has an unused tick, it is written again with one more bit cleared, otherwise a new one is written with the
+  /// counter as its base. Needs NOR flash, which programs bits only from 1 to 0 without erase.
+  static bool tickOnTime() noexcept;
+
+  static uint32_t getLogDropCount() noexcept {
+    return sLogDropCount.load(std::memory_order_relaxed);
+  }
+
+  /// Copies the entry of tLogEntrySize bytes into the queue. Lock-free, so it may be called from any thread or
+  /// interrupt, concurrently with flushLog. Returns false and counts the entry dropped if the queue is full.
+  static bool log(uint8_t const * const aEntry) noexcept;
+
+  /// Writes the queued entries in full cLogOnTime pages, tReadAheadSizeInPages - 1 pages at a time. A partial page is
+  /// written only if aForce, or if the entries have waited tLogMaxDelay since a flushLog first saw them, so calling
+  /// this periodically bounds the latency by tLogMaxDelay plus the period. aNow may be in any unit and may wrap.
+  static bool flushLog(uint32_t const aNow, bool const aForce = false) noexcept;
+
+  /// Calls aConsumer(uint32_t const aOnTime, uint8_t const * const aEntry) for each log entry in the LEO series,
+  /// oldest first. Pages failing the checksum are reported as cLeoBadPage and skipped.
+  template<typename tConsumer>
+  static bool readLog(tConsumer aConsumer) noexcept;
+
+  /// Adds aIncrement to the counter of aId in RAM, taking a new place in the table for a new id. Returns false if
+  /// aId is ffff or there are already tErrorCounterCount ids. The application must serialize the counter calls.
+  static bool countError(uint16_t const aId, uint32_t const aIncrement = 1u) noexcept {
+    bool result = false;
+    if constexpr(cErrorCounters) {
+      ErrorCounter * const counter = (aId == cUnusedValue ? nullptr : findErrorCounter(aId, true));
+      if(counter != nullptr) {
+        counter->mCount += aIncrement;
+        counter->mDirty = true;
+        result = true;
+      }
+      else if(aId != cUnusedValue) {
+        tInterface::fatalError(FlashException::cErrorCounterFull);
+      }
+      else { // nothing to do
+      }
+    }
+    else { // nothing to do
+    }
+    return result;
+  }
+
+  /// Returns 0 for unknown ids.
+  static uint32_t getErrorCount(uint16_t const aId) noexcept {
+    uint32_t result = 0u;
+    if constexpr(cErrorCounters) {
+      ErrorCounter const * const counter = (aId == cUnusedValue ? nullptr : findErrorCounter(aId, false));
+      result = (counter == nullptr ? 0u : counter->mCount);
+    }
+    else { // nothing to do
+    }
+    return result;
   }
+
+  /// Writes the counters changed since the last flush, densely packed in cErrorCounterOnTime pages. Counters whose
+  /// last page gets erased to keep the LEO series short are written again, also if a log flush erased it.
+  static bool flushErrorCounters() noexcept;
+
+private:
+  static void findLeo() noexcept;
+  static bool isLeo(uint32_t const aPageIndex) noexcept;
+  static uint32_t searchEnd(uint32_t const aHit, uint32_t const aNonLeoDistance, bool const aForward) noexcept;
+  static void loadErrorCounters() noexcept;
+
+  template<typename tVisitor>
+  static bool forEachLeoPage(tVisitor aVisitor) noexcept;
+
+  /// Linear probing. Returns the counter of aId, or if there is none, an empty place claimed for it if aInsert and
+  /// the table has room, otherwise nullptr.
+  static ErrorCounter* findErrorCounter(uint16_t const aId, bool const aInsert) noexcept {
+    uint32_t index = (static_cast<uint32_t>(aId) * cErrorHashFactor) >> (32u - cErrorTableBits);
+    while(sErrorCounters[index].mId != aId && sErrorCounters[index].mId != cUnusedValue) {
+      index = (index + 1u) & (cErrorTableSize - 1u);
+    }
+    ErrorCounter *result = sErrorCounters + index;
+    if(result->mId == aId) { // nothing to do
+    }
+    else if(aInsert && sErrorCounterCount < tErrorCounterCount) {
+      result->mId = aId;
+      ++sErrorCounterCount;
+    }
+    else {
+      result = nullptr;
+    }
+    return result;
+  }
+
+  /// The checksum of cOnTimeOnly pages excludes the ticks, as they are programmed later.
+  static bool isPageValid(uint8_t const * const aPage) noexcept {
+    uint16_t const checksum = (is<Magic::cOnTimeOnly>(aPage[cOffsetPageMagic]) ? calculateChecksumPart(aPage, 0u, cOffsetOnTimeTicks) : calculateChecksum(aPage));
+    return checksum == getValue<uint16_t>(aPage + cOffsetPageChecksum);
+  }
+
+  /// Returns the base plus the cleared bits of the ticks, whose byte count is in the count field.
+  static uint32_t getOnTime(uint8_t const * const aPage) noexcept {
+    uint32_t result = getValue<uint32_t>(aPage + cOffsetOnTime);
+    if(is<Magic::cOnTimeOnly>(aPage[cOffsetPageMagic])) {
+      uint32_t const tickBytes = std::min<uint32_t>(getValue<uint16_t>(aPage + cOffsetPageCount), cPageSizeInBytes - cOffsetOnTimeTicks);
+      for(uint32_t i = 0u; i < tickBytes; ++i) {
+        for(uint8_t cleared = static_cast<uint8_t>(~aPage[cOffsetOnTimeTicks + i]); cleared != 0u; cleared &= cleared - 1u) {
+          ++result;
+        }
+      }
+    }
+    else { // nothing to do
+    }
+    return result;
+  }
+
+  /// Clears the first aTicks bits of the ticks, so the page differs from the one with aTicks - 1 only in one bit.
+  static void makeTickPage(uint8_t * const aPage, uint32_t const aTicks) noexcept {
+    std::fill_n(aPage, cPageSizeInBytes, cErasedByte);
+    aPage[cOffsetPageMagic] = static_cast<uint8_t>(Magic::cOnTimeOnly);
+    setValue<uint16_t>(aPage + cOffsetPageCount, static_cast<uint16_t>(tOnTimeTickBytes));
+    setValue<uint32_t>(aPage + cOffsetOnTime, sTickBase);
+    setValue<uint16_t>(aPage + cOffsetPageChecksum, calculateChecksumPart(aPage, 0u, cOffsetOnTimeTicks));
+    std::fill_n(aPage + cOffsetOnTimeTicks, aTicks / 8u, 0u);
+    if(aTicks % 8u != 0u) {
+      aPage[cOffsetOnTimeTicks + aTicks / 8u] = static_cast<uint8_t>(cErasedByte << (aTicks % 8u));
+    }
+    else { // nothing to do
+    }
+  }
+
+  static void sealPage(uint8_t * const aPage, Magic const aMagic, uint16_t const aCount) noexcept {
+    aPage[cOffsetPageMagic] = static_cast<uint8_t>(aMagic);
+    setValue<uint16_t>(aPage + cOffsetPageCount, aCount);
+    setValue<uint32_t>(aPage + cOffsetOnTime, sOnTime);
+    setValue<uint16_t>(aPage + cOffsetPageChecksum, calculateChecksum(aPage));
+  }
+
+  static bool isLogReady(uint32_t const aPosition) noexcept {
+    return sLogSlots[aPosition % tLogQueueSizeInEntries].mSequence.load(std::memory_order_acquire) == aPosition + 1u;
+  }
+
+  static void dequeueLog(uint8_t * const aEntry) noexcept {
+    LogSlot &slot = sLogSlots[sLogDequeue % tLogQueueSizeInEntries];
+    std::memcpy(aEntry, slot.mEntry, tLogEntrySize);
+    slot.mSequence.store(sLogDequeue + tLogQueueSizeInEntries, std::memory_order_release);
+    ++sLogDequeue;
+  }
+
+  static bool writeLeoPages(uint32_t const aPageCount) noexcept;
+  static bool writeLeoPage(uint8_t const * const aPage, uint32_t const aBufferPage) noexcept;
+  static bool rescueErrorCounters() noexcept;
+  static bool trimLeo() noexcept;
+  static bool prepareSector(uint32_t const aPageIndex) noexcept;
 };
 
-template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages>
-uint32_t FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages>::sStartPage;
+/// Probes until the first LEO page. The probes before it were not LEO, so the nearest ones on both sides of the hit
+/// bound the series, as well as tLeoMaxCount if small enough. If the very first probe hits and there is no bound,
+/// the probing goes on until a page which is not LEO.
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+void FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::findLeo() noexcept {
+  sProbeCount = 0u;
+  sLeoStartPage = 0u;
+  sLeoPageCount = 0u;
+  sOnTime = 0u;
+  uint32_t hit = cNoPage;
+  uint32_t hitIndex = 0u;
+  for(uint32_t probe = 0u; hit == cNoPage && hitIndex < tPagesNeeded; probe = (probe + cDisplacement) % tPagesNeeded) {
+    if(isLeo(probe)) {
+      hit = probe;
+    }
+    else {
+      ++hitIndex;
+    }
+  }
+  if(hit != cNoPage) {
+    uint32_t before = (cLeoBounded ? tLeoMaxCount : tPagesNeeded); // distance of the nearest page not LEO before the hit
+    uint32_t after = before;
+    if(!cLeoBounded && hitIndex == 0u) {
+      uint32_t probe = cDisplacement % tPagesNeeded;
+      for(uint32_t i = 1u; after == tPagesNeeded && i < tPagesNeeded; ++i) {
+        if(!isLeo(probe)) {
+          before = (hit + tPagesNeeded - probe) % tPagesNeeded;
+          after = (probe + tPagesNeeded - hit) % tPagesNeeded;
+        }
+        else { // nothing to do
+        }
+        probe = (probe + cDisplacement) % tPagesNeeded;
+      }
+    }
+    else {
+      uint32_t probe = 0u;
+      for(uint32_t i = 0u; i < hitIndex; ++i) {
+        before = std::min(before, (hit + tPagesNeeded - probe) % tPagesNeeded);
+        after = std::min(after, (probe + tPagesNeeded - hit) % tPagesNeeded);
+        probe = (probe + cDisplacement) % tPagesNeeded;
+      }
+    }
+    if(after < tPagesNeeded) {
+      uint32_t const endDistance = searchEnd(hit, after, true);
+      uint32_t const startDistance = searchEnd(hit, before, false);
+      sLeoStartPage = (hit + tPagesNeeded - startDistance) % tPagesNeeded;
+      sLeoPageCount = startDistance + 1u + endDistance;
+    }
+    else {
+      sLeoPageCount = tPagesNeeded;
+    }
+    uint8_t * const page = sReadAheadBuffer + cReadSlot * cPageSizeInBytes;
+    uint32_t const lastPage = (sLeoStartPage + sLeoPageCount - 1u) % tPagesNeeded;
+    if(tInterface::readPages(sStartPage + lastPage, 1u, page) == SpiResult::cOk && isPageValid(page)) {
+      sOnTime = getOnTime(page);
+      if(is<Magic::cOnTimeOnly>(page[cOffsetPageMagic]) && getValue<uint16_t>(page + cOffsetPageCount) == tOnTimeTickBytes) {
+        sTickPage = lastPage;
+        sTickBase = getValue<uint32_t>(page + cOffsetOnTime);
+        sTickCount = sOnTime - sTickBase;
+      }
+      else { // nothing to do
+      }
+    }
+    else { // nothing to do
+    }
+  }
+  else { // nothing to do
+  }
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+bool FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::isLeo(uint32_t const aPageIndex) noexcept {
+  ++sProbeCount;
+  bool result = false;
+  if(tInterface::readPages(sStartPage + aPageIndex, 1u, sReadAheadBuffer) == SpiResult::cOk) {
+    uint8_t const magic = sReadAheadBuffer[cOffsetPageMagic];
+    result = is<Magic::cOnTimeOnly>(magic) || is<Magic::cLogOnTime>(magic) || is<Magic::cErrorCounterOnTime>(magic);
+  }
+  else {
+    tInterface::fatalError(FlashException::cFlashTransferError);
+  }
+  return result;
+}
+
+/// Returns the distance of the last LEO page from aHit in the direction, knowing the page aNonLeoDistance away is
+/// not LEO. Between them, the LEO pages come first, so binary search applies.
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+uint32_t FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::searchEnd(uint32_t const aHit, uint32_t const aNonLeoDistance, bool const aForward) noexcept {
+  uint32_t leo = 0u;
+  uint32_t nonLeo = aNonLeoDistance;
+  while(nonLeo - leo > 1u) {
+    uint32_t const middle = leo + (nonLeo - leo) / 2u;
+    uint32_t const page = (aForward ? aHit + middle : aHit + tPagesNeeded - middle) % tPagesNeeded;
+    if(isLeo(page)) {
+      leo = middle;
+    }
+    else {
+      nonLeo = middle;
+    }
+  }
+  return leo;
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+bool FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::log(uint8_t const * const aEntry) noexcept {
+  bool result = false;
+  if constexpr(cLog) {
+    uint32_t position = sLogEnqueue.load(std::memory_order_relaxed);
+    LogSlot *slot = nullptr;
+    bool goOn = true;
+    while(goOn) {
+      slot = sLogSlots + position % tLogQueueSizeInEntries;
+      int32_t const difference = static_cast<int32_t>(slot->mSequence.load(std::memory_order_acquire) - position);
+      if(difference == 0) {
+        result = sLogEnqueue.compare_exchange_weak(position, position + 1u, std::memory_order_relaxed);
+        goOn = !result;
+      }
+      else if(difference < 0) { // full
+        goOn = false;
+      }
+      else { // an other producer took it
+        position = sLogEnqueue.load(std::memory_order_relaxed);
+      }
+    }
+    if(result) {
+      std::memcpy(slot->mEntry, aEntry, tLogEntrySize);
+      slot->mSequence.store(position + 1u, std::memory_order_release);
+    }
+    else {
+      sLogDropCount.fetch_add(1u, std::memory_order_relaxed);
+    }
+  }
+  else { // nothing to do
+  }
+  return result;
+}
+
+/// The tick page must still be the last LEO page, so findLeo restores the counter from the last page, and the
+/// counter must not have been set meanwhile.
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+bool FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::tickOnTime() noexcept {
+  bool ok = true;
+  if constexpr(cOnTimeTicks) {
+    ++sOnTime;
+    uint32_t const lastPage = (sLeoStartPage + sLeoPageCount + tPagesNeeded - 1u) % tPagesNeeded;
+    if(sLeoPageCount > 0u && sTickPage == lastPage && sTickCount < cOnTimeTicksPerPage && sTickBase + sTickCount + 1u == sOnTime) {
+      makeTickPage(sReadAheadBuffer, sTickCount + 1u);
+      ok = (tInterface::writePage(sStartPage + sTickPage, sReadAheadBuffer) == SpiResult::cOk);
+      if(ok) {
+        ++sTickCount;
+      }
+      else {
+        tInterface::fatalError(FlashException::cFlashTransferError);
+      }
+    }
+    else {
+      sTickBase = sOnTime;
+      makeTickPage(sReadAheadBuffer, 0u);
+      ok = writeLeoPages(1u);
+      sTickPage = (ok ? (sLeoStartPage + sLeoPageCount - 1u) % tPagesNeeded : cNoPage);
+      sTickCount = 0u;
+    }
+  }
+  else { // nothing to do
+  }
+  return ok;
+}
+
+/// Only the entries ready in order are written, so an entry being copied by a preempted producer waits for the next
+/// call together with the ones after it.
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+bool FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::flushLog(uint32_t const aNow, bool const aForce) noexcept {
+  bool ok = true;
+  if constexpr(cLog) {
+    uint32_t ready = 0u;
+    while(ready < tLogQueueSizeInEntries && isLogReady(sLogDequeue + ready)) {
+      ++ready;
+    }
+    if(ready > 0u && !sLogWaiting) {
+      sLogWaiting = true;
+      sLogWaitingSince = aNow;
+    }
+    else { // nothing to do
+    }
+    bool const due = (aForce || (sLogWaiting && aNow - sLogWaitingSince >= tLogMaxDelay));
+    uint32_t toWrite = (due ? ready : ready / cLogEntriesPerPage * cLogEntriesPerPage);
+    sLogWaiting = (ready > toWrite);
+    while(ok && toWrite > 0u) {
+      uint32_t pageCount = 0u;
+      for(; toWrite > 0u && pageCount < cWriteBurstSize; ++pageCount) {
+        uint8_t * const page = sReadAheadBuffer + pageCount * cPageSizeInBytes;
+        uint32_t const count = std::min(toWrite, cLogEntriesPerPage);
+        std::fill_n(page, cPageSizeInBytes, cErasedByte);
+        for(uint32_t i = 0u; i < count; ++i) {
+          dequeueLog(page + cOffsetLogEntries + i * tLogEntrySize);
+        }
+        sealPage(page, Magic::cLogOnTime, static_cast<uint16_t>(count));
+        toWrite -= count;
+      }
+      ok = writeLeoPages(pageCount);
+    }
+  }
+  else { // nothing to do
+  }
+  return ok;
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+template<typename tConsumer>
+bool FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::readLog(tConsumer aConsumer) noexcept {
+  return forEachLeoPage([&aConsumer](uint32_t const, uint8_t const * const aPage){
+    uint16_t const count = getValue<uint16_t>(aPage + cOffsetPageCount);
+    if(!is<Magic::cLogOnTime>(aPage[cOffsetPageMagic])) { // nothing to do
+    }
+    else if(count > cLogEntriesPerPage) {
+      tInterface::fatalError(FlashException::cLeoBadPage);
+    }
+    else {
+      uint32_t const onTime = getValue<uint32_t>(aPage + cOffsetOnTime);
+      for(uint16_t i = 0u; i < count; ++i) {
+        aConsumer(onTime, aPage + cOffsetLogEntries + i * tLogEntrySize);
+      }
+    }
+  });
+}
+
+/// Packs at most cWriteBurstSize pages in one go, scanning the table again after each, as erasing the oldest sector
+/// may have marked counters before the scan position dirty.
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+bool FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::flushErrorCounters() noexcept {
+  bool ok = true;
+  if constexpr(cErrorCounters) {
+    uint32_t pageCount = 1u;
+    while(ok && pageCount > 0u) {
+      pageCount = 0u;
+      uint32_t count = 0u;
+      for(uint32_t i = 0u; i < cErrorTableSize && pageCount < cWriteBurstSize; ++i) {
+        ErrorCounter &counter = sErrorCounters[i];
+        if(counter.mDirty) {
+          uint8_t * const page = sReadAheadBuffer + pageCount * cPageSizeInBytes;
+          if(count == 0u) {
+            std::fill_n(page, cPageSizeInBytes, cErasedByte);
+          }
+          else { // nothing to do
+          }
+          setValue<uint16_t>(page + cOffsetErrorCounters + count * cErrorCounterSize, counter.mId);
+          setValue<uint32_t>(page + cOffsetErrorCounters + count * cErrorCounterSize + sizeof(uint16_t), counter.mCount);
+          counter.mDirty = false;
+          counter.mPage = tPagesNeeded + pageCount;
+          if(++count == cErrorCountersPerPage) {
+            sealPage(page, Magic::cErrorCounterOnTime, static_cast<uint16_t>(count));
+            ++pageCount;
+            count = 0u;
+          }
+          else { // nothing to do
+          }
+        }
+        else { // nothing to do
+        }
+      }
+      if(count > 0u) {
+        sealPage(sReadAheadBuffer + pageCount * cPageSizeInBytes, Magic::cErrorCounterOnTime, static_cast<uint16_t>(count));
+        ++pageCount;
+      }
+      else { // nothing to do
+      }
+      if(pageCount > 0u) {
+        ok = writeLeoPages(pageCount);
+        for(uint32_t i = 0u; i < cErrorTableSize; ++i) { // the ones in pages not written
+          ErrorCounter &counter = sErrorCounters[i];
+          if(counter.mPage >= tPagesNeeded && counter.mPage != cNoPage) {
+            counter.mDirty = true;
+            counter.mPage = cNoPage;
+          }
+          else { // nothing to do
+          }
+        }
+      }
+      else { // nothing to do
+      }
+    }
+  }
+  else { // nothing to do
+  }
+  return ok;
+}
+
+/// Newer pages overwrite the values of older ones.
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+void FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::loadErrorCounters() noexcept {
+  forEachLeoPage([](uint32_t const aPageIndex, uint8_t const * const aPage){
+    uint16_t const count = getValue<uint16_t>(aPage + cOffsetPageCount);
+    if(!is<Magic::cErrorCounterOnTime>(aPage[cOffsetPageMagic])) { // nothing to do
+    }
+    else if(count > cErrorCountersPerPage) {
+      tInterface::fatalError(FlashException::cLeoBadPage);
+    }
+    else {
+      for(uint16_t i = 0u; i < count; ++i) {
+        uint8_t const * const pair = aPage + cOffsetErrorCounters + i * cErrorCounterSize;
+        ErrorCounter * const counter = findErrorCounter(getValue<uint16_t>(pair), true);
+        if(counter != nullptr) {
+          counter->mCount = getValue<uint32_t>(pair + sizeof(uint16_t));
+          counter->mPage = aPageIndex;
+        }
+        else {
+          tInterface::fatalError(FlashException::cErrorCounterFull);
+        }
+      }
+    }
+  });
+}
+
+/// Calls aVisitor(uint32_t const aPageIndex, uint8_t const * const aPage) for each LEO page in order, reading them
+/// in chunks of the buffer. Pages failing the checksum are reported and skipped.
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+template<typename tVisitor>
+bool FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::forEachLeoPage(tVisitor aVisitor) noexcept {
+  bool ok = true;
+  for(uint32_t done = 0u; ok && done < sLeoPageCount;) {
+    uint32_t const pageIndex = (sLeoStartPage + done) % tPagesNeeded;
+    uint32_t const pageCount = std::min({ tReadAheadSizeInPages, sLeoPageCount - done, tPagesNeeded - pageIndex });
+    ok = (tInterface::readPages(sStartPage + pageIndex, pageCount, sReadAheadBuffer) == SpiResult::cOk);
+    for(uint32_t i = 0u; ok && i < pageCount; ++i) {
+      uint8_t const * const page = sReadAheadBuffer + i * cPageSizeInBytes;
+      if(isPageValid(page)) {
+        aVisitor(pageIndex + i, page);
+      }
+      else {
+        tInterface::fatalError(FlashException::cLeoBadPage);
+      }
+    }
+    done += pageCount;
+  }
+  if(!ok) {
+    tInterface::fatalError(FlashException::cFlashTransferError);
+  }
+  else { // nothing to do
+  }
+  return ok;
+}
+
+/// Writes the sealed buffer pages after the last LEO page. Entering a sector, the oldest sectors are erased until
+/// the series fits tLeoMaxCount with the new sector, which also keeps the series from wrapping onto itself. Then the
+/// error counters are moved away from the sector the next entry will erase, and if they fill the sector, the next one
+/// is entered the same way.
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+bool FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::writeLeoPages(uint32_t const aPageCount) noexcept {
+  bool ok = true;
+  for(uint32_t i = 0u; ok && i < aPageCount; ++i) {
+    uint32_t head = (sLeoStartPage + sLeoPageCount) % tPagesNeeded;
+    for(bool enter = (head % cSectorSizeInPages == 0u); ok && enter;) {
+      while(ok && sLeoPageCount > 0u && sLeoPageCount + cSectorSizeInPages > tLeoMaxCount) {
+        ok = trimLeo();
+      }
+      ok = (ok && prepareSector(head) && rescueErrorCounters());
+      uint32_t const newHead = (sLeoStartPage + sLeoPageCount) % tPagesNeeded;
+      enter = (newHead != head && newHead % cSectorSizeInPages == 0u);
+      head = newHead;
+    }
+    ok = (ok && writeLeoPage(sReadAheadBuffer + i * cPageSizeInBytes, i));
+  }
+  if(!ok) {
+    tInterface::fatalError(FlashException::cFlashTransferError);
+  }
+  else { // nothing to do
+  }
+  return ok;
+}
+
+/// Writes the page at the head without entering a sector, and assigns it to the error counters waiting for buffer
+/// page aBufferPage.
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+bool FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::writeLeoPage(uint8_t const * const aPage, uint32_t const aBufferPage) noexcept {
+  uint32_t const head = (sLeoStartPage + sLeoPageCount) % tPagesNeeded;
+  bool const ok = (tInterface::writePage(sStartPage + head, aPage) == SpiResult::cOk);
+  if(ok) {
+    sLeoStartPage = (sLeoPageCount == 0u ? head : sLeoStartPage);
+    ++sLeoPageCount;
+    for(uint32_t i = 0u; i < cErrorTableSize; ++i) {
+      ErrorCounter &counter = sErrorCounters[i];
+      if(counter.mPage == tPagesNeeded + aBufferPage) {
+        counter.mDirty = false;
+        counter.mPage = head;
+      }
+      else { // nothing to do
+      }
+    }
+  }
+  else { // nothing to do
+  }
+  return ok;
+}
+
+/// Called entering a sector. As the series grows a sector between two entries, and trimLeo keeps its start at a sector
+/// boundary, the next entry erases the oldest sector if the series would not fit then. The counters last written
+/// there are written again now, densely packed, so they fit the sector just entered, and no counter ever loses its
+/// only stored value, not even when only logs or ticks are written meanwhile.
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+bool FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::rescueErrorCounters() noexcept {
+  bool ok = true;
+  if constexpr(cErrorCounters) {
+    if(sLeoPageCount > 0u && sLeoPageCount + 2u * cSectorSizeInPages > tLeoMaxCount) {
+      uint8_t * const page = sReadAheadBuffer + cReadSlot * cPageSizeInBytes;
+      uint32_t const oldestSector = sLeoStartPage / cSectorSizeInPages;
+      uint32_t count = 0u;
+      for(uint32_t i = 0u; ok && i < cErrorTableSize; ++i) {
+        ErrorCounter &counter = sErrorCounters[i];
+        if(counter.mPage < tPagesNeeded && counter.mPage / cSectorSizeInPages == oldestSector) {
+          if(count == 0u) {
+            std::fill_n(page, cPageSizeInBytes, cErasedByte);
+          }
+          else { // nothing to do
+          }
+          setValue<uint16_t>(page + cOffsetErrorCounters + count * cErrorCounterSize, counter.mId);
+          setValue<uint32_t>(page + cOffsetErrorCounters + count * cErrorCounterSize + sizeof(uint16_t), counter.mCount);
+          counter.mPage = tPagesNeeded + cReadSlot;
+          if(++count == cErrorCountersPerPage) {
+            sealPage(page, Magic::cErrorCounterOnTime, static_cast<uint16_t>(count));
+            ok = writeLeoPage(page, cReadSlot);
+            count = 0u;
+          }
+          else { // nothing to do
+          }
+        }
+        else { // nothing to do
+        }
+      }
+      if(ok && count > 0u) {
+        sealPage(page, Magic::cErrorCounterOnTime, static_cast<uint16_t>(count));
+        ok = writeLeoPage(page, cReadSlot);
+      }
+      else { // nothing to do
+      }
+      for(uint32_t i = 0u; !ok && i < cErrorTableSize; ++i) { // the ones in the page not written
+        ErrorCounter &counter = sErrorCounters[i];
+        if(counter.mPage == tPagesNeeded + cReadSlot) {
+          counter.mDirty = true;
+          counter.mPage = cNoPage;
+        }
+        else { // nothing to do
+        }
+      }
+    }
+    else { // nothing to do
+    }
+  }
+  else { // nothing to do
+  }
+  return ok;
+}
+
+/// Erases the sector of the first LEO page. The error counters last written there, which rescueErrorCounters could
+/// not move, like after a failed write, become dirty.
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+bool FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::trimLeo() noexcept {
+  uint32_t const sectorEnd = (sLeoStartPage / cSectorSizeInPages + 1u) * cSectorSizeInPages;
+  bool const ok = (tInterface::eraseSector((sStartPage + sLeoStartPage) / cSectorSizeInPages) == SpiResult::cOk);
+  if(ok) {
+    for(uint32_t i = 0u; i < cErrorTableSize; ++i) {
+      ErrorCounter &counter = sErrorCounters[i];
+      if(counter.mPage < tPagesNeeded && counter.mPage / cSectorSizeInPages == sLeoStartPage / cSectorSizeInPages) {
+        counter.mDirty = true;
+        counter.mPage = cNoPage;
+      }
+      else { // nothing to do
+      }
+    }
+    uint32_t const removed = std::min(sLeoPageCount, sectorEnd - sLeoStartPage);
+    sLeoStartPage = (sLeoStartPage + removed) % tPagesNeeded;
+    sLeoPageCount -= removed;
+  }
+  else { // nothing to do
+  }
+  return ok;
+}
+
+/// Erases the sector starting at the page unless it is erased already, which is checked page by page in the last
+/// buffer page, as a sector erase takes much longer than reading it.
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+bool FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::prepareSector(uint32_t const aPageIndex) noexcept {
+  uint8_t * const page = sReadAheadBuffer + cReadSlot * cPageSizeInBytes;
+  bool erased = true;
+  bool ok = true;
+  for(uint32_t i = 0u; ok && erased && i < cSectorSizeInPages; ++i) {
+    ok = (tInterface::readPages(sStartPage + aPageIndex + i, 1u, page) == SpiResult::cOk);
+    erased = std::all_of(page, page + cPageSizeInBytes, [](uint8_t const aByte){ return aByte == cErasedByte; });
+  }
+  if(ok && !erased) {
+    ok = (tInterface::eraseSector((sStartPage + aPageIndex) / cSectorSizeInPages) == SpiResult::cOk);
+  }
+  else { // nothing to do
+  }
+  return ok;
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+uint32_t FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::sStartPage;
+
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+uint8_t* FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::sReadAheadBuffer;
+
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+uint32_t FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::sLeoStartPage;
+
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+uint32_t FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::sLeoPageCount;
+
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+uint32_t FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::sProbeCount;
+
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+uint32_t FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::sOnTime;
+
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+typename FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::LogSlot* FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::sLogSlots;
+
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+std::atomic<uint32_t> FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::sLogEnqueue;
+
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+uint32_t FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::sLogDequeue;
+
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+std::atomic<uint32_t> FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::sLogDropCount;
+
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+bool FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::sLogWaiting;
+
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+uint32_t FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::sLogWaitingSince;
+
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+typename FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::ErrorCounter* FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::sErrorCounters;
+
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+uint32_t FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::sErrorCounterCount;
+
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+uint32_t FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::sTickPage;
+
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+uint32_t FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::sTickBase;
 
-template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages>
-uint8_t FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages>::sReadAheadBuffer;
+template<typename tInterface, uint32_t tPagesNeeded, uint16_t tBalancingInitialFillCount, uint32_t tLeoMaxCount, uint32_t tReadAheadSizeInPages, uint32_t tLogEntrySize, uint32_t tLogQueueSizeInEntries, uint32_t tLogMaxDelay, uint32_t tErrorCounterCount, uint32_t tOnTimeTickBytes>
+uint32_t FlashLoadBalancing<tInterface, tPagesNeeded, tBalancingInitialFillCount, tLeoMaxCount, tReadAheadSizeInPages, tLogEntrySize, tLogQueueSizeInEntries, tLogMaxDelay, tErrorCounterCount, tOnTimeTickBytes>::sTickCount;
 
 }
 
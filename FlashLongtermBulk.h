@@ -2,30 +2,87 @@
 #define NOWTECH_FLASHLONGTERMBULK
 
 #include "FlashCommon.h"
+#include "FlashCompression.h"
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
 
 namespace nowtech::memory {
 
-template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages>
+/// Long-term bulk data storage. Each item starts in a new page, and its data continues right after the page header
+/// of the following pages, so the number of its pages follows from its length. On boot, only the pages holding item
+/// headers are read to build the index, and the other pages are read and checked only when the item is read. The
+/// items are delivered in chunks of the read ahead buffer, so they may be much bigger than the RAM. The items are
+/// written the same way: the appended data is collected in whole pages in the read ahead buffer, and the header page
+/// is kept in its first page until the item is finished, so the item length is known when it gets written.
+/// With a nonzero tCompressionWindowSize, the items can be stored LZSS-compressed, flagged in their header. The
+/// compression happens while appending and the decompression while reading, so the chunks stay streamed.
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize = 0u>
 class FlashLongtermBulk final : FlashCommon<tInterface> {
-  static_assert(tCopies == FlashCopies::c1 || tCopies == FlashCopies::c2);
-  static_assert(tPagesNeeded % 2u == 0 || tCopies == FlashCopies::c1);
-  static_assert(tReadAheadSizeInPages > 1u);
-
   template<typename tInterfaceOther, typename tPlugin1, typename tPlugin2, typename tPlugin3>
   friend class FlashPartitioner;
-  
+
   using FlashCommon<tInterface>::cPageSizeInBytes;
   using FlashCommon<tInterface>::cSectorSizeInPages;
-  using FlashCommon<tInterface>::cFlashSizeInPages;
   using FlashCommon<tInterface>::cOffsetPageMagic;
   using FlashCommon<tInterface>::cOffsetPageCount;
   using FlashCommon<tInterface>::cOffsetPageChecksum;
+  using FlashCommon<tInterface>::cOffsetPageItems;
   using FlashCommon<tInterface>::cUnusedValue;
   using FlashCommon<tInterface>::calculateChecksum;
 
 private:
-  static uint32_t            sStartPage;
-  static uint8_t*          sReadAheadBuffer;
+  static constexpr uint16_t cOffsetItemId         = 0u;
+  static constexpr uint16_t cOffsetItemFlags      = cOffsetItemId + sizeof(uint8_t);
+  static constexpr uint16_t cOffsetItemCount      = cOffsetItemFlags + sizeof(uint8_t);
+  static constexpr uint16_t cOffsetItemData       = cOffsetItemCount + 3u; // 24-bit count
+  static constexpr uint32_t cFirstPageDataSize    = cPageSizeInBytes - cOffsetPageItems - cOffsetItemData;
+  static constexpr uint32_t cOtherPageDataSize    = cPageSizeInBytes - cOffsetPageItems;
+  static constexpr uint32_t cMaxItemSize          = 0xffffffu;
+  static constexpr uint32_t cCopyCount            = static_cast<uint32_t>(tCopies);
+  static constexpr uint32_t cCopySizeInPages      = tPagesNeeded / cCopyCount;
+  static constexpr uint32_t cNoPage               = 0xffffffffu;
+  static constexpr uint16_t cItemCountInFirstPage = 1u;
+  static constexpr uint8_t  cErasedByte           = static_cast<uint8_t>(Magic::cErased);
+  static constexpr uint8_t  cCopyUnverified       = 0xffu;
+  static constexpr uint8_t  cCopyNone             = 0xfeu;
+  static constexpr bool     cCompression          = (tCompressionWindowSize > 0u);
+  static constexpr uint8_t  cFlagCompressed       = 0x01u;
+  static constexpr uint8_t  cValidFlags           = (cCompression ? cFlagCompressed : 0u);
+
+  static_assert(tCopies == FlashCopies::c1 || tCopies == FlashCopies::c2, "LBD needs 1 or 2 copies.");
+  static_assert(tPagesNeeded % (cCopyCount * cSectorSizeInPages) == 0u, "Each LBD copy must consist of whole sectors.");
+  static_assert(tReadAheadSizeInPages > 1u, "The read ahead buffer must hold the header pages of both copies.");
+  static_assert(tMaxItemCount > 0u && tMaxItemCount <= 0xffu, "Item count must fit the 8-bit item ids.");
+
+  enum class ReadResult : uint8_t {
+    cOk            = 0u,
+    cErrorChecksum = 1u, // or consistency
+    cErased        = 2u,
+    cContinuation  = 3u, // a valid page, but not a header page
+    cTransferError = 4u
+  };
+
+  struct IndexEntry final {
+    uint32_t mStartPage;  // relative to copy start, cNoPage if the item is missing
+    uint32_t mCount;
+    uint8_t  mMappedCopy; // the copy having all the pages valid, checked on the first mapping
+    uint8_t  mFlags;
+  };
+
+  static uint32_t    sStartPage;
+  static uint8_t*    sReadAheadBuffer;
+  static IndexEntry* sIndex;
+  static uint32_t    sFirstFreePage;   // where the next item starts, relative to copy start
+  static uint32_t    sErasedEndPage;   // the pages from sFirstFreePage until this one are known to be erased
+  static uint32_t    sWriteCount;      // of the item being written, cNoPage if none
+  static uint32_t    sWriteBufferPage; // the page of buffer page 1, relative to copy start
+  static uint32_t    sWriteSlot;       // the buffer page being filled, 0 holds the header
+  static uint32_t    sWriteOffset;     // the next free byte in it
+  static uint8_t     sWriteId;
+  static uint8_t     sWriteFlags;
+  static bool        sMapped;
+  static LzssCodec<tInterface, tCompressionWindowSize> sCodec;
 
   FlashLongtermBulk() = delete;
 
@@ -33,21 +90,730 @@ private:
     return tPagesNeeded;
   }
 
-  static void init(uint32_t const aStartPage) noexcept {
+  static void init(uint32_t const aStartPage) {
     sStartPage = aStartPage;
-    sReadAheadBuffer = tInterface::_newArray<uint8_t>(tReadAheadSizeInPages * tInterface::getPageSizeInBytes());
+    sReadAheadBuffer = tInterface::template _newArray<uint8_t>(tReadAheadSizeInPages * cPageSizeInBytes);
+    sIndex = tInterface::template _newArray<IndexEntry>(tMaxItemCount);
+    sWriteCount = cNoPage;
+    sMapped = false;
+    if constexpr(cCompression) {
+      sCodec.init();
+    }
+    else { // nothing to do
+    }
+    readIndex();
+  }
+
+  static void done() {
+    setMapped(false);
+    tInterface::template _deleteArray<uint8_t>(sReadAheadBuffer);
+    tInterface::template _deleteArray<IndexEntry>(sIndex);
+    if constexpr(cCompression) {
+      sCodec.done();
+    }
+    else { // nothing to do
+    }
+  }
+
+public:
+  /// Zero-copy view of an item in the memory-mapped flash. The page headers split the data into fragments, one in
+  /// each page. Valid only in mapped mode, that is until an LBD method other than getItemSpan needs the flash.
+  class ItemSpan final {
+  public:
+    struct Fragment final {
+      uint8_t const * mData;
+      uint32_t        mCount;
+    };
+
+    class Iterator final {
+    private:
+      ItemSpan const * mSpan;
+      uint32_t         mIndex;
+
+    public:
+      Iterator(ItemSpan const * const aSpan, uint32_t const aIndex) noexcept : mSpan(aSpan), mIndex(aIndex) {
+      }
+
+      Fragment operator*() const noexcept {
+        return mSpan->getFragment(mIndex);
+      }
+
+      Iterator& operator++() noexcept {
+        ++mIndex;
+        return *this;
+      }
+
+      bool operator!=(Iterator const &aOther) const noexcept {
+        return mIndex != aOther.mIndex;
+      }
+    };
+
+  private:
+    uint8_t const * mHeaderPage; // nullptr if the item could not be mapped
+    uint32_t        mCount;
+
+  public:
+    ItemSpan() noexcept : mHeaderPage(nullptr), mCount(0u) {
+    }
+
+    ItemSpan(uint8_t const * const aHeaderPage, uint32_t const aCount) noexcept : mHeaderPage(aHeaderPage), mCount(aCount) {
+    }
+
+    bool isValid() const noexcept {
+      return mHeaderPage != nullptr;
+    }
+
+    uint32_t getCount() const noexcept {
+      return mCount;
+    }
+
+    uint32_t getFragmentCount() const noexcept {
+      return mHeaderPage == nullptr ? 0u : getPageCount(mCount);
+    }
+
+    Fragment getFragment(uint32_t const aIndex) const noexcept {
+      uint32_t const offsetInPage = (aIndex == 0u ? cOffsetPageItems + cOffsetItemData : cOffsetPageItems);
+      uint32_t const offsetInItem = (aIndex == 0u ? 0u : cFirstPageDataSize + (aIndex - 1u) * cOtherPageDataSize);
+      return Fragment{ mHeaderPage + aIndex * cPageSizeInBytes + offsetInPage, std::min(cPageSizeInBytes - offsetInPage, mCount - offsetInItem) };
+    }
+
+    uint8_t operator[](uint32_t const aIndex) const noexcept {
+      uint32_t const pageIndex = (aIndex < cFirstPageDataSize ? 0u : 1u + (aIndex - cFirstPageDataSize) / cOtherPageDataSize);
+      uint32_t const offsetInPage = (pageIndex == 0u ? cOffsetPageItems + cOffsetItemData + aIndex : cOffsetPageItems + (aIndex - cFirstPageDataSize) % cOtherPageDataSize);
+      return mHeaderPage[pageIndex * cPageSizeInBytes + offsetInPage];
+    }
+
+    Iterator begin() const noexcept {
+      return Iterator(this, 0u);
+    }
+
+    Iterator end() const noexcept {
+      return Iterator(this, getFragmentCount());
+    }
+  };
+
+  static bool hasItem(uint8_t const aId) noexcept {
+    return aId < tMaxItemCount && sIndex[aId].mStartPage != cNoPage;
   }
-  
-  static void done() noexcept {
-    tInterface::_deleteArray<uint8_t>(tReadAheadBuffer);
+
+  static bool isItemCompressed(uint8_t const aId) noexcept {
+    return hasItem(aId) && (sIndex[aId].mFlags & cFlagCompressed) != 0u;
+  }
+
+  /// The stored length, which is the compressed one for compressed items.
+  static uint32_t getItemSize(uint8_t const aId) noexcept {
+    uint32_t result = 0u;
+    if(hasItem(aId)) {
+      result = sIndex[aId].mCount;
+    }
+    else {
+      tInterface::fatalError(FlashException::cBulkInvalidId);
+    }
+    return result;
   }
+
+  /// Calls aConsumer(uint8_t const * const aData, uint32_t const aCount) with the consecutive chunks of the item,
+  /// each at most tReadAheadSizeInPages pages long, or for compressed items at most tCompressionWindowSize bytes.
+  /// The data is valid only during the call. The pages are checked while reading, and a bad page is read from the
+  /// other copy if any. Returns false if the item could not be read completely.
+  template<typename tConsumer>
+  static bool readItem(uint8_t const aId, tConsumer aConsumer);
+
+  /// Switches the interface to mapped mode if needed, and returns the item in the mapped flash without copying.
+  /// The pages of the item are checked only on its first mapping, and if copy 1 is bad, copy 2 is mapped. The
+  /// result is invalid if the item is bad in every copy or is compressed.
+  static ItemSpan getItemSpan(uint8_t const aId) noexcept;
+
+  /// Starts writing an item, which replaces the one having the same id when finished. No other method may be called
+  /// until finishItem, as they share the read ahead buffer. aCompress is ignored without a compression window.
+  static bool beginItem(uint8_t const aId, bool const aCompress = false) noexcept;
+
+  /// Appends a chunk of any length. The whole pages are written when the buffer gets full, and the sectors are erased
+  /// when the first page is written into them. On error, the item is dropped and the next calls return false.
+  static bool appendItem(uint8_t const * const aData, uint32_t const aCount) noexcept;
+
+  /// Writes the remaining pages, and then the header page in each copy, which makes the item valid.
+  static bool finishItem() noexcept;
+
+  /// Erases the pages of all the items. The space of a replaced item is reused only after this.
+  static void clear() noexcept;
+
+  static uint32_t getFreePageCount() noexcept {
+    return cCopySizeInPages - sFirstFreePage;
+  }
+
+private:
+  static uint32_t getItemCount(uint8_t const * const aItemHeader) noexcept {
+    return getValue<uint16_t>(aItemHeader + cOffsetItemCount) | (static_cast<uint32_t>(aItemHeader[cOffsetItemCount + sizeof(uint16_t)]) << 16u);
+  }
+
+  static void setItemCount(uint8_t * const aItemHeader, uint32_t const aCount) noexcept {
+    setValue<uint16_t>(aItemHeader + cOffsetItemCount, static_cast<uint16_t>(aCount));
+    aItemHeader[cOffsetItemCount + sizeof(uint16_t)] = static_cast<uint8_t>(aCount >> 16u);
+  }
+
+  static constexpr uint32_t getSectorEnd(uint32_t const aPageIndex) noexcept {
+    return (aPageIndex / cSectorSizeInPages + 1u) * cSectorSizeInPages;
+  }
+
+  static constexpr uint32_t getPageCount(uint32_t const aCount) noexcept {
+    return aCount <= cFirstPageDataSize ? 1u : 1u + (aCount - cFirstPageDataSize + cOtherPageDataSize - 1u) / cOtherPageDataSize;
+  }
+
+  static bool isPageValid(uint8_t const * const aPage, bool const aFirst) noexcept {
+    return is<Magic::cLongtermBulk>(aPage[cOffsetPageMagic])
+        && getValue<uint16_t>(aPage + cOffsetPageCount) == (aFirst ? cItemCountInFirstPage : cUnusedValue)
+        && calculateChecksum(aPage) == getValue<uint16_t>(aPage + cOffsetPageChecksum);
+  }
+
+  static bool setMapped(bool const aMapped) noexcept {
+    bool ok = true;
+    if(sMapped != aMapped) {
+      ok = (tInterface::setMappedMode(aMapped) == SpiResult::cOk);
+      sMapped = (ok ? aMapped : sMapped);
+    }
+    else { // nothing to do
+    }
+    if(!ok) {
+      tInterface::fatalError(FlashException::cCommunication);
+    }
+    else { // nothing to do
+    }
+    return ok;
+  }
+
+  static uint8_t const * getMappedPage(uint32_t const aCopy, uint32_t const aPageIndexRelCopy) noexcept {
+    return tInterface::getMappedAddress((sStartPage + aCopy * cCopySizeInPages + aPageIndexRelCopy) * cPageSizeInBytes);
+  }
+
+  static void readIndex();
+  static uint8_t findMappedCopy(IndexEntry const &aEntry) noexcept;
+  static ReadResult readHeader(uint32_t const aCopy, uint32_t const aPageIndexRelCopy) noexcept;
+  static bool readChunk(uint32_t const aPageIndexRelCopy, uint32_t const aPageCount, bool const aFirst);
+  static uint32_t gatherData(uint32_t const aPageCount, bool const aFirst, uint32_t const aRemaining) noexcept;
+  static bool isErased(uint32_t const aBeginPage, uint32_t const aEndPage) noexcept;
+  static bool nextSlot() noexcept;
+  static void sealPage(uint32_t const aSlot) noexcept;
+  static bool writeSlots(uint32_t const aFirstSlot, uint32_t const aEndSlot, uint32_t const aFirstPage) noexcept;
+  static bool appendStored(uint8_t const * const aData, uint32_t const aCount) noexcept;
+  static void dropItem() noexcept;
 };
 
-template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages>
-uint32_t FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages>::sStartPage;
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+template<typename tConsumer>
+bool FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::readItem(uint8_t const aId, tConsumer aConsumer) {
+  bool ok = false;
+  if(hasItem(aId)) {
+    IndexEntry const entry = sIndex[aId];
+    uint32_t const pageCount = getPageCount(entry.mCount);
+    uint32_t remaining = entry.mCount;
+    bool const compressed = ((entry.mFlags & cFlagCompressed) != 0u);
+    if constexpr(cCompression) {
+      sCodec.beginDecode();
+    }
+    else { // nothing to do
+    }
+    ok = setMapped(false);
+    for(uint32_t pageDone = 0u; ok && pageDone < pageCount; pageDone += tReadAheadSizeInPages) {
+      uint32_t const chunkPageCount = std::min(tReadAheadSizeInPages, pageCount - pageDone);
+      ok = readChunk(entry.mStartPage + pageDone, chunkPageCount, pageDone == 0u);
+      if(ok) {
+        uint32_t const count = gatherData(chunkPageCount, pageDone == 0u, remaining);
+        if constexpr(cCompression) {
+          if(compressed) {
+            sCodec.decode(sReadAheadBuffer, count, aConsumer);
+          }
+          else {
+            aConsumer(static_cast<uint8_t const *>(sReadAheadBuffer), count);
+          }
+        }
+        else {
+          aConsumer(static_cast<uint8_t const *>(sReadAheadBuffer), count);
+        }
+        remaining -= count;
+      }
+      else { // nothing to do
+      }
+    }
+  }
+  else {
+    tInterface::fatalError(FlashException::cBulkInvalidId);
+  }
+  return ok;
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+typename FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::ItemSpan FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::getItemSpan(uint8_t const aId) noexcept {
+  ItemSpan result;
+  if(!hasItem(aId)) {
+    tInterface::fatalError(FlashException::cBulkInvalidId);
+  }
+  else if(!tInterface::canMapMemory()) {
+    tInterface::fatalError(FlashException::cCommunication);
+  }
+  else if((sIndex[aId].mFlags & cFlagCompressed) != 0u) { // nothing to map
+  }
+  else if(setMapped(true)) {
+    IndexEntry &entry = sIndex[aId];
+    if(entry.mMappedCopy == cCopyUnverified) {
+      entry.mMappedCopy = findMappedCopy(entry);
+    }
+    else { // nothing to do
+    }
+    if(entry.mMappedCopy != cCopyNone) {
+      result = ItemSpan(getMappedPage(entry.mMappedCopy, entry.mStartPage), entry.mCount);
+    }
+    else { // nothing to do
+    }
+  }
+  else { // nothing to do
+  }
+  return result;
+}
+
+/// Checks the pages of the item in place in the mapped flash, and returns the first copy having all of them valid.
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+uint8_t FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::findMappedCopy(IndexEntry const &aEntry) noexcept {
+  uint32_t const pageCount = getPageCount(aEntry.mCount);
+  uint8_t result = cCopyNone;
+  for(uint32_t copy = 0u; result == cCopyNone && copy < cCopyCount; ++copy) {
+    bool valid = true;
+    for(uint32_t i = 0u; valid && i < pageCount; ++i) {
+      uint8_t const * const page = getMappedPage(copy, aEntry.mStartPage + i);
+      valid = (isPageValid(page, i == 0u) && (i > 0u || getItemCount(page + cOffsetPageItems) == aEntry.mCount));
+    }
+    result = (valid ? static_cast<uint8_t>(copy) : result);
+  }
+  if(result == cCopyNone) {
+    tInterface::fatalError(FlashException::cBulkBadCopies);
+  }
+  else if(result > 0u) {
+    tInterface::fatalError(FlashException::cBulkBadCopy1);
+  }
+  else { // nothing to do
+  }
+  return result;
+}
+
+/// Jumps from header page to header page. An item is valid if its header page is valid in any copy, because the
+/// header pages are written after all the other pages of the item. If only the header page of the second copy is
+/// missing, the power was lost while finishing the item, so it gets written now. Where no copy has a valid header
+/// page, either the items end, or the next item starts in the next sector, see dropItem.
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+void FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::readIndex() {
+  std::fill_n(sIndex, tMaxItemCount, IndexEntry{ cNoPage, 0u, cCopyUnverified, 0u });
+  sFirstFreePage = cCopySizeInPages; // also on errors, so nothing gets written until clear
+  sErasedEndPage = cCopySizeInPages;
+  uint32_t pageIndex = 0u;
+  bool goOn = true;
+  bool afterItem = true; // otherwise the page may be any page of a dropped item
+  while(goOn && pageIndex < cCopySizeInPages) {
+    ReadResult const result1 = readHeader(0u, pageIndex);
+    ReadResult const result2 = (cCopyCount == 1u ? result1 : readHeader(1u, pageIndex));
+    uint8_t const * header = sReadAheadBuffer + cOffsetPageItems;
+    if(result1 == ReadResult::cTransferError || result2 == ReadResult::cTransferError) {
+      tInterface::fatalError(FlashException::cFlashTransferError);
+      goOn = false;
+    }
+    else if(result1 != ReadResult::cOk && result2 != ReadResult::cOk) {
+      if(result2 != ReadResult::cErased && afterItem) {
+        tInterface::fatalError(FlashException::cBulkBadCopies);
+      }
+      else { // nothing to do
+      }
+      uint32_t const sectorEnd = getSectorEnd(pageIndex);
+      if(!afterItem && (result1 == ReadResult::cContinuation || result2 == ReadResult::cContinuation)) {
+        // the rest of a dropped item, as writing an item here would have erased this sector first
+        sFirstFreePage = pageIndex;
+        sErasedEndPage = pageIndex;
+        goOn = false;
+      }
+      else if(isErased(pageIndex, sectorEnd)) {
+        sFirstFreePage = pageIndex;
+        sErasedEndPage = sectorEnd;
+        goOn = false;
+      }
+      else {
+        pageIndex = sectorEnd;
+        afterItem = false;
+      }
+    }
+    else if(cCopyCount > 1u && result1 == ReadResult::cOk && result2 == ReadResult::cOk && std::memcmp(header, header + cPageSizeInBytes, cOffsetItemData) != 0) {
+      tInterface::fatalError(FlashException::cBulkCopiesMismatch);
+      goOn = false;
+    }
+    else {
+      if(result1 != ReadResult::cOk) {
+        tInterface::fatalError(FlashException::cBulkBadCopy1);
+        header += cPageSizeInBytes;
+      }
+      else if(result2 == ReadResult::cErased) {
+        if(tInterface::writePage(sStartPage + cCopySizeInPages + pageIndex, sReadAheadBuffer) != SpiResult::cOk) {
+          tInterface::fatalError(FlashException::cFlashTransferError);
+        }
+        else { // nothing to do
+        }
+      }
+      else if(result2 != ReadResult::cOk) {
+        tInterface::fatalError(FlashException::cBulkBadCopy2);
+      }
+      else { // nothing to do
+      }
+      uint32_t const count = getItemCount(header);
+      sIndex[header[cOffsetItemId]] = IndexEntry{ pageIndex, count, cCopyUnverified, header[cOffsetItemFlags] };
+      pageIndex += getPageCount(count);
+      afterItem = true;
+    }
+  }
+}
+
+/// Reads the header page into the buffer page of the copy.
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+typename FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::ReadResult FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::readHeader(uint32_t const aCopy, uint32_t const aPageIndexRelCopy) noexcept {
+  ReadResult result = ReadResult::cOk;
+  uint8_t * const page = sReadAheadBuffer + aCopy * cPageSizeInBytes;
+  if(tInterface::readPages(sStartPage + aCopy * cCopySizeInPages + aPageIndexRelCopy, 1u, page) != SpiResult::cOk) {
+    result = ReadResult::cTransferError;
+  }
+  else if(is<Magic::cErased>(page[cOffsetPageMagic])) {
+    result = ReadResult::cErased;
+  }
+  else if(isPageValid(page, false)) {
+    result = ReadResult::cContinuation;
+  }
+  else if(!isPageValid(page, true) || page[cOffsetPageItems + cOffsetItemId] >= tMaxItemCount || (page[cOffsetPageItems + cOffsetItemFlags] & ~cValidFlags) != 0u
+       || aPageIndexRelCopy + getPageCount(getItemCount(page + cOffsetPageItems)) > cCopySizeInPages) {
+    result = ReadResult::cErrorChecksum;
+  }
+  else { // nothing to do
+  }
+  return result;
+}
+
+/// Reads the pages of the first copy into the read ahead buffer, and replaces the bad ones from the other copy.
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+bool FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::readChunk(uint32_t const aPageIndexRelCopy, uint32_t const aPageCount, bool const aFirst) {
+  bool ok = (tInterface::readPages(sStartPage + aPageIndexRelCopy, aPageCount, sReadAheadBuffer) == SpiResult::cOk);
+  if(ok) {
+    for(uint32_t i = 0u; ok && i < aPageCount; ++i) {
+      uint8_t * const page = sReadAheadBuffer + i * cPageSizeInBytes;
+      if(!isPageValid(page, aFirst && i == 0u)) {
+        if(cCopyCount > 1u && tInterface::readPages(sStartPage + cCopySizeInPages + aPageIndexRelCopy + i, 1u, page) == SpiResult::cOk && isPageValid(page, aFirst && i == 0u)) {
+          tInterface::fatalError(FlashException::cBulkBadCopy1);
+        }
+        else {
+          tInterface::fatalError(FlashException::cBulkBadCopies);
+          ok = false;
+        }
+      }
+      else { // nothing to do
+      }
+    }
+  }
+  else {
+    tInterface::fatalError(FlashException::cFlashTransferError);
+  }
+  return ok;
+}
+
+/// Moves the data of the pages in the buffer together at its beginning, and returns its length.
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+uint32_t FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::gatherData(uint32_t const aPageCount, bool const aFirst, uint32_t const aRemaining) noexcept {
+  uint32_t result = 0u;
+  for(uint32_t i = 0u; i < aPageCount; ++i) {
+    uint32_t const offsetInPage = (aFirst && i == 0u ? cOffsetPageItems + cOffsetItemData : cOffsetPageItems);
+    uint32_t const count = std::min(cPageSizeInBytes - offsetInPage, aRemaining - result);
+    std::memmove(sReadAheadBuffer + result, sReadAheadBuffer + i * cPageSizeInBytes + offsetInPage, count);
+    result += count;
+  }
+  return result;
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+bool FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::isErased(uint32_t const aBeginPage, uint32_t const aEndPage) noexcept {
+  bool result = true;
+  for(uint32_t copy = 0u; result && copy < cCopyCount; ++copy) {
+    for(uint32_t pageIndex = aBeginPage; result && pageIndex < aEndPage; pageIndex += tReadAheadSizeInPages) {
+      uint32_t const pageCount = std::min(tReadAheadSizeInPages, aEndPage - pageIndex);
+      if(tInterface::readPages(sStartPage + copy * cCopySizeInPages + pageIndex, pageCount, sReadAheadBuffer) == SpiResult::cOk) {
+        result = std::all_of(sReadAheadBuffer, sReadAheadBuffer + pageCount * cPageSizeInBytes, [](uint8_t const aByte){ return aByte == cErasedByte; });
+      }
+      else {
+        tInterface::fatalError(FlashException::cFlashTransferError);
+        result = false;
+      }
+    }
+  }
+  return result;
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+bool FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::beginItem(uint8_t const aId, bool const aCompress) noexcept {
+  bool ok = false;
+  if(setMapped(false)) {
+    dropItem();
+    if(aId >= tMaxItemCount) {
+      tInterface::fatalError(FlashException::cBulkInvalidId);
+    }
+    else if(sFirstFreePage >= cCopySizeInPages) {
+      tInterface::fatalError(FlashException::cBulkFull);
+    }
+    else {
+      std::fill_n(sReadAheadBuffer, cPageSizeInBytes, cErasedByte);
+      sWriteId = aId;
+      sWriteFlags = (cCompression && aCompress ? cFlagCompressed : 0u);
+      sWriteCount = 0u;
+      sWriteBufferPage = sFirstFreePage + 1u;
+      sWriteSlot = 0u;
+      sWriteOffset = cOffsetPageItems + cOffsetItemData;
+      if constexpr(cCompression) {
+        sCodec.beginEncode();
+      }
+      else { // nothing to do
+      }
+      ok = true;
+    }
+  }
+  else { // nothing to do
+  }
+  return ok;
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+bool FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::appendItem(uint8_t const * const aData, uint32_t const aCount) noexcept {
+  bool ok = (sWriteCount != cNoPage);
+  if(ok) {
+    if constexpr(cCompression) {
+      if((sWriteFlags & cFlagCompressed) != 0u) {
+        auto sink = [](uint8_t const * const aEncoded, uint32_t const aEncodedCount){ return appendStored(aEncoded, aEncodedCount); };
+        ok = sCodec.encode(aData, aCount, sink);
+      }
+      else {
+        ok = appendStored(aData, aCount);
+      }
+    }
+    else {
+      ok = appendStored(aData, aCount);
+    }
+  }
+  else { // nothing to do
+  }
+  return ok;
+}
+
+/// Appends the data as stored, that is after the compression if any.
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+bool FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::appendStored(uint8_t const * const aData, uint32_t const aCount) noexcept {
+  bool ok = (sWriteCount != cNoPage);
+  if(ok && aCount > cMaxItemSize - sWriteCount) {
+    tInterface::fatalError(FlashException::cBulkItemTooBig);
+    ok = false;
+  }
+  else { // nothing to do
+  }
+  for(uint32_t done = 0u; ok && done < aCount;) {
+    ok = (sWriteOffset < cPageSizeInBytes || nextSlot());
+    if(ok) {
+      uint32_t const count = std::min(cPageSizeInBytes - sWriteOffset, aCount - done);
+      std::memcpy(sReadAheadBuffer + sWriteSlot * cPageSizeInBytes + sWriteOffset, aData + done, count);
+      sWriteOffset += count;
+      sWriteCount += count;
+      done += count;
+    }
+    else { // nothing to do
+    }
+  }
+  if(!ok) {
+    dropItem();
+  }
+  else { // nothing to do
+  }
+  return ok;
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+bool FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::finishItem() noexcept {
+  bool ok = (sWriteCount != cNoPage);
+  if constexpr(cCompression) {
+    if(ok && (sWriteFlags & cFlagCompressed) != 0u) {
+      auto sink = [](uint8_t const * const aEncoded, uint32_t const aEncodedCount){ return appendStored(aEncoded, aEncodedCount); };
+      ok = sCodec.finishEncode(sink);
+    }
+    else { // nothing to do
+    }
+  }
+  else { // nothing to do
+  }
+  if(ok) {
+    if(sWriteSlot > 0u) {
+      sealPage(sWriteSlot);
+      ok = writeSlots(1u, sWriteSlot + 1u, sWriteBufferPage);
+    }
+    else { // nothing to do
+    }
+    sealPage(0u);
+    ok = (ok && writeSlots(0u, 1u, sFirstFreePage));
+    if(ok) {
+      sIndex[sWriteId] = IndexEntry{ sFirstFreePage, sWriteCount, cCopyUnverified, sWriteFlags };
+      sFirstFreePage += getPageCount(sWriteCount);
+      sWriteCount = cNoPage;
+    }
+    else {
+      dropItem();
+    }
+  }
+  else { // nothing to do
+  }
+  return ok;
+}
+
+/// Erases the sectors in ascending order, so an interrupted clear may leave the items of the later sectors in the
+/// flash, but the first ones are gone anyway.
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+void FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::clear() noexcept {
+  bool ok = setMapped(false);
+  dropItem();
+  std::fill_n(sIndex, tMaxItemCount, IndexEntry{ cNoPage, 0u, cCopyUnverified, 0u });
+  uint32_t const usedEnd = getSectorEnd(sFirstFreePage + cSectorSizeInPages - 1u) - cSectorSizeInPages;
+  for(uint32_t pageIndex = 0u; ok && pageIndex < usedEnd; pageIndex += cSectorSizeInPages) {
+    for(uint32_t copy = 0u; ok && copy < cCopyCount; ++copy) {
+      ok = (tInterface::eraseSector((sStartPage + copy * cCopySizeInPages + pageIndex) / cSectorSizeInPages) == SpiResult::cOk);
+    }
+  }
+  if(ok) {
+    sFirstFreePage = 0u;
+    sErasedEndPage = std::max(usedEnd, sErasedEndPage);
+  }
+  else {
+    tInterface::fatalError(FlashException::cFlashTransferError);
+    sFirstFreePage = cCopySizeInPages;
+    sErasedEndPage = cCopySizeInPages;
+  }
+}
+
+/// Seals the full page being filled, and writes the data pages if the buffer is full.
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+bool FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::nextSlot() noexcept {
+  bool ok = true;
+  if(sWriteSlot > 0u) {
+    sealPage(sWriteSlot);
+  }
+  else { // nothing to do
+  }
+  if(sWriteSlot + 1u == tReadAheadSizeInPages) {
+    ok = writeSlots(1u, tReadAheadSizeInPages, sWriteBufferPage);
+    sWriteBufferPage += tReadAheadSizeInPages - 1u;
+    sWriteSlot = 1u;
+  }
+  else {
+    ++sWriteSlot;
+  }
+  if(ok && sWriteBufferPage + sWriteSlot - 1u >= cCopySizeInPages) {
+    tInterface::fatalError(FlashException::cBulkFull);
+    ok = false;
+  }
+  else { // nothing to do
+  }
+  std::fill_n(sReadAheadBuffer + sWriteSlot * cPageSizeInBytes, cPageSizeInBytes, cErasedByte);
+  sWriteOffset = cOffsetPageItems;
+  return ok;
+}
+
+/// The checksum of each page is calculated once, when its contents are final.
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+void FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::sealPage(uint32_t const aSlot) noexcept {
+  uint8_t * const page = sReadAheadBuffer + aSlot * cPageSizeInBytes;
+  page[cOffsetPageMagic] = static_cast<uint8_t>(Magic::cLongtermBulk);
+  if(aSlot == 0u) {
+    setValue<uint16_t>(page + cOffsetPageCount, cItemCountInFirstPage);
+    page[cOffsetPageItems + cOffsetItemId] = sWriteId;
+    page[cOffsetPageItems + cOffsetItemFlags] = sWriteFlags;
+    setItemCount(page + cOffsetPageItems, sWriteCount);
+  }
+  else {
+    setValue<uint16_t>(page + cOffsetPageCount, cUnusedValue);
+  }
+  setValue<uint16_t>(page + cOffsetPageChecksum, calculateChecksum(page));
+}
+
+/// Writes the buffer pages [aFirstSlot, aEndSlot) from aFirstPage on into each copy, erasing the sectors first
+/// the writing gets into.
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+bool FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::writeSlots(uint32_t const aFirstSlot, uint32_t const aEndSlot, uint32_t const aFirstPage) noexcept {
+  uint32_t const endPage = aFirstPage + aEndSlot - aFirstSlot;
+  bool ok = true;
+  while(ok && sErasedEndPage < endPage) {
+    for(uint32_t copy = 0u; ok && copy < cCopyCount; ++copy) {
+      ok = (tInterface::eraseSector((sStartPage + copy * cCopySizeInPages + sErasedEndPage) / cSectorSizeInPages) == SpiResult::cOk);
+    }
+    sErasedEndPage += (ok ? cSectorSizeInPages : 0u);
+  }
+  for(uint32_t copy = 0u; ok && copy < cCopyCount; ++copy) {
+    for(uint32_t slot = aFirstSlot; ok && slot < aEndSlot; ++slot) {
+      ok = (tInterface::writePage(sStartPage + copy * cCopySizeInPages + aFirstPage + slot - aFirstSlot, sReadAheadBuffer + slot * cPageSizeInBytes) == SpiResult::cOk);
+    }
+  }
+  if(!ok) {
+    tInterface::fatalError(FlashException::cFlashTransferError);
+  }
+  else { // nothing to do
+  }
+  return ok;
+}
+
+/// Some pages of the dropped item may have been written after its header page, so unless the rest of its sector is
+/// erased, the next item starts in the next sector. readIndex decides the same way, and the sectors from there on
+/// get erased before writing into them.
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+void FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::dropItem() noexcept {
+  if(sWriteCount != cNoPage) {
+    sWriteCount = cNoPage;
+    uint32_t const sectorEnd = getSectorEnd(sFirstFreePage);
+    sFirstFreePage = (isErased(sFirstFreePage, sectorEnd) ? sFirstFreePage : sectorEnd);
+    sErasedEndPage = sectorEnd;
+  }
+  else { // nothing to do
+  }
+}
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+uint32_t FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::sStartPage;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+uint8_t* FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::sReadAheadBuffer;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+typename FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::IndexEntry* FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::sIndex;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+uint32_t FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::sFirstFreePage;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+uint32_t FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::sErasedEndPage;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+uint32_t FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::sWriteCount;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+uint32_t FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::sWriteBufferPage;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+uint32_t FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::sWriteSlot;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+uint32_t FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::sWriteOffset;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+uint8_t FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::sWriteId;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+uint8_t FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::sWriteFlags;
+
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+bool FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::sMapped;
 
-template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages>
-uint8_t FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages>::sReadAheadBuffer;
+template<typename tInterface, uint32_t tPagesNeeded, FlashCopies tCopies, uint32_t tReadAheadSizeInPages, uint32_t tMaxItemCount, uint32_t tCompressionWindowSize>
+LzssCodec<tInterface, tCompressionWindowSize> FlashLongtermBulk<tInterface, tPagesNeeded, tCopies, tReadAheadSizeInPages, tMaxItemCount, tCompressionWindowSize>::sCodec;
 
 }
 
@@ -0,0 +1,70 @@
+#include "FlashCommon.h"
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <vector>
+
+template<uint32_t tPageSizeInBytes>
+class ChecksumInterface final {
+public:
+  static constexpr uint32_t getPageSizeInBytes() noexcept {
+    return tPageSizeInBytes;
+  }
+
+  static constexpr uint32_t getSectorSizeInPages() noexcept {
+    return 16u;
+  }
+
+  static constexpr uint32_t getFlashSizeInPages() noexcept {
+    return 65536u;
+  }
+};
+
+template<uint32_t tPageSizeInBytes>
+class ChecksumTest final : public nowtech::memory::FlashCommon<ChecksumInterface<tPageSizeInBytes>> {
+  using Base = nowtech::memory::FlashCommon<ChecksumInterface<tPageSizeInBytes>>;
+
+public:
+  static bool run(std::mt19937 &aGenerator, uint32_t const aPageCount) {
+    std::uniform_int_distribution<uint16_t> distribution(0u, 255u);
+    std::vector<uint8_t> page(tPageSizeInBytes);
+    bool ok = true;
+    for(uint32_t i = 0u; ok && i < aPageCount; ++i) {
+      if(i == 0u) {
+        std::fill(page.begin(), page.end(), 0xffu);
+      }
+      else if(i == 1u) {
+        std::fill(page.begin(), page.end(), 0x00u);
+      }
+      else {
+        std::generate(page.begin(), page.end(), [&aGenerator, &distribution](){ return static_cast<uint8_t>(distribution(aGenerator)); });
+      }
+      uint16_t const expected = Base::calculateChecksumScalar(page.data());
+      uint16_t const word     = Base::template calculateChecksum<nowtech::memory::ChecksumKernel::cWord>(page.data());
+      uint16_t const simd     = Base::template calculateChecksum<nowtech::memory::ChecksumKernel::cSimd>(page.data());
+      uint16_t const selected = Base::calculateChecksum(page.data());
+      if(word != expected || simd != expected || selected != expected) {
+        std::cout << "page size " << tPageSizeInBytes << " page " << i << ": scalar " << expected << " word " << word << " simd " << simd << " selected " << selected << '\n';
+        ok = false;
+      }
+      else { // nothing to do
+      }
+    }
+    std::cout << "page size " << std::setw(5) << tPageSizeInBytes << ": " << (ok ? "ok" : "FAILED") << '\n';
+    return ok;
+  }
+};
+
+int main() {
+  constexpr uint32_t cPageCount = 1000u;
+  std::mt19937 generator(1234u);
+  bool ok = ChecksumTest<256u>::run(generator, cPageCount);
+  ok = ChecksumTest<512u>::run(generator, cPageCount) && ok;
+  ok = ChecksumTest<1024u>::run(generator, cPageCount) && ok;
+  ok = ChecksumTest<2048u>::run(generator, cPageCount) && ok;
+  ok = ChecksumTest<4096u>::run(generator, cPageCount) && ok;
+  ok = ChecksumTest<8192u>::run(generator, cPageCount) && ok;
+  ok = ChecksumTest<16384u>::run(generator, cPageCount) && ok;
+  ok = ChecksumTest<32768u>::run(generator, cPageCount) && ok;
+  return ok ? 0 : 1;
+}
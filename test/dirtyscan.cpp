@@ -0,0 +1,93 @@
+#include "FlashCommon.h"
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <vector>
+
+constexpr uint32_t cCopySizeInPages      = 2048u;
+constexpr uint32_t cSectorSizeInPages    =   16u;
+constexpr uint32_t cReadAheadSizeInPages =   48u;
+constexpr uint32_t cRepetitions          = 20000u;
+
+// Both scans visit the dirty read-ahead windows the same way FlashConfig::commit does.
+uint32_t scanBools(bool const * const aDirtyPages) {
+  uint32_t windows = 0u;
+  bool const * const dirtyEnd = aDirtyPages + cCopySizeInPages;
+  bool const * dirtyIter = std::find(aDirtyPages, dirtyEnd, true);
+  while(dirtyIter != dirtyEnd) {
+    uint32_t const startPage = (dirtyIter - aDirtyPages) / cSectorSizeInPages * cSectorSizeInPages;
+    uint32_t const endPage = std::min(cCopySizeInPages, startPage + cReadAheadSizeInPages);
+    dirtyIter = std::find(aDirtyPages + endPage, dirtyEnd, true);
+    ++windows;
+  }
+  return windows;
+}
+
+uint32_t scanBits(uint32_t const * const aDirtyPages) {
+  uint32_t windows = 0u;
+  uint32_t dirtyPage = nowtech::memory::findNextSetBit(aDirtyPages, 0u, cCopySizeInPages);
+  while(dirtyPage != cCopySizeInPages) {
+    uint32_t const startPage = dirtyPage / cSectorSizeInPages * cSectorSizeInPages;
+    uint32_t const endPage = std::min(cCopySizeInPages, startPage + cReadAheadSizeInPages);
+    dirtyPage = nowtech::memory::findNextSetBit(aDirtyPages, endPage, cCopySizeInPages);
+    ++windows;
+  }
+  return windows;
+}
+
+bool*     volatile gBools; // volatile so that the scans are not hoisted out of the measurement loop
+uint32_t* volatile gBits;
+
+template<typename tScan>
+double measure(tScan aScan, uint32_t &aWindows) {
+  auto const start = std::chrono::steady_clock::now();
+  uint32_t windows = 0u;
+  for(uint32_t i = 0u; i < cRepetitions; ++i) {
+    windows += aScan();
+  }
+  auto const end = std::chrono::steady_clock::now();
+  aWindows = windows / cRepetitions;
+  return std::chrono::duration<double, std::nano>(end - start).count() / cRepetitions;
+}
+
+void benchmark(char const * const aName, uint32_t const aDirtyCount, std::mt19937 &aGenerator) {
+  std::vector<bool> dirty(cCopySizeInPages, false);
+  std::uniform_int_distribution<uint32_t> distribution(0u, cCopySizeInPages - 1u);
+  for(uint32_t i = 0u; i < aDirtyCount; ++i) {
+    dirty[distribution(aGenerator)] = true;
+  }
+  bool* bools = new bool[cCopySizeInPages];
+  uint32_t* bits = new uint32_t[nowtech::memory::getBitWordCount(cCopySizeInPages)]();
+  for(uint32_t i = 0u; i < cCopySizeInPages; ++i) {
+    bools[i] = dirty[i];
+    if(dirty[i]) {
+      nowtech::memory::setBit(bits, i);
+    }
+    else { // nothing to do
+    }
+  }
+  uint32_t windowsBools;
+  uint32_t windowsBits;
+  gBools = bools;
+  gBits = bits;
+  double const nsBools = measure([](){ return scanBools(gBools); }, windowsBools);
+  double const nsBits  = measure([](){ return scanBits(gBits); }, windowsBits);
+  std::cout << std::setw(8) << aName << std::setw(6) << aDirtyCount << " dirty pages, " << std::setw(4) << windowsBools << " windows: bool[] "
+            << std::fixed << std::setprecision(1) << std::setw(9) << nsBools << " ns, bitset " << std::setw(7) << nsBits << " ns, speedup "
+            << std::setw(5) << nsBools / nsBits << (windowsBools == windowsBits ? "" : " MISMATCH") << '\n';
+  delete[] bools;
+  delete[] bits;
+}
+
+int main() {
+  std::mt19937 generator(1234u);
+  std::cout << "RAM: bool[] " << cCopySizeInPages * sizeof(bool) << " bytes, bitset " << nowtech::memory::getBitWordCount(cCopySizeInPages) * sizeof(uint32_t) << " bytes\n";
+  benchmark("empty", 0u, generator);
+  benchmark("sparse", 1u, generator);
+  benchmark("sparse", 8u, generator);
+  benchmark("medium", 64u, generator);
+  benchmark("dense", 512u, generator);
+  benchmark("dense", 2048u, generator);
+  return 0;
+}
@@ -1,12 +1,22 @@
 #include "FlashPartitioner.h"
 #include "FlashConfig.h"
-//#include "FlashLongtermBulk.h"
-//#include "FlashLoadBalancing.h"
+#include "FlashConfigSchema.h"
+#include "FlashConfigMapped.h"
+#include "FlashLongtermBulk.h"
+#include "FlashLoadBalancing.h"
 #include "FibonacciMemoryManager.h"
 #include <iostream>
 #include <iomanip>
 #include <numeric>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
 
 class FibonacciInterface final {
 public:
@@ -38,7 +48,7 @@ private:
   static constexpr uint32_t cErasedByte          =   255u;
   static constexpr uint32_t cPatternSize         = cPageSizeInBytes;
 
-  static constexpr char cExceptionTexts[][22] = { "cCommunication", "cConfigBadCopy1", "cConfigBadCopy2", "cConfigBadCopies", "cConfigCopiesMismatch", "cConfigInvalidId", "cConfigFull", "cConfigItemTooBig", "cConfigCommitError" };
+  static constexpr char cExceptionTexts[][22] = { "cCommunication", "cConfigBadCopy1", "cConfigBadCopy2", "cConfigBadCopies", "cConfigCopiesMismatch", "cConfigInvalidId", "cConfigFull", "cConfigItemTooBig", "cConfigCommitError", "cConfigSchemaMismatch", "cBulkBadCopy1", "cBulkBadCopy2", "cBulkBadCopies", "cBulkCopiesMismatch", "cBulkInvalidId", "cBulkFull", "cBulkItemTooBig", "cLeoBadPage", "cErrorCounterFull" };
 
   static uint8_t* sMemoryFlash;
   static uint8_t* sMemoryRam;
@@ -46,9 +56,28 @@ private:
 
 public:
   static uint8_t* sPattern;
+  static bool     sVerbose;       // false suppresses the printing of erases, writes and reads
+  static uint32_t sEraseDelayUs;  // simulates the sector erase time
+  static bool     sNorOnly;       // true makes writePage only clear bits like NOR flash, and count the attempts to set some
+  static uint32_t sNorViolationCount;
+  static uint32_t sFatalErrorCount;
+  static nowtech::memory::FlashException sLastFatalError;
+  static bool     sCanMap;        // false makes canMapMemory report no memory-mapped mode
+  static uint32_t sReadPageCount; // pages read by readPages
+  static uint32_t sPowerLossCountdown; // erases and page writes done before all the next ones fail, cNoPowerLoss for never
+
+  static constexpr uint32_t cNoPowerLoss = 0xffffffffu;
 
   static void init() {
     sMapped = false;
+    sVerbose = true;
+    sEraseDelayUs = 0u;
+    sNorOnly = false;
+    sNorViolationCount = 0u;
+    sFatalErrorCount = 0u;
+    sCanMap = true;
+    sReadPageCount = 0u;
+    sPowerLossCountdown = cNoPowerLoss;
     sMemoryFlash = new uint8_t[cPageSizeInBytes * cFlashSizeInPages];
     sMemoryRam = new uint8_t[cMemorySize];
     sPattern = new uint8_t[cPatternSize];
@@ -56,6 +85,10 @@ public:
     FlashNewDelete::init(sMemoryRam, false);
   }
 
+  static void eraseAll() {
+    std::fill_n(sMemoryFlash, cPageSizeInBytes * cFlashSizeInPages, cErasedByte);
+  }
+
   static void done() {
     delete[] sPattern;
     delete[] sMemoryFlash;
@@ -80,6 +113,8 @@ public:
 
   static void fatalError(nowtech::memory::FlashException const aException) {
     std::cout << "fatal error: " << cExceptionTexts[static_cast<uint8_t>(aException)] << '\n';
+    ++sFatalErrorCount;
+    sLastFatalError = aException;
   }
 
   template<typename tClass, typename ...tParameters>
@@ -103,7 +138,7 @@ public:
   }
 
   static bool canMapMemory() noexcept {
-    return true;
+    return sCanMap;
   }
 
   static nowtech::memory::SpiResult setMappedMode(bool const aMapped) noexcept {
@@ -111,6 +146,10 @@ public:
     return nowtech::memory::SpiResult::cOk;
   }
 
+  static uint8_t const * getMappedAddress(uint32_t const aAddress) noexcept {
+    return sMapped ? sMemoryFlash + aAddress : nullptr;
+  }
+
   static nowtech::memory::SpiResult readMapped(uint32_t const aAddress, uint8_t aCount, uint8_t * const aData) noexcept {
     nowtech::memory::SpiResult result;
     if(!sMapped) {
@@ -143,15 +182,32 @@ public:
     return result;
   }
 
+  /// Returns true if the power is already lost, otherwise counts the operation towards the power loss.
+  static bool isPowerLost() noexcept {
+    bool const result = (sPowerLossCountdown == 0u);
+    if(!result && sPowerLossCountdown != cNoPowerLoss) {
+      --sPowerLossCountdown;
+    }
+    else { // nothing to do
+    }
+    return result;
+  }
+
   static nowtech::memory::SpiResult eraseSector(uint32_t const aSector) noexcept {
     nowtech::memory::SpiResult result;
     if(sMapped) {
       result = nowtech::memory::SpiResult::cMap;
     }
+    else if(isPowerLost()) {
+      result = nowtech::memory::SpiResult::cError;
+    }
     else if(aSector < cFlashSizeInSectors) {
       uint8_t const erasedByte = cErasedByte;
       std::fill_n(sMemoryFlash + aSector * cSectorSizeInBytes, cSectorSizeInBytes, erasedByte);
-      std::cout << "erased sector: " << aSector << " (pages " << aSector * cSectorSizeInPages << " - " << (aSector + 1u) * cSectorSizeInPages - 1u << ")\n";
+      std::this_thread::sleep_for(std::chrono::microseconds(sEraseDelayUs));
+      if(sVerbose) {
+        std::cout << "erased sector: " << aSector << " (pages " << aSector * cSectorSizeInPages << " - " << (aSector + 1u) * cSectorSizeInPages - 1u << ")\n";
+      }
       result = nowtech::memory::SpiResult::cOk;
     }
     else {
@@ -166,16 +222,29 @@ public:
     if(sMapped) {
       result = nowtech::memory::SpiResult::cMap;
     }
+    else if(isPowerLost()) {
+      result = nowtech::memory::SpiResult::cError;
+    }
+    else if(aPage < cFlashSizeInPages && sNorOnly) {
+      uint8_t * const page = sMemoryFlash + aPage * cPageSizeInBytes;
+      for(uint32_t i = 0u; i < cPageSizeInBytes; ++i) {
+        sNorViolationCount += ((aData[i] & ~page[i]) != 0u ? 1u : 0u);
+        page[i] &= aData[i];
+      }
+      result = nowtech::memory::SpiResult::cOk;
+    }
     else if(aPage < cFlashSizeInPages) {
       std::copy_n(aData, cPageSizeInBytes, sMemoryFlash + aPage * cPageSizeInBytes);
-      std::cout << "wrote page: " << aPage << '\n';
-      for(uint16_t i = 0u; i < 16u; ++i) {
-        for(uint16_t j = 0u; j < 16u; ++j) {
-          std::cout << std::setw(2) << std::setfill('0') << std::hex << static_cast<uint16_t>(sMemoryFlash[aPage * cPageSizeInBytes + i * 16u + j]) << ' ';
+      if(sVerbose) {
+        std::cout << "wrote page: " << aPage << '\n';
+        for(uint16_t i = 0u; i < 16u; ++i) {
+          for(uint16_t j = 0u; j < 16u; ++j) {
+            std::cout << std::setw(2) << std::setfill('0') << std::hex << static_cast<uint16_t>(sMemoryFlash[aPage * cPageSizeInBytes + i * 16u + j]) << ' ';
+          }
+          std::cout << '\n';
         }
-        std::cout << '\n';
+        std::cout << '\n' << std::dec;
       }
-      std::cout << '\n' << std::dec;
       result = nowtech::memory::SpiResult::cOk;
     }
     else {
@@ -192,6 +261,7 @@ public:
     }
     else if(aStartPage < cFlashSizeInPages && aStartPage + aPageCount <= cFlashSizeInPages) {
       std::copy_n(sMemoryFlash + aStartPage * cPageSizeInBytes, cPageSizeInBytes * aPageCount, aData);
+      sReadPageCount += aPageCount;
 /*      for(uint32_t k = 0; k < aPageCount; ++k) {
         std::cout << std::dec << "reading page: " << aStartPage + k << '\n';
         for(uint16_t i = 0u; i < 16u; ++i) {
@@ -202,7 +272,9 @@ public:
         }
       }
       std::cout << '\n' << std::dec;*/
-      std::cout << "read pages " << aStartPage << " - " << aStartPage + aPageCount - 1u << "\n";
+      if(sVerbose) {
+        std::cout << "read pages " << aStartPage << " - " << aStartPage + aPageCount - 1u << "\n";
+      }
       result = nowtech::memory::SpiResult::cOk;
     }
     else {
@@ -218,6 +290,15 @@ uint8_t* FlashInterface::sMemoryFlash;
 uint8_t* FlashInterface::sMemoryRam;
 uint8_t* FlashInterface::sPattern;
 bool     FlashInterface::sMapped;
+bool     FlashInterface::sVerbose;
+uint32_t FlashInterface::sEraseDelayUs;
+bool     FlashInterface::sNorOnly;
+uint32_t FlashInterface::sNorViolationCount;
+uint32_t FlashInterface::sFatalErrorCount;
+nowtech::memory::FlashException FlashInterface::sLastFatalError;
+bool     FlashInterface::sCanMap;
+uint32_t FlashInterface::sReadPageCount;
+uint32_t FlashInterface::sPowerLossCountdown;
 
 constexpr nowtech::memory::FlashCopies cCopies               = nowtech::memory::FlashCopies::c2;
 constexpr uint32_t                     cPagesNeeded          = 4096u;
@@ -228,6 +309,186 @@ constexpr uint32_t                     cValueBufferSize      =    8u;
 typedef nowtech::memory::FlashConfig<FlashInterface, cPagesNeeded, cCopies, cReadAheadSizeInPages, cMaxItemCount, cValueBufferSize>   DebugFlashConfig;
 typedef nowtech::memory::FlashPartitioner<FlashInterface, DebugFlashConfig, nowtech::memory::NullPlugin, nowtech::memory::NullPlugin> DebugFlashPartitioner;
 
+constexpr uint32_t cStressItemCount        =  400u;
+constexpr uint32_t cStressCommitCount      =   20u;
+constexpr uint32_t cStressQuietCommitCount =    5u;
+constexpr uint32_t cStressEraseDelayUs     = 2000u;
+constexpr uint32_t cStressWriterCount      =    2u;
+constexpr uint32_t cStressReaderCount      =    2u;
+
+typedef nowtech::memory::FlashConfig<FlashInterface, cPagesNeeded, cCopies, cReadAheadSizeInPages, cStressItemCount, cValueBufferSize, 0u, nowtech::memory::ConfigStorage::cInline, nowtech::memory::ConfigBoot::cFull, nowtech::memory::ConfigConcurrency::cSeqlock> StressFlashConfig;
+typedef nowtech::memory::FlashPartitioner<FlashInterface, StressFlashConfig, nowtech::memory::NullPlugin, nowtech::memory::NullPlugin> StressFlashPartitioner;
+
+constexpr uint32_t cJournalPagesNeeded       = 128u;
+constexpr uint32_t cJournalSizeInPages       =  16u;
+constexpr uint32_t cJournalCommitCount       =  40u;
+constexpr uint32_t cJournalChangesPerCommit  =   3u;  // a journal page each
+constexpr uint32_t cJournalRebootPeriod      =   7u;
+
+typedef nowtech::memory::FlashConfig<FlashInterface, cJournalPagesNeeded, cCopies, cReadAheadSizeInPages / 3u, cMaxItemCount, cValueBufferSize, cJournalSizeInPages> JournalFlashConfig;
+typedef nowtech::memory::FlashPartitioner<FlashInterface, JournalFlashConfig, nowtech::memory::NullPlugin, nowtech::memory::NullPlugin> JournalFlashPartitioner;
+
+constexpr uint32_t cAlternatingPagesNeeded   = 128u;
+constexpr uint32_t cAlternatingCopySizeInPages = cAlternatingPagesNeeded / 2u;
+constexpr uint32_t cAlternatingCommitCount   =  12u;
+
+typedef nowtech::memory::FlashConfig<FlashInterface, cAlternatingPagesNeeded, nowtech::memory::FlashCopies::c2Alternating, cReadAheadSizeInPages / 3u, cMaxItemCount, cValueBufferSize> AlternatingFlashConfig;
+typedef nowtech::memory::FlashPartitioner<FlashInterface, AlternatingFlashConfig, nowtech::memory::NullPlugin, nowtech::memory::NullPlugin> AlternatingFlashPartitioner;
+
+constexpr uint32_t cSchemaPagesNeeded        =  64u;
+
+typedef nowtech::memory::FlashConfig<FlashInterface, cSchemaPagesNeeded, cCopies, cReadAheadSizeInPages / 3u, cMaxItemCount, cValueBufferSize> SchemaFlashConfig;
+typedef nowtech::memory::FlashPartitioner<FlashInterface, SchemaFlashConfig, nowtech::memory::NullPlugin, nowtech::memory::NullPlugin> SchemaFlashPartitioner;
+typedef nowtech::memory::FlashConfig<FlashInterface, cSchemaPagesNeeded, cCopies, cReadAheadSizeInPages / 3u, cMaxItemCount, cValueBufferSize, 0u, nowtech::memory::ConfigStorage::cArena> ArenaSchemaFlashConfig;
+typedef nowtech::memory::FlashPartitioner<FlashInterface, ArenaSchemaFlashConfig, nowtech::memory::NullPlugin, nowtech::memory::NullPlugin> ArenaSchemaFlashPartitioner;
+
+struct MotorGain final {
+  typedef float Type;
+  static constexpr Type cDefault = 1.5f;
+};
+
+struct SerialNumber final {
+  typedef uint32_t Type;
+  static constexpr Type cDefault = 0u;
+};
+
+struct Calibration final {   // does not fit the rest of the first page
+  typedef std::array<int16_t, 120u> Type;
+  static constexpr Type cDefault = {};
+};
+
+struct DeviceName final {    // appended in a later version
+  typedef std::array<char, 16u> Type;
+  static constexpr Type cDefault = { 'm', 'o', 't', 'o', 'r' };
+};
+
+struct ShortSerialNumber final {
+  typedef uint16_t Type;
+  static constexpr Type cDefault = 0u;
+};
+
+constexpr uint32_t cMappedPagesNeeded        = 128u;
+constexpr uint32_t cMappedMaxItemCount       = 100u;
+constexpr uint32_t cMappedWriteBufferSize    = 300u;  // overflows after a few staged items
+constexpr uint32_t cMappedOperationCount     = 3000u;
+constexpr uint32_t cMappedMaxItemSize        =  60u;
+
+typedef nowtech::memory::FlashConfigMapped<FlashInterface, cMappedPagesNeeded, cMappedMaxItemCount, cMappedWriteBufferSize> MappedFlashConfig;
+typedef nowtech::memory::FlashPartitioner<FlashInterface, MappedFlashConfig, nowtech::memory::NullPlugin, nowtech::memory::NullPlugin> MappedFlashPartitioner;
+
+constexpr uint32_t cPackingItemCount = 300u;
+
+constexpr uint32_t cArenaPagesNeeded         =  64u;
+constexpr uint32_t cArenaValueBufferSize     =   2u;  // a small initial arena, so it is relocated several times
+constexpr uint16_t cArenaItemSize            =  40u;
+constexpr uint32_t cArenaFirstItemCount      =  60u;
+constexpr uint16_t cInvalidConfigId          = 0xffffu; // returned by addConfig on failure
+
+typedef nowtech::memory::FlashConfig<FlashInterface, cArenaPagesNeeded, cCopies, cReadAheadSizeInPages / 3u, cPackingItemCount, cArenaValueBufferSize, 0u, nowtech::memory::ConfigStorage::cArena> ArenaFlashConfig;
+typedef nowtech::memory::FlashPartitioner<FlashInterface, ArenaFlashConfig, nowtech::memory::NullPlugin, nowtech::memory::NullPlugin> ArenaFlashPartitioner;
+
+typedef nowtech::memory::FlashConfig<FlashInterface, cPagesNeeded, cCopies, cReadAheadSizeInPages, cPackingItemCount, cValueBufferSize> WholeFlashConfig;
+typedef nowtech::memory::FlashPartitioner<FlashInterface, WholeFlashConfig, nowtech::memory::NullPlugin, nowtech::memory::NullPlugin> WholeFlashPartitioner;
+typedef nowtech::memory::FlashConfig<FlashInterface, cPagesNeeded, cCopies, cReadAheadSizeInPages, cPackingItemCount, cValueBufferSize, 0u, nowtech::memory::ConfigStorage::cInline, nowtech::memory::ConfigBoot::cFull, nowtech::memory::ConfigConcurrency::cExclusive, nowtech::memory::ConfigPacking::cSpanning> SpanningFlashConfig;
+typedef nowtech::memory::FlashPartitioner<FlashInterface, SpanningFlashConfig, nowtech::memory::NullPlugin, nowtech::memory::NullPlugin> SpanningFlashPartitioner;
+
+constexpr uint32_t cPlacementHotStep     = 25u;
+constexpr uint32_t cPlacementCommitCount = 10u;
+
+typedef nowtech::memory::FlashConfig<FlashInterface, cPagesNeeded, cCopies, cReadAheadSizeInPages, cPackingItemCount, cValueBufferSize, 0u, nowtech::memory::ConfigStorage::cInline, nowtech::memory::ConfigBoot::cFull, nowtech::memory::ConfigConcurrency::cExclusive, nowtech::memory::ConfigPacking::cSpanning, nowtech::memory::ConfigPlacement::cHotTail> HotFlashConfig;
+typedef nowtech::memory::FlashPartitioner<FlashInterface, HotFlashConfig, nowtech::memory::NullPlugin, nowtech::memory::NullPlugin> HotFlashPartitioner;
+
+constexpr uint32_t cMultiPagesNeeded          = 64u;
+constexpr uint32_t cMultiReadAheadSizeInPages = 16u;  // a single slot, so commit serializes and writes one sector after the other
+constexpr uint16_t cMultiItemSize             = 20u;
+constexpr uint16_t cMultiChangedIds[]         = { 250u, 3u }; // in the last sector first
+
+typedef nowtech::memory::FlashConfig<FlashInterface, cMultiPagesNeeded, nowtech::memory::FlashCopies::c1, cMultiReadAheadSizeInPages, cPackingItemCount, cValueBufferSize> MultiFlashConfig1;
+typedef nowtech::memory::FlashPartitioner<FlashInterface, MultiFlashConfig1, nowtech::memory::NullPlugin, nowtech::memory::NullPlugin> MultiFlashPartitioner1;
+typedef nowtech::memory::FlashConfig<FlashInterface, cMultiPagesNeeded, nowtech::memory::FlashCopies::c2, cMultiReadAheadSizeInPages, cPackingItemCount, cValueBufferSize> MultiFlashConfig2;
+typedef nowtech::memory::FlashPartitioner<FlashInterface, MultiFlashConfig2, nowtech::memory::NullPlugin, nowtech::memory::NullPlugin> MultiFlashPartitioner2;
+
+constexpr uint32_t cLazyCorruptPage          =  20u;
+constexpr uint32_t cLazyCorruptOffset        =  10u;  // in the value of the first item of the page
+
+typedef nowtech::memory::FlashConfig<FlashInterface, cMultiPagesNeeded, nowtech::memory::FlashCopies::c2, cMultiReadAheadSizeInPages, cPackingItemCount, cValueBufferSize, 0u, nowtech::memory::ConfigStorage::cInline, nowtech::memory::ConfigBoot::cLazy> LazyFlashConfig;
+typedef nowtech::memory::FlashPartitioner<FlashInterface, LazyFlashConfig, nowtech::memory::NullPlugin, nowtech::memory::NullPlugin> LazyFlashPartitioner;
+
+constexpr uint32_t cBulkPagesNeeded          = 16384u;
+constexpr uint32_t cBulkReadAheadSizeInPages =   16u;
+constexpr uint32_t cBulkMaxItemCount         =    8u;
+constexpr uint32_t cBulkItemSizes[]          = { 1000000u, 247u, 0u, 70000u };
+constexpr uint32_t cBulkMaxChunkSize         = 3000u;
+
+typedef nowtech::memory::FlashLongtermBulk<FlashInterface, cBulkPagesNeeded, cCopies, cBulkReadAheadSizeInPages, cBulkMaxItemCount> BulkFlash;
+typedef nowtech::memory::FlashPartitioner<FlashInterface, DebugFlashConfig, BulkFlash, nowtech::memory::NullPlugin> BulkFlashPartitioner;
+typedef nowtech::memory::FlashPartitioner<FlashInterface, BulkFlash, nowtech::memory::NullPlugin, nowtech::memory::NullPlugin> IndexFlashPartitioner;
+
+constexpr uint32_t cIndexCopySizeInPages     = cBulkPagesNeeded / 2u;
+constexpr uint8_t  cIndexReplacedId          =    1u;
+constexpr uint32_t cIndexReplacedSize        = 5000u;
+constexpr uint8_t  cIndexCorruptId           =    3u;
+
+constexpr uint32_t cCompressionWindowSize    = 1024u;
+constexpr uint32_t cCompressionDataSize      = 200000u;
+
+typedef nowtech::memory::FlashLongtermBulk<FlashInterface, cBulkPagesNeeded, cCopies, cBulkReadAheadSizeInPages, cBulkMaxItemCount, cCompressionWindowSize> CompressedBulkFlash;
+typedef nowtech::memory::FlashPartitioner<FlashInterface, DebugFlashConfig, CompressedBulkFlash, nowtech::memory::NullPlugin> CompressedBulkFlashPartitioner;
+
+constexpr uint32_t cLeoPagesNeeded           = 512u;
+constexpr uint32_t cLeoReadAheadSizeInPages  =   2u;
+
+constexpr uint32_t cLeoMaxCount              = cLeoPagesNeeded / 2u;
+
+typedef nowtech::memory::FlashLoadBalancing<FlashInterface, cLeoPagesNeeded, 0u, cLeoMaxCount, cLeoReadAheadSizeInPages> LeoFlash;
+typedef nowtech::memory::FlashPartitioner<FlashInterface, LeoFlash, nowtech::memory::NullPlugin, nowtech::memory::NullPlugin> LeoFlashPartitioner;
+
+constexpr uint32_t cLogReadAheadSizeInPages  =    4u;
+constexpr uint32_t cLogEntrySize             =   16u;
+constexpr uint32_t cLogQueueSizeInEntries    =  256u;
+constexpr uint32_t cLogMaxDelay              =   10u;
+constexpr uint32_t cLogProducerCount         =    4u;
+constexpr uint32_t cLogEntriesPerProducer    = 1000u;
+
+typedef nowtech::memory::FlashLoadBalancing<FlashInterface, cLeoPagesNeeded, 0u, cLeoMaxCount, cLogReadAheadSizeInPages, cLogEntrySize, cLogQueueSizeInEntries, cLogMaxDelay> LogFlash;
+typedef nowtech::memory::FlashPartitioner<FlashInterface, LogFlash, nowtech::memory::NullPlugin, nowtech::memory::NullPlugin> LogFlashPartitioner;
+
+constexpr uint32_t cErrorCounterCount        =  200u;
+constexpr uint32_t cErrorHotCount            =    4u;
+constexpr uint32_t cErrorFlushCount          =  300u;
+constexpr uint32_t cErrorRebootPeriod        =  100u;
+constexpr uint32_t cErrorIncrementsPerFlush  =  500u;
+
+typedef nowtech::memory::FlashLoadBalancing<FlashInterface, cLeoPagesNeeded, 0u, cLeoMaxCount, cLogReadAheadSizeInPages, 0u, cLogQueueSizeInEntries, 0u, cErrorCounterCount> ErrorFlash;
+typedef nowtech::memory::FlashPartitioner<FlashInterface, ErrorFlash, nowtech::memory::NullPlugin, nowtech::memory::NullPlugin> ErrorFlashPartitioner;
+
+constexpr uint32_t cLogErrorFlushCount       = 2000u;
+constexpr uint32_t cLogErrorRebootPeriod     =  250u;
+constexpr uint32_t cLogErrorCountPeriod      =  400u;
+
+typedef nowtech::memory::FlashLoadBalancing<FlashInterface, cLeoPagesNeeded, 0u, cLeoMaxCount, cLogReadAheadSizeInPages, cLogEntrySize, cLogQueueSizeInEntries, cLogMaxDelay, cErrorCounterCount> LogErrorFlash;
+typedef nowtech::memory::FlashPartitioner<FlashInterface, LogErrorFlash, nowtech::memory::NullPlugin, nowtech::memory::NullPlugin> LogErrorFlashPartitioner;
+
+constexpr uint32_t cOnTimeTickBytes          =  247u;
+constexpr uint32_t cOnTimeTickCount          = 10000u;
+constexpr uint32_t cOnTimeRebootPeriod       = 2500u;
+constexpr uint32_t cOnTimeJump               = 1000u;
+
+typedef nowtech::memory::FlashLoadBalancing<FlashInterface, cLeoPagesNeeded, 0u, cLeoMaxCount, cLeoReadAheadSizeInPages, 0u, cLogQueueSizeInEntries, 0u, 0u, cOnTimeTickBytes> TickFlash;
+typedef nowtech::memory::FlashPartitioner<FlashInterface, TickFlash, nowtech::memory::NullPlugin, nowtech::memory::NullPlugin> TickFlashPartitioner;
+
+uint32_t sFailureCount = 0u;
+
+/// Reports and counts a failed check, so that main can return non-zero.
+void check(bool const aCondition, char const * const aWhat) {
+  if(!aCondition) {
+    std::cout << "FAILED: " << aWhat << '\n';
+    ++sFailureCount;
+  }
+  else { // nothing to do
+  }
+}
+
 void testConfig1() {
   uint16_t lastId;
   for(uint16_t i = 1u; i < 80u; i += 5u) {
@@ -247,10 +508,1394 @@ void testConfig1() {
   }
 }
 
+// Each value is a counter and its complement, so a torn read is detected.
+struct StressValue final {
+  uint32_t mCounter;
+  uint32_t mComplement;
+};
+
+struct ReaderStatistics final {
+  uint64_t mReadCount          = 0u;
+  uint64_t mReadCountInCommit  = 0u;
+  uint64_t mInconsistentCount  = 0u;
+  uint64_t mTotalNs            = 0u;
+  uint64_t mMaxNs              = 0u;
+  uint64_t mTotalNsInCommit    = 0u;
+  uint64_t mMaxNsInCommit      = 0u;
+};
+
+/// Readers run during commits, first without writers, when no read may be repeated, as commit never changes the
+/// pages. Then with writers, a read may be repeated only when a setConfig locked its page meanwhile, so at most once
+/// for each setConfig in each reader thread and in commit. No read may be torn, and the values must survive a reboot.
+/// The latencies depend on the scheduling, so they are only printed.
+void testConcurrency() {
+  FlashInterface::sVerbose = false;
+  FlashInterface::eraseAll();
+  StressFlashPartitioner::init();
+  StressFlashConfig::clear();
+  StressValue value { 0u, ~0u };
+  for(uint32_t i = 0u; i < cStressItemCount; ++i) {
+    StressFlashConfig::addConfig(reinterpret_cast<uint8_t const*>(&value), sizeof(value));
+  }
+  StressFlashConfig::commit();
+  FlashInterface::sEraseDelayUs = cStressEraseDelayUs;
+
+  std::atomic<bool> stop = false;
+  std::atomic<bool> committing = false;
+  std::vector<std::thread> threads;
+  std::vector<ReaderStatistics> statistics(cStressReaderCount);
+  auto const startReaders = [&threads, &stop, &committing, &statistics](){
+    for(uint32_t r = 0u; r < cStressReaderCount; ++r) {
+      threads.emplace_back([r, &stop, &committing, &statistics](){
+        std::mt19937 random(cStressWriterCount + r);
+        ReaderStatistics &stat = statistics[r];
+        while(!stop.load(std::memory_order_relaxed)) {
+          StressValue value;
+          bool const inCommit = committing.load(std::memory_order_relaxed);
+          auto const start = std::chrono::steady_clock::now();
+          StressFlashConfig::readConfig(static_cast<uint16_t>(random() % cStressItemCount), reinterpret_cast<uint8_t*>(&value));
+          uint64_t const ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+          stat.mInconsistentCount += (value.mCounter != ~value.mComplement ? 1u : 0u);
+          ++stat.mReadCount;
+          stat.mTotalNs += ns;
+          stat.mMaxNs = std::max(stat.mMaxNs, ns);
+          if(inCommit) {
+            ++stat.mReadCountInCommit;
+            stat.mTotalNsInCommit += ns;
+            stat.mMaxNsInCommit = std::max(stat.mMaxNsInCommit, ns);
+          }
+          else { // nothing to do
+          }
+        }
+      });
+    }
+  };
+  auto const stopThreads = [&threads, &stop](){
+    stop = true;
+    for(auto &thread : threads) {
+      thread.join();
+    }
+    threads.clear();
+    stop = false;
+  };
+
+  StressFlashConfig::clearStatistics();
+  startReaders();
+  for(uint32_t i = 0u; i < cStressQuietCommitCount; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    StressFlashConfig::makeAllDirty();
+    StressFlashConfig::commit();
+  }
+  stopThreads();
+  uint32_t const quietRetriedReadCount = StressFlashConfig::getRetriedReadCount();
+  uint64_t quietInconsistentCount = 0u;
+  for(auto &stat : statistics) {
+    quietInconsistentCount += stat.mInconsistentCount;
+    stat = ReaderStatistics();
+  }
+
+  StressFlashConfig::clearStatistics();
+  std::atomic<uint64_t> setCount = 0u;
+  for(uint32_t w = 0u; w < cStressWriterCount; ++w) {
+    threads.emplace_back([w, &stop, &setCount](){
+      std::mt19937 random(w);
+      uint32_t counter = 0u;
+      while(!stop.load(std::memory_order_relaxed)) {
+        ++counter;
+        StressValue const value { counter, ~counter };
+        StressFlashConfig::setConfig(static_cast<uint16_t>(random() % cStressItemCount), reinterpret_cast<uint8_t const*>(&value));
+      }
+      setCount += counter;
+    });
+  }
+  startReaders();
+  uint64_t commitTotalUs = 0u;
+  for(uint32_t i = 0u; i < cStressCommitCount; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    committing = true;
+    auto const start = std::chrono::steady_clock::now();
+    StressFlashConfig::commit();
+    commitTotalUs += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    committing = false;
+  }
+  stopThreads();
+  FlashInterface::sEraseDelayUs = 0u;
+  uint32_t const retriedReadCount = StressFlashConfig::getRetriedReadCount();
+
+  ReaderStatistics total;
+  for(auto const &stat : statistics) {
+    total.mReadCount += stat.mReadCount;
+    total.mReadCountInCommit += stat.mReadCountInCommit;
+    total.mInconsistentCount += stat.mInconsistentCount;
+    total.mTotalNs += stat.mTotalNs;
+    total.mMaxNs = std::max(total.mMaxNs, stat.mMaxNs);
+    total.mTotalNsInCommit += stat.mTotalNsInCommit;
+    total.mMaxNsInCommit = std::max(total.mMaxNsInCommit, stat.mMaxNsInCommit);
+  }
+  std::cout << "seqlock stress without writers: " << cStressQuietCommitCount << " commits, retried reads: " << quietRetriedReadCount
+            << ", inconsistent reads: " << quietInconsistentCount << '\n';
+  std::cout << "seqlock stress: " << cStressCommitCount << " commits, mean " << commitTotalUs / cStressCommitCount << " us, " << setCount << " setConfig calls\n";
+  std::cout << "  reads: " << total.mReadCount << ", mean " << total.mTotalNs / std::max<uint64_t>(1u, total.mReadCount) << " ns, max " << total.mMaxNs << " ns\n";
+  std::cout << "  reads during commit: " << total.mReadCountInCommit << ", mean " << total.mTotalNsInCommit / std::max<uint64_t>(1u, total.mReadCountInCommit) << " ns, max " << total.mMaxNsInCommit << " ns\n";
+  std::cout << "  retried reads: " << retriedReadCount << ", inconsistent reads: " << total.mInconsistentCount << '\n';
+
+  StressFlashConfig::commit();
+  std::vector<StressValue> expected(cStressItemCount);
+  for(uint32_t i = 0u; i < cStressItemCount; ++i) {
+    StressFlashConfig::readConfig(static_cast<uint16_t>(i), reinterpret_cast<uint8_t*>(&expected[i]));
+  }
+  StressFlashPartitioner::done();
+  StressFlashPartitioner::init();
+  uint32_t mismatchCount = 0u;
+  for(uint32_t i = 0u; i < cStressItemCount; ++i) {
+    StressValue value;
+    StressFlashConfig::readConfig(static_cast<uint16_t>(i), reinterpret_cast<uint8_t*>(&value));
+    mismatchCount += (value.mCounter != expected[i].mCounter || value.mComplement != expected[i].mComplement ? 1u : 0u);
+  }
+  std::cout << "  mismatches after reboot: " << mismatchCount << '\n';
+  check(quietRetriedReadCount == 0u && quietInconsistentCount == 0u, "seqlock commit never makes readers retry");
+  check(retriedReadCount <= (cStressReaderCount + 1u) * setCount, "seqlock retries at most once per setConfig in each reader");
+  check(total.mInconsistentCount == 0u, "seqlock reads are never torn");
+  check(mismatchCount == 0u, "seqlock values survive reboot");
+  StressFlashPartitioner::done();
+  FlashInterface::sVerbose = true;
+}
+
+std::vector<uint8_t> readFlash(uint32_t const aStartPage, uint32_t const aPageCount) {
+  std::vector<uint8_t> result(aPageCount * FlashInterface::getPageSizeInBytes());
+  FlashInterface::readPages(aStartPage, aPageCount, result.data());
+  return result;
+}
+
+/// Fills two sectors with items, then changes one item in each sector with the last sector first, so that commit
+/// erases and writes several sectors through the same read ahead slot. Each item must survive the reboot.
+template<typename tConfig, typename tPartitioner>
+void measureMultiSectorCommit(char const * const aName) {
+  FlashInterface::eraseAll();
+  tPartitioner::init();
+  tConfig::clear();
+  uint8_t value[cMultiItemSize];
+  for(uint32_t i = 0u; i < cPackingItemCount; ++i) {
+    std::fill_n(value, cMultiItemSize, static_cast<uint8_t>(i));
+    tConfig::addConfig(value, cMultiItemSize);
+  }
+  tConfig::commit();
+  uint32_t const pageCount = tConfig::getUsedPageCount();
+  std::fill_n(value, cMultiItemSize, 0xa5u);
+  for(auto const id : cMultiChangedIds) {
+    tConfig::setConfig(id, value);
+  }
+  tConfig::commit();
+  tPartitioner::done();
+  tPartitioner::init();
+  uint32_t mismatchCount = 0u;
+  for(uint32_t i = 0u; i < cPackingItemCount; ++i) {
+    bool const changed = std::find(std::begin(cMultiChangedIds), std::end(cMultiChangedIds), i) != std::end(cMultiChangedIds);
+    std::fill_n(value, cMultiItemSize, changed ? 0xa5u : static_cast<uint8_t>(i));
+    uint8_t const * const data = tConfig::getConfig(static_cast<uint16_t>(i));
+    mismatchCount += (data != nullptr && std::equal(value, value + cMultiItemSize, data) ? 0u : 1u);
+  }
+  std::cout << aName << ": " << cPackingItemCount << " items in " << pageCount << " pages, mismatches after reboot: " << mismatchCount << '\n';
+  check(pageCount > FlashInterface::getSectorSizeInPages(), "multi-sector commit spans several sectors");
+  check(mismatchCount == 0u, "multi-sector commit survives reboot");
+  tPartitioner::done();
+}
+
+void testMultiSectorCommit() {
+  FlashInterface::sVerbose = false;
+  measureMultiSectorCommit<MultiFlashConfig1, MultiFlashPartitioner1>("multi-sector commit, 1 copy");
+  measureMultiSectorCommit<MultiFlashConfig2, MultiFlashPartitioner2>("multi-sector commit, 2 copies");
+  FlashInterface::sVerbose = true;
+}
+
+/// Cuts the power at each erase and page write of a two-copy multi-sector commit in turn. As the copies are written one
+/// after the other, the one not being written holds the whole old or new image. After the reboot the changed items
+/// must be either all old or all new, or if the torn copy still looks valid, boot must report cConfigCopiesMismatch.
+/// A mixed image must never be accepted.
+void testTornMultiSectorCommit() {
+  FlashInterface::sVerbose = false;
+  FlashInterface::eraseAll();
+  MultiFlashPartitioner2::init();
+  MultiFlashConfig2::clear();
+  uint8_t value[cMultiItemSize];
+  for(uint32_t i = 0u; i < cPackingItemCount; ++i) {
+    std::fill_n(value, cMultiItemSize, static_cast<uint8_t>(i));
+    MultiFlashConfig2::addConfig(value, cMultiItemSize);
+  }
+  MultiFlashConfig2::commit();
+  MultiFlashPartitioner2::done();
+  std::vector<uint8_t> const committed = readFlash(0u, cMultiPagesNeeded);
+  uint32_t lossCount = 0u;
+  uint32_t mixedCount = 0u;
+  uint32_t newCount = 0u;
+  uint32_t mismatchReportCount = 0u;
+  for(bool powerLost = true; powerLost; ++lossCount) {
+    for(uint32_t page = 0u; page < cMultiPagesNeeded; ++page) {
+      FlashInterface::writePage(page, committed.data() + page * FlashInterface::getPageSizeInBytes());
+    }
+    MultiFlashPartitioner2::init();
+    std::fill_n(value, cMultiItemSize, 0xa5u);
+    for(auto const id : cMultiChangedIds) {
+      MultiFlashConfig2::setConfig(id, value);
+    }
+    FlashInterface::sPowerLossCountdown = lossCount;
+    MultiFlashConfig2::commit();
+    powerLost = (FlashInterface::sPowerLossCountdown == 0u);
+    FlashInterface::sPowerLossCountdown = FlashInterface::cNoPowerLoss;
+    MultiFlashPartitioner2::done();
+    FlashInterface::sFatalErrorCount = 0u;
+    MultiFlashPartitioner2::init();
+    bool const mismatchReported = (FlashInterface::sFatalErrorCount > 0u && FlashInterface::sLastFatalError == nowtech::memory::FlashException::cConfigCopiesMismatch);
+    uint32_t changedCount = 0u;
+    uint32_t keptCount = 0u;
+    for(uint32_t i = 0u; !mismatchReported && i < cPackingItemCount; ++i) {
+      uint8_t const * const data = MultiFlashConfig2::getConfig(static_cast<uint16_t>(i));
+      bool const changed = std::find(std::begin(cMultiChangedIds), std::end(cMultiChangedIds), i) != std::end(cMultiChangedIds);
+      bool const isOld = (data != nullptr && std::all_of(data, data + cMultiItemSize, [i](uint8_t const aValue){ return aValue == static_cast<uint8_t>(i); }));
+      bool const isNew = (data != nullptr && std::all_of(data, data + cMultiItemSize, [](uint8_t const aValue){ return aValue == 0xa5u; }));
+      changedCount += (changed && isNew ? 1u : 0u);
+      keptCount += ((changed && isOld) || (!changed && isOld) ? 1u : 0u);
+    }
+    bool const allOld = (changedCount == 0u && keptCount == cPackingItemCount);
+    bool const allNew = (changedCount == std::size(cMultiChangedIds) && keptCount == cPackingItemCount - std::size(cMultiChangedIds));
+    mixedCount += (mismatchReported || allOld || allNew ? 0u : 1u);
+    newCount += (allNew ? 1u : 0u);
+    mismatchReportCount += (mismatchReported ? 1u : 0u);
+    MultiFlashPartitioner2::done();
+  }
+  std::cout << "torn multi-sector commit: " << lossCount << " power loss points, new image after " << newCount << ", mismatch reported after "
+            << mismatchReportCount << ", mixed images accepted: " << mixedCount << '\n';
+  check(mixedCount == 0u, "torn multi-sector commit never accepts a mixed image");
+  check(newCount > 0u && mismatchReportCount > 0u, "torn multi-sector commit reports the copies mismatch");
+  FlashInterface::sVerbose = true;
+}
+
+typedef std::array<uint8_t, cValueBufferSize> SmallValue;
+
+template<typename tConfig>
+uint32_t countValueMismatches(std::vector<SmallValue> const &aValues) {
+  uint32_t result = 0u;
+  for(uint32_t i = 0u; i < aValues.size(); ++i) {
+    uint8_t const * const data = tConfig::getConfig(static_cast<uint16_t>(i));
+    result += (data != nullptr && std::equal(aValues[i].begin(), aValues[i].end(), data) ? 0u : 1u);
+  }
+  return result;
+}
+
+/// Commits a few changes at a time, so that most commits append to the journal and every few the full journal is
+/// folded into the base. Reboots in between replay the journal. Then checks compactJournal, and a power loss between
+/// writing a journal page to the first and the second copy.
+void testJournal() {
+  FlashInterface::sVerbose = false;
+  std::mt19937 random(1u);
+  std::vector<SmallValue> values(cMaxItemCount);
+  FlashInterface::eraseAll();
+  JournalFlashPartitioner::init();
+  JournalFlashConfig::clear();
+  for(uint32_t i = 0u; i < cMaxItemCount; ++i) {
+    values[i].fill(static_cast<uint8_t>(i));
+    JournalFlashConfig::addConfig(values[i].data(), cValueBufferSize);
+  }
+  JournalFlashConfig::commit();
+  check(JournalFlashConfig::getJournalFreePages() == cJournalSizeInPages, "journal empty after the first commit");
+  uint32_t appendCount = 0u;
+  uint32_t appendEraseCount = 0u;
+  uint32_t foldCount = 0u;
+  uint32_t mismatchCount = 0u;
+  FlashInterface::sFatalErrorCount = 0u;
+  for(uint32_t commit = 1u; commit <= cJournalCommitCount; ++commit) {
+    for(uint32_t i = 0u; i < cJournalChangesPerCommit; ++i) {
+      SmallValue &value = values[random() % cMaxItemCount];
+      std::generate(value.begin(), value.end(), [&random](){ return static_cast<uint8_t>(random()); });
+      JournalFlashConfig::setConfig(static_cast<uint16_t>(&value - values.data()), value.data());
+    }
+    uint32_t const freeBefore = JournalFlashConfig::getJournalFreePages();
+    JournalFlashConfig::clearStatistics();
+    JournalFlashConfig::commit();
+    uint32_t const freeAfter = JournalFlashConfig::getJournalFreePages();
+    if(freeAfter < freeBefore) {
+      ++appendCount;
+      appendEraseCount += JournalFlashConfig::getCommitStatistics().mSectorEraseCount;
+    }
+    else {
+      ++foldCount;
+    }
+    if(commit % cJournalRebootPeriod == 0u) {
+      JournalFlashPartitioner::done();
+      JournalFlashPartitioner::init();
+      mismatchCount += countValueMismatches<JournalFlashConfig>(values);
+      mismatchCount += (JournalFlashConfig::getJournalFreePages() == freeAfter ? 0u : 1u);
+    }
+    else { // nothing to do
+    }
+  }
+  std::cout << "journal: " << cJournalCommitCount << " commits, " << appendCount << " appended with " << appendEraseCount << " erases, "
+            << foldCount << " folded, mismatches after reboots: " << mismatchCount << '\n';
+  check(appendCount > 0u && appendEraseCount == 0u, "journal appends erase nothing");
+  check(foldCount > 0u, "journal overflow folds");
+  check(mismatchCount == 0u && FlashInterface::sFatalErrorCount == 0u, "journal replays on reboot");
+
+  JournalFlashConfig::compactJournal();
+  bool const compacted = (JournalFlashConfig::getJournalFreePages() == cJournalSizeInPages);
+  JournalFlashPartitioner::done();
+  JournalFlashPartitioner::init();
+  check(compacted && JournalFlashConfig::getJournalFreePages() == cJournalSizeInPages && countValueMismatches<JournalFlashConfig>(values) == 0u, "compactJournal empties the journal");
+
+  // The power is lost after the journal page is written to the first copy, so the second one lacks it. The journal
+  // of the second copy ends the partition.
+  uint32_t const tornPage = cJournalPagesNeeded - JournalFlashConfig::getJournalFreePages();
+  values[0u].fill(0xa5u);
+  JournalFlashConfig::setConfig(0u, values[0u].data());
+  JournalFlashConfig::commit();
+  JournalFlashPartitioner::done();
+  std::vector<uint8_t> const erasedPage(FlashInterface::getPageSizeInBytes(), 0xffu);
+  FlashInterface::writePage(tornPage, erasedPage.data());
+  FlashInterface::sFatalErrorCount = 0u;
+  JournalFlashPartitioner::init();
+  bool const detected = (FlashInterface::sFatalErrorCount == 1u && FlashInterface::sLastFatalError == nowtech::memory::FlashException::cConfigBadCopy2);
+  uint32_t const tornMismatchCount = countValueMismatches<JournalFlashConfig>(values);
+  JournalFlashConfig::commit(); // repairs the second copy
+  JournalFlashPartitioner::done();
+  FlashInterface::sFatalErrorCount = 0u;
+  JournalFlashPartitioner::init();
+  uint32_t const repairedMismatchCount = countValueMismatches<JournalFlashConfig>(values);
+  std::cout << "journal torn write: detected as bad copy: " << detected << ", mismatches: " << tornMismatchCount << ", after repair: "
+            << repairedMismatchCount << ", errors: " << FlashInterface::sFatalErrorCount << '\n';
+  check(detected && tornMismatchCount == 0u, "journal torn write detected as a bad copy");
+  check(repairedMismatchCount == 0u && FlashInterface::sFatalErrorCount == 0u, "journal torn write repaired by the next commit");
+  JournalFlashPartitioner::done();
+  FlashInterface::sVerbose = true;
+}
+
+/// Returns the page after the last programmed one in the seal sector at the end of the copy.
+uint32_t findSealEnd(uint32_t const aCopyIndex) {
+  uint32_t const sealStartPage = (aCopyIndex + 1u) * cAlternatingCopySizeInPages - FlashInterface::getSectorSizeInPages();
+  std::vector<uint8_t> const seals = readFlash(sealStartPage, FlashInterface::getSectorSizeInPages());
+  uint32_t result = sealStartPage;
+  for(uint32_t i = 0u; i < FlashInterface::getSectorSizeInPages(); ++i) {
+    result = (seals[i * FlashInterface::getPageSizeInBytes()] != 0xffu ? sealStartPage + i + 1u : result);
+  }
+  return result;
+}
+
+/// Each commit must write only the older copy, so the copies alternate, and a reboot must find the newer one.
+/// Then a commit torn before its closing seal must leave the copy it wrote invalid, and the boot falls back to the
+/// other one having the values before that commit.
+void testAlternating() {
+  FlashInterface::sVerbose = false;
+  std::mt19937 random(1u);
+  std::vector<SmallValue> values(cMaxItemCount);
+  FlashInterface::eraseAll();
+  AlternatingFlashPartitioner::init();
+  AlternatingFlashConfig::clear();
+  for(uint32_t i = 0u; i < cMaxItemCount; ++i) {
+    values[i].fill(static_cast<uint8_t>(i));
+    AlternatingFlashConfig::addConfig(values[i].data(), cValueBufferSize);
+  }
+  AlternatingFlashConfig::commit();
+  uint32_t lastCopy = (readFlash(0u, cAlternatingCopySizeInPages) != std::vector<uint8_t>(cAlternatingCopySizeInPages * FlashInterface::getPageSizeInBytes(), 0xffu) ? 0u : 1u);
+  uint32_t alternationErrorCount = 0u;
+  uint32_t mismatchCount = 0u;
+  FlashInterface::sFatalErrorCount = 0u;
+  for(uint32_t commit = 0u; commit < cAlternatingCommitCount; ++commit) {
+    SmallValue &value = values[random() % cMaxItemCount];
+    std::generate(value.begin(), value.end(), [&random](){ return static_cast<uint8_t>(random()); });
+    AlternatingFlashConfig::setConfig(static_cast<uint16_t>(&value - values.data()), value.data());
+    std::vector<uint8_t> const before[2] = { readFlash(0u, cAlternatingCopySizeInPages), readFlash(cAlternatingCopySizeInPages, cAlternatingCopySizeInPages) };
+    AlternatingFlashConfig::commit();
+    bool const changed[2] = { readFlash(0u, cAlternatingCopySizeInPages) != before[0], readFlash(cAlternatingCopySizeInPages, cAlternatingCopySizeInPages) != before[1] };
+    alternationErrorCount += (changed[1u - lastCopy] && !changed[lastCopy] ? 0u : 1u);
+    lastCopy = 1u - lastCopy;
+    AlternatingFlashPartitioner::done();
+    AlternatingFlashPartitioner::init();
+    mismatchCount += countValueMismatches<AlternatingFlashConfig>(values);
+  }
+  std::cout << "alternating: " << cAlternatingCommitCount << " commits, alternation errors: " << alternationErrorCount
+            << ", mismatches after reboots: " << mismatchCount << ", errors: " << FlashInterface::sFatalErrorCount << '\n';
+  check(alternationErrorCount == 0u, "alternating commits write the older copy");
+  check(mismatchCount == 0u && FlashInterface::sFatalErrorCount == 0u, "alternating boot chooses the newer copy");
+
+  // The power is lost before the seal closing the commit is written.
+  std::vector<SmallValue> const committed = values;
+  values[0u].fill(0xa5u);
+  AlternatingFlashConfig::setConfig(0u, values[0u].data());
+  AlternatingFlashConfig::commit();
+  AlternatingFlashPartitioner::done();
+  std::vector<uint8_t> const erasedPage(FlashInterface::getPageSizeInBytes(), 0xffu);
+  FlashInterface::writePage(findSealEnd(1u - lastCopy) - 1u, erasedPage.data());
+  FlashInterface::sFatalErrorCount = 0u;
+  AlternatingFlashPartitioner::init();
+  bool const detected = (FlashInterface::sFatalErrorCount == 1u
+                      && FlashInterface::sLastFatalError == (lastCopy == 0u ? nowtech::memory::FlashException::cConfigBadCopy2 : nowtech::memory::FlashException::cConfigBadCopy1));
+  uint32_t const tornMismatchCount = countValueMismatches<AlternatingFlashConfig>(committed);
+  AlternatingFlashConfig::setConfig(0u, values[0u].data());
+  AlternatingFlashConfig::commit();
+  AlternatingFlashPartitioner::done();
+  FlashInterface::sFatalErrorCount = 0u;
+  AlternatingFlashPartitioner::init();
+  uint32_t const repairedMismatchCount = countValueMismatches<AlternatingFlashConfig>(values);
+  std::cout << "alternating torn commit: detected: " << detected << ", mismatches with the older copy: " << tornMismatchCount
+            << ", after the next commit: " << repairedMismatchCount << ", errors: " << FlashInterface::sFatalErrorCount << '\n';
+  check(detected && tornMismatchCount == 0u, "alternating boot falls back to the older copy without the closing seal");
+  check(repairedMismatchCount == 0u && FlashInterface::sFatalErrorCount == 0u, "alternating commit after the torn one");
+  AlternatingFlashPartitioner::done();
+  FlashInterface::sVerbose = true;
+}
+
+template<typename tConfig>
+uint32_t countValueMismatches(std::vector<std::vector<uint8_t>> const &aValues) {
+  uint32_t result = 0u;
+  for(uint32_t i = 0u; i < aValues.size(); ++i) {
+    uint8_t const * const data = tConfig::getConfig(static_cast<uint16_t>(i));
+    result += (data != nullptr && std::equal(aValues[i].begin(), aValues[i].end(), data) ? 0u : 1u);
+  }
+  return result;
+}
+
+/// Adds items to the arena storage until the pages are full, with a reboot after the first ones, which shrinks the
+/// arena. Each growth relocates all the values, so a pointer returned by getConfig before is no longer the place of
+/// the value, while setConfig and commit never move it. Every value must survive the relocations and the reboots.
+void testArena() {
+  FlashInterface::sVerbose = false;
+  std::mt19937 random(1u);
+  std::vector<std::vector<uint8_t>> values;
+  auto const addValue = [&random, &values](){
+    std::vector<uint8_t> value(cArenaItemSize);
+    std::generate(value.begin(), value.end(), [&random](){ return static_cast<uint8_t>(random()); });
+    bool const added = (ArenaFlashConfig::addConfig(value.data(), cArenaItemSize) != cInvalidConfigId);
+    if(added) {
+      values.push_back(value);
+    }
+    else { // nothing to do
+    }
+    return added;
+  };
+  FlashInterface::eraseAll();
+  ArenaFlashPartitioner::init();
+  ArenaFlashConfig::clear();
+  FlashInterface::sFatalErrorCount = 0u;
+  for(uint32_t i = 0u; i < cArenaFirstItemCount; ++i) {
+    addValue();
+  }
+  ArenaFlashConfig::commit();
+  ArenaFlashPartitioner::done();
+  ArenaFlashPartitioner::init();
+  uint32_t mismatchCount = countValueMismatches<ArenaFlashConfig>(values);
+
+  uint32_t relocationCount = 0u;
+  uint32_t stableErrorCount = 0u;
+  uint8_t const * first = ArenaFlashConfig::getConfig(0u);
+  bool full = false;
+  while(!full) {
+    full = !addValue();
+    uint8_t const * const now = ArenaFlashConfig::getConfig(0u);
+    relocationCount += (now != first ? 1u : 0u);
+    first = now;
+    if(!full && values.size() % 10u == 0u) {
+      uint16_t const id = static_cast<uint16_t>(random() % values.size());
+      std::generate(values[id].begin(), values[id].end(), [&random](){ return static_cast<uint8_t>(random()); });
+      ArenaFlashConfig::setConfig(id, values[id].data());
+      ArenaFlashConfig::commit();
+      stableErrorCount += (ArenaFlashConfig::getConfig(0u) == first ? 0u : 1u);
+    }
+    else { // nothing to do
+    }
+  }
+  bool const exhausted = (FlashInterface::sFatalErrorCount == 1u && FlashInterface::sLastFatalError == nowtech::memory::FlashException::cConfigFull);
+  mismatchCount += countValueMismatches<ArenaFlashConfig>(values);
+  ArenaFlashConfig::commit();
+  ArenaFlashPartitioner::done();
+  ArenaFlashPartitioner::init();
+  mismatchCount += countValueMismatches<ArenaFlashConfig>(values);
+  std::cout << "arena: " << values.size() << " items in " << ArenaFlashConfig::getUsedPageCount() << " pages, relocations: " << relocationCount
+            << ", moved by setConfig or commit: " << stableErrorCount << ", mismatches after reboots: " << mismatchCount << '\n';
+  check(exhausted, "arena fills the pages up to cConfigFull");
+  check(relocationCount > 1u && stableErrorCount == 0u, "arena relocates only on growth");
+  check(mismatchCount == 0u, "arena values survive relocation and reboot");
+  ArenaFlashPartitioner::done();
+  FlashInterface::sVerbose = true;
+}
+
+/// Starts with the defaults of a schema, sets the fields and reboots, then a later version appends a field and
+/// reboots again. A schema not matching the stored items must be reported.
+template<typename tConfig, typename tPartitioner>
+void measureSchema(char const * const aName) {
+  typedef nowtech::memory::FlashConfigSchema<FlashInterface, tConfig, MotorGain, SerialNumber, Calibration> Schema1;
+  typedef nowtech::memory::FlashConfigSchema<FlashInterface, tConfig, MotorGain, SerialNumber, Calibration, DeviceName> Schema2;
+  typedef nowtech::memory::FlashConfigSchema<FlashInterface, tConfig, MotorGain, ShortSerialNumber> BadSchema;
+  FlashInterface::eraseAll();
+  tPartitioner::init();
+  tConfig::clear();
+  FlashInterface::sFatalErrorCount = 0u;
+  Schema1::init();
+  uint32_t mismatchCount = (Schema1::template get<MotorGain>() == MotorGain::cDefault && Schema1::template get<SerialNumber>() == SerialNumber::cDefault
+                         && Schema1::template get<Calibration>() == Calibration::cDefault ? 0u : 1u);
+  tConfig::commit();
+  Calibration::Type calibration;
+  std::iota(calibration.begin(), calibration.end(), -60);
+  Schema1::template set<MotorGain>(2.25f);
+  Schema1::template set<SerialNumber>(12345678u);
+  Schema1::template set<Calibration>(calibration);
+  tConfig::commit();
+  tPartitioner::done();
+  tPartitioner::init();
+  Schema1::init();
+  mismatchCount += (Schema1::template get<MotorGain>() == 2.25f && Schema1::template get<SerialNumber>() == 12345678u && Schema1::template get<Calibration>() == calibration ? 0u : 1u);
+
+  Schema2::init();
+  tConfig::commit();
+  tPartitioner::done();
+  tPartitioner::init();
+  Schema2::init();
+  SerialNumber::Type serialNumber;
+  std::memcpy(&serialNumber, tConfig::getConfig(Schema2::template getId<SerialNumber>()), sizeof(serialNumber));
+  mismatchCount += (Schema2::template get<MotorGain>() == 2.25f && serialNumber == 12345678u && Schema2::template get<Calibration>() == calibration
+                 && Schema2::template get<DeviceName>() == DeviceName::cDefault && Schema2::template getId<DeviceName>() == 3u ? 0u : 1u);
+  bool const noError = (FlashInterface::sFatalErrorCount == 0u);
+
+  BadSchema::init();
+  bool const mismatchDetected = (FlashInterface::sFatalErrorCount == 1u && FlashInterface::sLastFatalError == nowtech::memory::FlashException::cConfigSchemaMismatch);
+  std::cout << aName << ": " << tConfig::getUsedPageCount() << " pages, mismatch detected: " << mismatchDetected << ", mismatches after reboots: " << mismatchCount << '\n';
+  check(mismatchCount == 0u && noError, "schema values survive reboot and upgrade");
+  check(mismatchDetected, "schema reports cConfigSchemaMismatch");
+  tPartitioner::done();
+}
+
+void testSchema() {
+  FlashInterface::sVerbose = false;
+  measureSchema<SchemaFlashConfig, SchemaFlashPartitioner>("schema inline");
+  measureSchema<ArenaSchemaFlashConfig, ArenaSchemaFlashPartitioner>("schema arena");
+  FlashInterface::sVerbose = true;
+}
+
+/// Follows what FlashConfigMapped holds in the flash and in its write buffer, including the commits done by makeRoom
+/// when the buffer would overflow.
+class MappedModel final {
+private:
+  std::vector<std::vector<uint8_t>> mCommitted;
+  std::vector<uint16_t> mStagedIds;
+  uint32_t mStagedSize = 0u;
+
+public:
+  std::vector<std::vector<uint8_t>> mCurrent;
+  uint32_t mRoomCommitCountInAdd = 0u;
+  uint32_t mRoomCommitCountInSet = 0u;
+
+  void add(std::vector<uint8_t> const &aValue) {
+    mRoomCommitCountInAdd += (makeRoom(aValue.size()) ? 1u : 0u);
+    mStagedIds.push_back(static_cast<uint16_t>(mCurrent.size()));
+    mStagedSize += 4u + aValue.size();
+    mCurrent.push_back(aValue);
+  }
+
+  void set(uint16_t const aId, std::vector<uint8_t> const &aValue) {
+    if(std::find(mStagedIds.begin(), mStagedIds.end(), aId) != mStagedIds.end()) {
+      mCurrent[aId] = aValue;
+    }
+    else if(aValue != mCommitted[aId]) {
+      mRoomCommitCountInSet += (makeRoom(aValue.size()) ? 1u : 0u);
+      mStagedIds.push_back(aId);
+      mStagedSize += 4u + aValue.size();
+      mCurrent[aId] = aValue;
+    }
+    else { // nothing to do
+    }
+  }
+
+  void clear() {
+    mCurrent.clear();
+    mStagedIds.clear();
+    mStagedSize = 0u;
+  }
+
+  void commit() {
+    mCommitted = mCurrent;
+    mStagedIds.clear();
+    mStagedSize = 0u;
+  }
+
+  void reboot() {
+    mCurrent = mCommitted;
+    mStagedIds.clear();
+    mStagedSize = 0u;
+  }
+
+private:
+  bool makeRoom(uint32_t const aCount) {
+    bool const result = (mStagedSize + 4u + aCount > cMappedWriteBufferSize);
+    if(result) {
+      commit();
+    }
+    else { // nothing to do
+    }
+    return result;
+  }
+};
+
+uint32_t countMappedMismatches(std::vector<std::vector<uint8_t>> const &aValues) {
+  uint32_t result = 0u;
+  for(uint32_t i = 0u; i < aValues.size(); ++i) {
+    uint8_t const * const data = MappedFlashConfig::getConfig(static_cast<uint16_t>(i));
+    result += (data != nullptr && std::equal(aValues[i].begin(), aValues[i].end(), data) ? 0u : 1u);
+  }
+  return result;
+}
+
+/// Flips a byte of the first page of the copy in the flash.
+void corruptMappedCopy(uint32_t const aCopyIndex) {
+  uint32_t const page = aCopyIndex * cMappedPagesNeeded / 2u;
+  std::vector<uint8_t> content = readFlash(page, 1u);
+  content[FlashInterface::getPageSizeInBytes() / 2u] ^= 0xffu;
+  FlashInterface::writePage(page, content.data());
+}
+
+/// Random additions, changes, clears, commits and reboots without commit, with the write buffer overflowing often,
+/// so that makeRoom commits in the middle of addConfig and setConfig. Every value is compared with a model after each
+/// operation. Then a corrupted copy must be reported, and repaired by a commit after makeAllDirty.
+void testConfigMapped() {
+  FlashInterface::sVerbose = false;
+  std::mt19937 random(1u);
+  FlashInterface::eraseAll();
+  MappedFlashPartitioner::init();
+  FlashInterface::sFatalErrorCount = 0u;
+  MappedModel model;
+  uint32_t rebootCount = 0u;
+  uint32_t mismatchCount = 0u;
+  auto const makeValue = [&random](uint32_t const aCount){
+    std::vector<uint8_t> result(aCount);
+    std::generate(result.begin(), result.end(), [&random](){ return static_cast<uint8_t>(random() % 4u); }); // so that some changes keep the value
+    return result;
+  };
+  for(uint32_t operation = 0u; operation < cMappedOperationCount; ++operation) {
+    uint32_t const kind = random() % 100u;
+    if(kind < 25u && model.mCurrent.size() < cMappedMaxItemCount) {
+      std::vector<uint8_t> const value = makeValue(1u + random() % cMappedMaxItemSize);
+      MappedFlashConfig::addConfig(value.data(), static_cast<uint16_t>(value.size()));
+      model.add(value);
+    }
+    else if(kind < 90u && !model.mCurrent.empty()) {
+      uint16_t const id = static_cast<uint16_t>(random() % model.mCurrent.size());
+      std::vector<uint8_t> const value = makeValue(model.mCurrent[id].size());
+      MappedFlashConfig::setConfig(id, value.data());
+      model.set(id, value);
+    }
+    else if(kind < 92u || model.mCurrent.size() == cMappedMaxItemCount) {
+      MappedFlashConfig::clear();
+      model.clear();
+    }
+    else if(kind < 97u) {
+      MappedFlashConfig::commit();
+      model.commit();
+    }
+    else {
+      MappedFlashPartitioner::done();
+      MappedFlashPartitioner::init();
+      model.reboot();
+      ++rebootCount;
+    }
+    mismatchCount += countMappedMismatches(model.mCurrent);
+  }
+  std::cout << "config mapped: " << cMappedOperationCount << " operations, " << rebootCount << " reboots, commits by makeRoom in addConfig: " << model.mRoomCommitCountInAdd
+            << ", in setConfig: " << model.mRoomCommitCountInSet << ", mismatches: " << mismatchCount << ", errors: " << FlashInterface::sFatalErrorCount << '\n';
+  check(model.mRoomCommitCountInAdd > 0u && model.mRoomCommitCountInSet > 0u, "config mapped makeRoom commits in addConfig and setConfig");
+  check(mismatchCount == 0u && FlashInterface::sFatalErrorCount == 0u, "config mapped follows the model");
+
+  MappedFlashConfig::clear();
+  model.clear();
+  for(uint32_t i = 0u; i < cMappedMaxItemCount; ++i) {
+    std::vector<uint8_t> const value = makeValue(1u + random() % cMappedMaxItemSize);
+    MappedFlashConfig::addConfig(value.data(), static_cast<uint16_t>(value.size()));
+    model.add(value);
+  }
+  MappedFlashConfig::commit();
+  model.commit();
+  uint32_t repairMismatchCount = 0u;
+  uint32_t repairErrorCount = 0u;
+  for(uint32_t copyIndex = 0u; copyIndex < 2u; ++copyIndex) {
+    MappedFlashPartitioner::done();
+    corruptMappedCopy(copyIndex);
+    FlashInterface::sFatalErrorCount = 0u;
+    MappedFlashPartitioner::init();
+    bool const detected = (FlashInterface::sFatalErrorCount == 1u
+                        && FlashInterface::sLastFatalError == (copyIndex == 0u ? nowtech::memory::FlashException::cConfigBadCopy1 : nowtech::memory::FlashException::cConfigBadCopy2));
+    repairErrorCount += (detected ? 0u : 1u);
+    repairMismatchCount += countMappedMismatches(model.mCurrent);
+    MappedFlashConfig::makeAllDirty();
+    MappedFlashConfig::commit();
+    MappedFlashPartitioner::done();
+    FlashInterface::sFatalErrorCount = 0u;
+    MappedFlashPartitioner::init();
+    repairErrorCount += FlashInterface::sFatalErrorCount;
+    repairMismatchCount += countMappedMismatches(model.mCurrent);
+  }
+  std::cout << "config mapped repair: " << model.mCurrent.size() << " items, errors: " << repairErrorCount << ", mismatches: " << repairMismatchCount << '\n';
+  check(repairErrorCount == 0u && repairMismatchCount == 0u, "config mapped bad copy repaired by makeAllDirty");
+  MappedFlashPartitioner::done();
+  FlashInterface::sVerbose = true;
+}
+
+uint32_t countLazyMismatches() {
+  uint32_t result = 0u;
+  for(uint32_t i = 0u; i < cPackingItemCount; ++i) {
+    uint8_t const * const data = LazyFlashConfig::getConfig(static_cast<uint16_t>(i));
+    result += (data != nullptr && std::all_of(data, data + cMultiItemSize, [i](uint8_t const aValue){ return aValue == static_cast<uint8_t>(i); }) ? 0u : 1u);
+  }
+  return result;
+}
+
+/// Flips a value byte of the page in the copy in the flash, leaving the headers intact.
+void corruptLazyCopy(uint32_t const aCopyIndex) {
+  uint32_t const page = aCopyIndex * cMultiPagesNeeded / 2u + cLazyCorruptPage;
+  std::vector<uint8_t> content = readFlash(page, 1u);
+  content[cLazyCorruptOffset] ^= 0xffu;
+  FlashInterface::writePage(page, content.data());
+}
+
+/// Lazy boot must read only the headers, and in non-mapped mode each used page once. A value corrupted in the first
+/// copy is found only when its page is loaded, and is taken from the second copy. If corrupted in both, it is kept
+/// as it is, so that the application can correct it and commit.
+void measureLazyBoot(bool const aMapped) {
+  FlashInterface::sCanMap = aMapped;
+  FlashInterface::eraseAll();
+  LazyFlashPartitioner::init();
+  LazyFlashConfig::clear();
+  uint8_t value[cMultiItemSize];
+  for(uint32_t i = 0u; i < cPackingItemCount; ++i) {
+    std::fill_n(value, cMultiItemSize, static_cast<uint8_t>(i));
+    LazyFlashConfig::addConfig(value, cMultiItemSize);
+  }
+  LazyFlashConfig::commit();
+  uint32_t const usedPages = LazyFlashConfig::getUsedPageCount();
+  LazyFlashPartitioner::done();
+  FlashInterface::sReadPageCount = 0u;
+  FlashInterface::sFatalErrorCount = 0u;
+  LazyFlashPartitioner::init();
+  uint32_t const bootReadPageCount = FlashInterface::sReadPageCount;
+  uint32_t mismatchCount = countLazyMismatches();
+  uint32_t errorCount = FlashInterface::sFatalErrorCount;
+
+  LazyFlashPartitioner::done();
+  corruptLazyCopy(0u);
+  FlashInterface::sFatalErrorCount = 0u;
+  LazyFlashPartitioner::init();
+  bool const passedBoot = (FlashInterface::sFatalErrorCount == 0u);
+  mismatchCount += countLazyMismatches();
+  bool const foundLater = (FlashInterface::sFatalErrorCount == 1u && FlashInterface::sLastFatalError == nowtech::memory::FlashException::cConfigBadCopy1);
+
+  LazyFlashPartitioner::done();
+  corruptLazyCopy(1u);
+  FlashInterface::sFatalErrorCount = 0u;
+  LazyFlashPartitioner::init();
+  uint32_t const keptMismatchCount = countLazyMismatches();
+  bool const bothBad = (FlashInterface::sFatalErrorCount == 1u && FlashInterface::sLastFatalError == nowtech::memory::FlashException::cConfigBadCopies);
+  for(uint32_t i = 0u; i < cPackingItemCount; ++i) {
+    std::fill_n(value, cMultiItemSize, static_cast<uint8_t>(i));
+    LazyFlashConfig::setConfig(static_cast<uint16_t>(i), value);
+  }
+  LazyFlashConfig::commit();
+  LazyFlashPartitioner::done();
+  FlashInterface::sFatalErrorCount = 0u;
+  LazyFlashPartitioner::init();
+  mismatchCount += countLazyMismatches();
+  errorCount += FlashInterface::sFatalErrorCount;
+  std::cout << "lazy boot " << (aMapped ? "mapped" : "unmapped") << ": " << usedPages << " pages, read on boot: " << bootReadPageCount
+            << ", bad page found only on load: " << (passedBoot && foundLater) << ", kept if bad in both copies: " << (bothBad && keptMismatchCount == 1u)
+            << ", mismatches: " << mismatchCount << ", errors: " << errorCount << '\n';
+  check(bootReadPageCount == (aMapped ? 0u : 2u * (usedPages + 1u)), "lazy boot reads only the headers"); // the erased page ends each copy
+  check(passedBoot && foundLater, "lazy boot finds a bad page on load and takes the other copy");
+  check(bothBad && keptMismatchCount == 1u, "lazy boot keeps a page bad in both copies");
+  check(mismatchCount == 0u && errorCount == 0u, "lazy boot values");
+  LazyFlashPartitioner::done();
+  FlashInterface::sCanMap = true;
+}
+
+void testLazyBoot() {
+  FlashInterface::sVerbose = false;
+  measureLazyBoot(true);
+  measureLazyBoot(false);
+  FlashInterface::sVerbose = true;
+}
+
+// Mostly scalars, some names and short arrays, and a few calibration tables.
+uint16_t getPackingItemSize(std::mt19937 &aRandom) {
+  uint32_t const kind = aRandom() % 100u;
+  uint16_t result;
+  if(kind < 60u) {
+    result = 1u << (aRandom() % 4u);
+  }
+  else if(kind < 85u) {
+    result = 10u + aRandom() % 31u;
+  }
+  else if(kind < 95u) {
+    result = 60u + aRandom() % 61u;
+  }
+  else {
+    result = 150u + aRandom() % 91u;
+  }
+  return result;
+}
+
+/// Returns the pages used.
+template<typename tConfig, typename tPartitioner>
+uint32_t measurePacking(char const * const aName) {
+  std::mt19937 random(1u);
+  std::vector<uint16_t> sizes(cPackingItemCount);
+  uint32_t dataSize = 0u;
+  FlashInterface::eraseAll();
+  tPartitioner::init();
+  tConfig::clear();
+  for(uint32_t i = 0u; i < cPackingItemCount; ++i) {
+    sizes[i] = getPackingItemSize(random);
+    dataSize += sizes[i];
+    tConfig::addConfig(FlashInterface::sPattern, sizes[i]);
+  }
+  tConfig::commit();
+  tPartitioner::done();
+  tPartitioner::init();
+  uint32_t mismatchCount = 0u;
+  for(uint32_t i = 0u; i < cPackingItemCount; ++i) {
+    mismatchCount += (std::equal(FlashInterface::sPattern, FlashInterface::sPattern + sizes[i], tConfig::getConfig(static_cast<uint16_t>(i))) ? 0u : 1u);
+  }
+  uint32_t const pageCount = tConfig::getUsedPageCount();
+  std::cout << aName << ": " << cPackingItemCount << " items of " << dataSize << " bytes in " << pageCount << " pages, "
+            << 100u * dataSize / (pageCount * FlashInterface::getPageSizeInBytes()) << "% data, mismatches after reboot: " << mismatchCount << '\n';
+  check(mismatchCount == 0u, "packed items read back after reboot");
+  tPartitioner::done();
+  return pageCount;
+}
+
+void testPacking() {
+  FlashInterface::sVerbose = false;
+  uint32_t const wholePageCount = measurePacking<WholeFlashConfig, WholeFlashPartitioner>("whole packing");
+  uint32_t const spanningPageCount = measurePacking<SpanningFlashConfig, SpanningFlashPartitioner>("spanning packing");
+  check(spanningPageCount < wholePageCount, "spanning packing takes fewer pages than whole packing");
+  FlashInterface::sVerbose = true;
+}
+
+/// Changes every cPlacementHotStep-th item cPlacementCommitCount times, and returns the sectors written per commit.
+double updateHotItems(std::mt19937 &aRandom, std::vector<std::vector<uint8_t>> &aValues) {
+  HotFlashConfig::clearStatistics();
+  for(uint32_t i = 0u; i < cPlacementCommitCount; ++i) {
+    for(uint32_t id = cPlacementHotStep / 2u; id < cPackingItemCount; id += cPlacementHotStep) {
+      std::generate(aValues[id].begin(), aValues[id].end(), [&aRandom](){ return static_cast<uint8_t>(aRandom()); });
+      HotFlashConfig::setConfig(static_cast<uint16_t>(id), aValues[id].data());
+    }
+    HotFlashConfig::commit();
+  }
+  return static_cast<double>(HotFlashConfig::getCommitStatistics().mSectorWriteCount) / HotFlashConfig::getCommitStatistics().mCommitCount;
+}
+
+void testPlacement() {
+  FlashInterface::sVerbose = false;
+  std::mt19937 random(1u);
+  std::vector<std::vector<uint8_t>> values(cPackingItemCount);
+  FlashInterface::eraseAll();
+  HotFlashPartitioner::init();
+  HotFlashConfig::clear();
+  for(uint32_t i = 0u; i < cPackingItemCount; ++i) {
+    values[i].resize(getPackingItemSize(random));
+    std::generate(values[i].begin(), values[i].end(), [&random](){ return static_cast<uint8_t>(random()); });
+    HotFlashConfig::addConfig(values[i].data(), static_cast<uint16_t>(values[i].size()));
+  }
+  HotFlashConfig::commit();
+  double const scatteredSectors = updateHotItems(random, values);
+  uint32_t const scatteredPages = HotFlashConfig::getUsedPageCount();
+  HotFlashConfig::compact(cPlacementCommitCount);
+  double const hotTailSectors = updateHotItems(random, values);
+  HotFlashPartitioner::done();
+  HotFlashPartitioner::init();
+  uint32_t mismatchCount = 0u;
+  for(uint32_t i = 0u; i < cPackingItemCount; ++i) {
+    mismatchCount += (std::equal(values[i].begin(), values[i].end(), HotFlashConfig::getConfig(static_cast<uint16_t>(i))) ? 0u : 1u);
+  }
+  std::cout << "hot items scattered: " << scatteredSectors << " sectors written per commit in " << scatteredPages << " pages\n";
+  std::cout << "hot items in the tail: " << hotTailSectors << " sectors written per commit in " << HotFlashConfig::getUsedPageCount()
+            << " pages, mismatches after reboot: " << mismatchCount << '\n';
+  check(mismatchCount == 0u, "placed items read back after reboot");
+  check(hotTailSectors < scatteredSectors, "hot items in the tail need fewer sectors written per commit");
+  HotFlashPartitioner::done();
+  FlashInterface::sVerbose = true;
+}
+
+/// Writes the items in random chunks, and reads them back after a reboot in chunks of the read ahead buffer.
+void testLongtermBulk() {
+  FlashInterface::sVerbose = false;
+  std::mt19937 random(1u);
+  std::vector<std::vector<uint8_t>> values(std::size(cBulkItemSizes));
+  FlashInterface::eraseAll();
+  BulkFlashPartitioner::init();
+  uint32_t const freeBefore = BulkFlash::getFreePageCount();
+  for(uint8_t id = 0u; id < values.size(); ++id) {
+    values[id].resize(cBulkItemSizes[id]);
+    std::generate(values[id].begin(), values[id].end(), [&random](){ return static_cast<uint8_t>(random()); });
+    BulkFlash::beginItem(id);
+    for(uint32_t done = 0u; done < values[id].size();) {
+      uint32_t const count = std::min<uint32_t>(values[id].size() - done, 1u + random() % cBulkMaxChunkSize);
+      BulkFlash::appendItem(values[id].data() + done, count);
+      done += count;
+    }
+    BulkFlash::finishItem();
+  }
+  uint32_t const usedPages = freeBefore - BulkFlash::getFreePageCount();
+  BulkFlashPartitioner::done();
+  BulkFlashPartitioner::init();
+  uint32_t mismatchCount = 0u;
+  uint32_t chunkCount = 0u;
+  uint32_t dataSize = 0u;
+  for(uint8_t id = 0u; id < values.size(); ++id) {
+    std::vector<uint8_t> read;
+    BulkFlash::readItem(id, [&read, &chunkCount](uint8_t const * const aData, uint32_t const aCount){
+      read.insert(read.end(), aData, aData + aCount);
+      ++chunkCount;
+    });
+    mismatchCount += (read == values[id] ? 0u : 1u);
+    dataSize += values[id].size();
+  }
+  uint32_t spanMismatchCount = 0u;
+  uint32_t fragmentCount = 0u;
+  for(uint8_t id = 0u; id < values.size(); ++id) {
+    std::vector<uint8_t> mapped;
+    for(auto const fragment : BulkFlash::getItemSpan(id)) {
+      mapped.insert(mapped.end(), fragment.mData, fragment.mData + fragment.mCount);
+      ++fragmentCount;
+    }
+    spanMismatchCount += (mapped == values[id] ? 0u : 1u);
+  }
+  std::cout << "bulk: " << values.size() << " items of " << dataSize << " bytes in " << usedPages << " pages, read in "
+            << chunkCount << " chunks, mismatches after reboot: " << mismatchCount << '\n';
+  check(mismatchCount == 0u, "bulk items read back after reboot");
+  std::cout << "bulk mapped: " << fragmentCount << " fragments, mismatches: " << spanMismatchCount << '\n';
+  check(spanMismatchCount == 0u, "bulk item spans map the items written");
+  BulkFlashPartitioner::done();
+  FlashInterface::sVerbose = true;
+}
+
+/// Returns the page of the item header in the first copy, relative to the flash start, while the LBD is at page 0.
+uint32_t getBulkHeaderPage(uint8_t const aId) {
+  uint8_t const * const data = (*BulkFlash::getItemSpan(aId).begin()).mData;
+  return static_cast<uint32_t>(data - FlashInterface::getMappedAddress(0u)) / FlashInterface::getPageSizeInBytes();
+}
+
+/// Reboots the LBD, and returns the number of pages read meanwhile.
+uint32_t rebootBulkIndex() {
+  IndexFlashPartitioner::done();
+  FlashInterface::sReadPageCount = 0u;
+  FlashInterface::sFatalErrorCount = 0u;
+  IndexFlashPartitioner::init();
+  return FlashInterface::sReadPageCount;
+}
+
+/// Returns the number of items missing, mismatching or having a different size.
+uint32_t countBulkMismatches(std::vector<std::vector<uint8_t>> const &aValues) {
+  uint32_t mismatchCount = 0u;
+  for(uint8_t id = 0u; id < cBulkMaxItemCount; ++id) {
+    if(id < aValues.size()) {
+      std::vector<uint8_t> read;
+      BulkFlash::readItem(id, [&read](uint8_t const * const aData, uint32_t const aCount){
+        read.insert(read.end(), aData, aData + aCount);
+      });
+      mismatchCount += (BulkFlash::hasItem(id) && BulkFlash::getItemSize(id) == aValues[id].size() && read == aValues[id] ? 0u : 1u);
+    }
+    else {
+      mismatchCount += (BulkFlash::hasItem(id) ? 1u : 0u);
+    }
+  }
+  return mismatchCount;
+}
+
+/// The index must be rebuilt on boot from the header pages alone, jumping over the data pages by the item length, so
+/// the pages read are the header pages of both copies, and the first free page and the rest of its sector to see
+/// they are erased. The replaced item has two headers, the later wins. A bad header page in the first copy is taken
+/// from the second, and a header page missing only from the second copy (power lost during finishItem) is rewritten.
+void testBulkIndex() {
+  FlashInterface::sVerbose = false;
+  std::mt19937 random(2u);
+  std::vector<std::vector<uint8_t>> values(std::size(cBulkItemSizes));
+  FlashInterface::eraseAll();
+  IndexFlashPartitioner::init();
+  uint32_t headerCount = 0u;
+  auto writeItem = [&random, &values, &headerCount](uint8_t const aId, uint32_t const aSize){
+    values[aId].resize(aSize);
+    std::generate(values[aId].begin(), values[aId].end(), [&random](){ return static_cast<uint8_t>(random()); });
+    BulkFlash::beginItem(aId);
+    BulkFlash::appendItem(values[aId].data(), aSize);
+    BulkFlash::finishItem();
+    ++headerCount;
+  };
+  for(uint8_t id = 0u; id < values.size(); ++id) {
+    writeItem(id, cBulkItemSizes[id]);
+  }
+  writeItem(cIndexReplacedId, cIndexReplacedSize);
+  uint32_t const usedPages = cIndexCopySizeInPages - BulkFlash::getFreePageCount();
+  uint32_t const sectorSize = FlashInterface::getSectorSizeInPages();
+  uint32_t const expectedReadCount = 2u * (headerCount + 1u) + 2u * ((usedPages / sectorSize + 1u) * sectorSize - usedPages);
+
+  uint32_t const bootReadCount = rebootBulkIndex();
+  uint32_t const bootErrorCount = FlashInterface::sFatalErrorCount;
+  uint32_t mismatchCount = countBulkMismatches(values);
+  check(bootReadCount == expectedReadCount, "bulk index: boot reads only the header pages");
+  check(mismatchCount == 0u && bootErrorCount == 0u, "bulk index: items after reboot");
+  check(BulkFlash::getFreePageCount() == cIndexCopySizeInPages - usedPages, "bulk index: first free page after reboot");
+  std::cout << "bulk index: " << headerCount << " headers in " << usedPages << " pages, boot read " << bootReadCount
+            << " pages, mismatches after reboot: " << mismatchCount << '\n';
+
+  uint32_t const corruptPage = getBulkHeaderPage(cIndexCorruptId);
+  IndexFlashPartitioner::done();
+  std::vector<uint8_t> const goodHeader = readFlash(corruptPage, 1u);
+  std::vector<uint8_t> header = goodHeader;
+  header[FlashInterface::getPageSizeInBytes() / 2u] ^= 0xffu;
+  FlashInterface::writePage(corruptPage, header.data());
+  IndexFlashPartitioner::init();
+  rebootBulkIndex();
+  check(FlashInterface::sFatalErrorCount == 1u && FlashInterface::sLastFatalError == nowtech::memory::FlashException::cBulkBadCopy1,
+        "bulk index: bad header page in copy 1 reported on boot");
+  mismatchCount = countBulkMismatches(values);
+  check(mismatchCount == 0u && FlashInterface::sLastFatalError == nowtech::memory::FlashException::cBulkBadCopy1,
+        "bulk index: bad header page in copy 1 taken from copy 2");
+  std::cout << "bulk index with a bad header page in copy 1: mismatches after reboot: " << mismatchCount << '\n';
+
+  uint32_t const tornPage = getBulkHeaderPage(cIndexReplacedId);
+  IndexFlashPartitioner::done();
+  FlashInterface::writePage(corruptPage, goodHeader.data());
+  std::vector<uint8_t> const tornHeader = readFlash(tornPage, 1u);
+  std::vector<uint8_t> const erased(FlashInterface::getPageSizeInBytes(), 0xffu);
+  FlashInterface::writePage(tornPage + cIndexCopySizeInPages, erased.data());
+  IndexFlashPartitioner::init();
+  rebootBulkIndex();
+  uint32_t const repairErrorCount = FlashInterface::sFatalErrorCount;
+  mismatchCount = countBulkMismatches(values);
+  check(mismatchCount == 0u && repairErrorCount == 0u && readFlash(tornPage + cIndexCopySizeInPages, 1u) == tornHeader,
+        "bulk index: header page missing from copy 2 rewritten");
+  std::cout << "bulk index with a header page missing from copy 2: mismatches after reboot: " << mismatchCount << '\n';
+  IndexFlashPartitioner::done();
+  FlashInterface::sVerbose = true;
+}
+
+std::vector<uint8_t> makeLog(std::mt19937 &aRandom) {
+  static constexpr char cStates[][8] = { "IDLE", "RUNNING", "FAULT" };
+  std::string text;
+  for(uint32_t i = 0u; text.size() < cCompressionDataSize; ++i) {
+    text += "t=" + std::to_string(i * 10u) + " motor current " + std::to_string(aRandom() % 4000u) + " mA state " + cStates[aRandom() % std::size(cStates)] + '\n';
+  }
+  return std::vector<uint8_t>(text.begin(), text.begin() + cCompressionDataSize);
+}
+
+std::vector<uint8_t> makeTable() {
+  std::vector<uint8_t> result(cCompressionDataSize);
+  for(uint32_t i = 0u; i < cCompressionDataSize; i += sizeof(int16_t)) {
+    int16_t const value = static_cast<int16_t>(1000.0 * std::sin(i / 5000.0)) & ~3; // quantized calibration curve
+    std::memcpy(result.data() + i, &value, sizeof(int16_t));
+  }
+  return result;
+}
+
+std::vector<uint8_t> makeRandom(std::mt19937 &aRandom) {
+  std::vector<uint8_t> result(cCompressionDataSize);
+  std::generate(result.begin(), result.end(), [&aRandom](){ return static_cast<uint8_t>(aRandom()); });
+  return result;
+}
+
+/// Writes each kind of data raw and compressed, and compares the pages used and the time of writing and reading.
+void testBulkCompression() {
+  FlashInterface::sVerbose = false;
+  std::mt19937 random(1u);
+  std::pair<char const *, std::vector<uint8_t>> const datas[] = { { "log", makeLog(random) }, { "table", makeTable() }, { "random", makeRandom(random) } };
+  FlashInterface::eraseAll();
+  CompressedBulkFlashPartitioner::init();
+  for(auto const &[name, value] : datas) {
+    uint32_t pages[2];
+    double writeMs[2];
+    double readMs[2];
+    uint32_t mismatchCount = 0u;
+    for(uint8_t compressed = 0u; compressed < 2u; ++compressed) {
+      CompressedBulkFlash::clear();
+      auto const start = std::chrono::steady_clock::now();
+      CompressedBulkFlash::beginItem(compressed, compressed == 1u);
+      for(uint32_t done = 0u; done < value.size(); done += cBulkMaxChunkSize) {
+        CompressedBulkFlash::appendItem(value.data() + done, std::min<uint32_t>(value.size() - done, cBulkMaxChunkSize));
+      }
+      CompressedBulkFlash::finishItem();
+      auto const written = std::chrono::steady_clock::now();
+      std::vector<uint8_t> read;
+      CompressedBulkFlash::readItem(compressed, [&read](uint8_t const * const aData, uint32_t const aCount){
+        read.insert(read.end(), aData, aData + aCount);
+      });
+      auto const end = std::chrono::steady_clock::now();
+      mismatchCount += (read == value ? 0u : 1u);
+      pages[compressed] = cBulkPagesNeeded / static_cast<uint32_t>(cCopies) - CompressedBulkFlash::getFreePageCount();
+      writeMs[compressed] = std::chrono::duration<double, std::milli>(written - start).count();
+      readMs[compressed] = std::chrono::duration<double, std::milli>(end - written).count();
+    }
+    std::cout << "bulk compression " << name << ": " << value.size() << " bytes in " << pages[0] << " pages raw, " << pages[1]
+              << " compressed, write " << writeMs[0] << " / " << writeMs[1] << " ms, read " << readMs[0] << " / " << readMs[1]
+              << " ms, mismatches: " << mismatchCount << '\n';
+    check(mismatchCount == 0u, "bulk compression reads back the item written");
+    check(std::strcmp(name, "random") == 0 || pages[1] < pages[0], "bulk compression takes fewer pages for log and table data");
+  }
+  CompressedBulkFlashPartitioner::done();
+  FlashInterface::sVerbose = true;
+}
+
+/// Boots with a LEO series of each length at each start page, and reports the worst-case probe count for the
+/// lengths in power of 2 ranges.
+void testLeoDiscovery() {
+  FlashInterface::sVerbose = false;
+  std::vector<uint8_t> erasedPage(FlashInterface::getPageSizeInBytes(), 0xffu);
+  std::vector<uint8_t> leoPage(erasedPage);
+  leoPage[0u] = static_cast<uint8_t>(nowtech::memory::Magic::cOnTimeOnly);
+  std::vector<uint32_t> worstProbeCounts(cLeoMaxCount + 1u, 0u);
+  uint32_t mismatchCount = 0u;
+  for(uint32_t length = 0u; length <= cLeoMaxCount; ++length) {
+    for(uint32_t page = 0u; page < cLeoPagesNeeded; ++page) {
+      FlashInterface::writePage(page, page < length ? leoPage.data() : erasedPage.data());
+    }
+    for(uint32_t start = 0u; start < cLeoPagesNeeded; ++start) {
+      LeoFlashPartitioner::init();
+      worstProbeCounts[length] = std::max(worstProbeCounts[length], LeoFlash::getProbeCount());
+      mismatchCount += (LeoFlash::getLeoPageCount() == length && (length == 0u || LeoFlash::getLeoStartPage() == start) ? 0u : 1u);
+      LeoFlashPartitioner::done();
+      FlashInterface::writePage(start, erasedPage.data());
+      FlashInterface::writePage((start + length) % cLeoPagesNeeded, length > 0u ? leoPage.data() : erasedPage.data());
+    }
+  }
+  uint32_t logPagesNeeded = 0u;
+  for(uint32_t pages = cLeoPagesNeeded; pages > 1u; pages /= 2u) {
+    ++logPagesNeeded;
+  }
+  uint32_t overBoundCount = (worstProbeCounts[0u] <= cLeoPagesNeeded ? 0u : 1u);
+  std::cout << "leo discovery in " << cLeoPagesNeeded << " pages, displacement " << LeoFlash::calculateDisplacement() << ", worst probes for length 0: " << worstProbeCounts[0u];
+  for(uint32_t low = 1u; low <= cLeoMaxCount; low *= 2u) {
+    uint32_t const high = std::min(2u * low - 1u, cLeoMaxCount);
+    uint32_t const worst = *std::max_element(worstProbeCounts.begin() + low, worstProbeCounts.begin() + high + 1u);
+    overBoundCount += (worst <= 2u * (cLeoPagesNeeded / low + logPagesNeeded) ? 0u : 1u);
+    std::cout << ", " << low << '-' << high << ": " << worst;
+  }
+  std::cout << ", mismatches: " << mismatchCount << '\n';
+  check(mismatchCount == 0u, "leo discovery finds every series");
+  check(overBoundCount == 0u, "leo discovery probes at most 2 * (B / L + log B) pages for a series of L pages in B");
+  FlashInterface::sVerbose = true;
+}
+
+/// Producers log concurrently with a thread flushing periodically, more than the LEO series can hold. After a reboot,
+/// the entries of each producer must be a run of consecutive sequence numbers ending with its last one. Then checks
+/// that a partial page is written only at the deadline.
+void testLeoLog() {
+  FlashInterface::sVerbose = false;
+  FlashInterface::eraseAll();
+  LogFlashPartitioner::init();
+  std::atomic<bool> producing = true;
+  std::thread flusher([&producing](){
+    uint32_t now = 0u;
+    while(producing.load()) {
+      LogFlash::setOnTime(now);
+      LogFlash::flushLog(now++);
+      std::this_thread::yield();
+    }
+  });
+  std::vector<std::thread> producers;
+  std::atomic<uint32_t> retryCount = 0u;
+  for(uint8_t producer = 0u; producer < cLogProducerCount; ++producer) {
+    producers.emplace_back([producer, &retryCount](){
+      for(uint32_t sequence = 0u; sequence < cLogEntriesPerProducer; ++sequence) {
+        uint8_t entry[cLogEntrySize] = { producer };
+        std::memcpy(entry + 1u, &sequence, sizeof(sequence));
+        while(!LogFlash::log(entry)) {
+          ++retryCount;
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for(auto &producer : producers) {
+    producer.join();
+  }
+  producing = false;
+  flusher.join();
+  LogFlash::setOnTime(cLogEntriesPerProducer);
+  LogFlash::flushLog(0u, true);
+  uint32_t const dropCount = LogFlash::getLogDropCount();
+  LogFlashPartitioner::done();
+
+  LogFlashPartitioner::init();
+  uint32_t mismatchCount = (LogFlash::getOnTime() == cLogEntriesPerProducer && LogFlash::getLeoPageCount() <= cLeoMaxCount ? 0u : 1u);
+  std::vector<int64_t> lastSequences(cLogProducerCount, -1);
+  uint32_t entryCount = 0u;
+  LogFlash::readLog([&](uint32_t const, uint8_t const * const aEntry){
+    uint32_t sequence;
+    std::memcpy(&sequence, aEntry + 1u, sizeof(sequence));
+    int64_t &last = lastSequences[aEntry[0u] % cLogProducerCount];
+    mismatchCount += (aEntry[0u] < cLogProducerCount && (last < 0 || sequence == last + 1) ? 0u : 1u);
+    last = sequence;
+    ++entryCount;
+  });
+  for(auto const last : lastSequences) {
+    mismatchCount += (last == cLogEntriesPerProducer - 1u ? 0u : 1u);
+  }
+  std::cout << "leo log: " << entryCount << " of " << cLogProducerCount * cLogEntriesPerProducer << " entries in " << LogFlash::getLeoPageCount()
+            << " pages, retries on full queue: " << retryCount << ", drops: " << dropCount << ", mismatches: " << mismatchCount << '\n';
+  check(mismatchCount == 0u, "log keeps the entries of each producer in order, ending with the last one");
+  check(dropCount == retryCount, "log drops exactly the entries refused on full queue");
+
+  uint32_t const pageCount = LogFlash::getLeoPageCount();
+  uint8_t const entry[cLogEntrySize] = {};
+  LogFlash::log(entry);
+  LogFlash::flushLog(100u);
+  bool const early = (LogFlash::getLeoPageCount() != pageCount);
+  LogFlash::log(entry);
+  LogFlash::flushLog(100u + cLogMaxDelay - 1u);
+  bool const late = (LogFlash::getLeoPageCount() != pageCount);
+  LogFlash::flushLog(100u + cLogMaxDelay);
+  bool const onTime = (LogFlash::getLeoPageCount() == pageCount + 1u);
+  std::cout << "leo log delay: written early: " << early << ", before deadline: " << late << ", at deadline: " << onTime << '\n';
+  check(!early && !late && onTime, "log writes a partial page only at the deadline");
+  LogFlashPartitioner::done();
+  FlashInterface::sVerbose = true;
+}
+
+/// Bursts of increments mostly on a few hot ids, with a flush after each burst, enough to wrap the partition several
+/// times. Each reboot must restore every counter.
+void testLeoErrorCounters() {
+  FlashInterface::sVerbose = false;
+  FlashInterface::eraseAll();
+  ErrorFlashPartitioner::init();
+  std::mt19937 random(1u);
+  std::vector<uint32_t> expected(cErrorCounterCount, 0u);
+  auto const getId = [](uint32_t const aIndex){ return static_cast<uint16_t>(aIndex * 97u); };
+  uint32_t pageCount = 0u;
+  uint32_t mismatchCount = 0u;
+  for(uint32_t flush = 1u; flush <= cErrorFlushCount; ++flush) {
+    for(uint32_t i = 0u; i < cErrorIncrementsPerFlush; ++i) {
+      uint32_t const index = (random() % 10u == 0u ? random() % cErrorCounterCount : random() % cErrorHotCount);
+      ErrorFlash::countError(getId(index));
+      ++expected[index];
+    }
+    uint32_t const head = ErrorFlash::getLeoStartPage() + ErrorFlash::getLeoPageCount();
+    ErrorFlash::flushErrorCounters();
+    pageCount += (ErrorFlash::getLeoStartPage() + ErrorFlash::getLeoPageCount() + cLeoPagesNeeded - head) % cLeoPagesNeeded;
+    if(flush % cErrorRebootPeriod == 0u) {
+      ErrorFlashPartitioner::done();
+      ErrorFlashPartitioner::init();
+      for(uint32_t index = 0u; index < cErrorCounterCount; ++index) {
+        mismatchCount += (ErrorFlash::getErrorCount(getId(index)) == expected[index] ? 0u : 1u);
+      }
+    }
+    else { // nothing to do
+    }
+  }
+  std::cout << "leo error counters: " << cErrorFlushCount * cErrorIncrementsPerFlush << " increments on " << cErrorCounterCount << " ids in "
+            << cErrorFlushCount << " flushes, pages written: " << pageCount << ", mismatches: " << mismatchCount << '\n';
+  check(pageCount <= 2u * cErrorFlushCount, "error counter flushes write about a page each, as the increments are on a few ids");
+  check(mismatchCount == 0u, "error counters survive reboots");
+  ErrorFlashPartitioner::done();
+  FlashInterface::sVerbose = true;
+}
+
+/// Flushes all the error counters once in a while, and flushes log pages in between, enough to trim the sectors of
+/// the counters many times. Each reboot must restore every counter, even though only log pages were written since
+/// their last flush.
+void testLeoLogWithErrorCounters() {
+  FlashInterface::sVerbose = false;
+  FlashInterface::eraseAll();
+  LogErrorFlashPartitioner::init();
+  std::vector<uint32_t> expected(cErrorCounterCount, 0u);
+  auto const getId = [](uint32_t const aIndex){ return static_cast<uint16_t>(aIndex * 97u + 1u); };
+  uint32_t mismatchCount = 0u;
+  uint32_t trimCount = 0u;
+  for(uint32_t flush = 0u; flush < cLogErrorFlushCount; ++flush) {
+    if(flush % cLogErrorCountPeriod == 0u) {
+      for(uint32_t index = 0u; index < cErrorCounterCount; ++index) {
+        LogErrorFlash::countError(getId(index), index + 1u);
+        expected[index] += index + 1u;
+      }
+      LogErrorFlash::flushErrorCounters();
+    }
+    else { // nothing to do
+    }
+    uint8_t entry[cLogEntrySize] = {};
+    std::memcpy(entry, &flush, sizeof(flush));
+    LogErrorFlash::log(entry);
+    uint32_t const start = LogErrorFlash::getLeoStartPage();
+    LogErrorFlash::flushLog(flush, true);
+    trimCount += (LogErrorFlash::getLeoStartPage() != start ? 1u : 0u);
+    if(flush % cLogErrorRebootPeriod == cLogErrorRebootPeriod - 1u) {
+      LogErrorFlashPartitioner::done();
+      LogErrorFlashPartitioner::init();
+      for(uint32_t index = 0u; index < cErrorCounterCount; ++index) {
+        mismatchCount += (LogErrorFlash::getErrorCount(getId(index)) == expected[index] ? 0u : 1u);
+      }
+    }
+    else { // nothing to do
+    }
+  }
+  std::cout << "leo log with error counters: " << cLogErrorFlushCount << " log flushes, trims: " << trimCount << ", mismatches: " << mismatchCount << '\n';
+  check(trimCount * FlashInterface::getSectorSizeInPages() >= cLogErrorFlushCount - cLeoMaxCount, "log flushes trim the series a sector at a time");
+  check(mismatchCount == 0u, "error counters survive log flushes trimming their sectors");
+  LogErrorFlashPartitioner::done();
+  FlashInterface::sVerbose = true;
+}
+
+/// Ticks the on-time counter in flash which only clears bits when writing, with reboots and a jump by setOnTime.
+void testLeoOnTimeTicks() {
+  FlashInterface::sVerbose = false;
+  FlashInterface::sNorOnly = true;
+  FlashInterface::sNorViolationCount = 0u;
+  FlashInterface::eraseAll();
+  TickFlashPartitioner::init();
+  uint32_t expected = 0u;
+  uint32_t mismatchCount = 0u;
+  for(uint32_t tick = 1u; tick <= cOnTimeTickCount; ++tick) {
+    if(tick == cOnTimeTickCount / 2u) {
+      expected += cOnTimeJump;
+      TickFlash::setOnTime(expected);
+    }
+    else { // nothing to do
+    }
+    TickFlash::tickOnTime();
+    ++expected;
+    if(tick % cOnTimeRebootPeriod == 0u) {
+      TickFlashPartitioner::done();
+      TickFlashPartitioner::init();
+      mismatchCount += (TickFlash::getOnTime() == expected ? 0u : 1u);
+    }
+    else { // nothing to do
+    }
+  }
+  std::cout << "leo on-time ticks: " << cOnTimeTickCount << " ticks in " << TickFlash::getLeoPageCount() << " pages, NOR violations: "
+            << FlashInterface::sNorViolationCount << ", mismatches: " << mismatchCount << '\n';
+  uint32_t const ticksPerPage = cOnTimeTickBytes * 8u + 1u; // the first one starts the page
+  auto const getPageCount = [ticksPerPage](uint32_t const aTickCount){ return (aTickCount + ticksPerPage - 1u) / ticksPerPage; };
+  check(FlashInterface::sNorViolationCount == 0u, "on-time ticks only clear bits");
+  check(mismatchCount == 0u, "on-time ticks survive reboots");
+  check(TickFlash::getLeoPageCount() == getPageCount(cOnTimeTickCount / 2u - 1u) + getPageCount(cOnTimeTickCount / 2u + 1u), "on-time ticks fill their pages, and reboots continue the last one");
+  TickFlashPartitioner::done();
+  FlashInterface::sNorOnly = false;
+  FlashInterface::sVerbose = true;
+}
+
 int main() {
   FlashInterface::init();
   DebugFlashPartitioner::init();
   testConfig1(); 
   DebugFlashPartitioner::done();
+  testConcurrency();
+  testMultiSectorCommit();
+  testTornMultiSectorCommit();
+  testJournal();
+  testAlternating();
+  testArena();
+  testSchema();
+  testConfigMapped();
+  testLazyBoot();
+  testPacking();
+  testPlacement();
+  testLongtermBulk();
+  testBulkIndex();
+  testBulkCompression();
+  testLeoDiscovery();
+  testLeoLog();
+  testLeoErrorCounters();
+  testLeoLogWithErrorCounters();
+  testLeoOnTimeTicks();
   FlashInterface::done();
+  return sFailureCount == 0u ? 0 : 1;
 }
@@ -0,0 +1,241 @@
+#include "FlashPartitioner.h"
+#include "FlashConfig.h"
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <numeric>
+#include <algorithm>
+
+// Timing model of a W25Q128JV-like flash with typical datasheet values. The time the CPU spends in the driver between
+// two flash calls is measured on the host and scaled by cCpuSlowdown to approximate a microcontroller.
+class TimedFlash {
+public:
+  static constexpr uint32_t cPageSizeInBytes     =   256u;
+  static constexpr uint32_t cSectorSizeInPages   =    16u;
+  static constexpr uint32_t cFlashSizeInPages    = 65536u;
+  static constexpr uint32_t cSectorSizeInBytes   = cPageSizeInBytes * cSectorSizeInPages;
+  static constexpr double   cEraseSectorUs       = 45000.0;
+  static constexpr double   cWritePageUs         =   400.0;
+  static constexpr double   cReadPageUs          =    20.0;
+  static constexpr double   cPollUs              =     1.0;
+  static constexpr double   cCpuSlowdown         =    50.0;
+
+  static uint8_t* sMemoryFlash;
+  static double   sNowUs;
+  static double   sBusyUntilUs;
+  static double   sDeviceUs;
+  static double   sCpuUs;
+  static std::chrono::steady_clock::time_point sLastExit;
+
+  static void init() {
+    sMemoryFlash = new uint8_t[cPageSizeInBytes * cFlashSizeInPages];
+    std::fill_n(sMemoryFlash, cPageSizeInBytes * cFlashSizeInPages, 0xffu);
+  }
+
+  static void done() {
+    delete[] sMemoryFlash;
+  }
+
+  static void startClock() {
+    sNowUs = sBusyUntilUs = sDeviceUs = sCpuUs = 0.0;
+    sLastExit = std::chrono::steady_clock::now();
+  }
+
+  static void stopClock() {
+    enter();
+    sNowUs = std::max(sNowUs, sBusyUntilUs);
+  }
+
+  static constexpr uint32_t getPageSizeInBytes() noexcept {
+    return cPageSizeInBytes;
+  }
+
+  static constexpr uint32_t getSectorSizeInPages() noexcept {
+    return cSectorSizeInPages;
+  }
+
+  static constexpr uint32_t getFlashSizeInPages() noexcept {
+    return cFlashSizeInPages;
+  }
+
+  static void badAlloc() {
+    std::cout << "bad alloc\n";
+  }
+
+  static void fatalError(nowtech::memory::FlashException const aException) {
+    std::cout << "fatal error: " << static_cast<uint32_t>(aException) << '\n';
+  }
+
+  template<typename tClass, typename ...tParameters>
+  static tClass* _new(tParameters... aParameters) {
+    return new tClass(aParameters...);
+  }
+
+  template<typename tClass>
+  static tClass* _newArray(uint32_t const aCount) {
+    return new tClass[aCount];
+  }
+
+  template<typename tClass>
+  static void _delete(tClass* aPointer) {
+    delete aPointer;
+  }
+
+  template<typename tClass>
+  static void _deleteArray(tClass* aPointer) {
+    delete[] aPointer;
+  }
+
+  static nowtech::memory::SpiResult eraseSector(uint32_t const aSector) noexcept {
+    auto result = startEraseSector(aSector);
+    sNowUs = sBusyUntilUs;
+    exit();
+    return result;
+  }
+
+  static nowtech::memory::SpiResult writePage(uint32_t const aPage, uint8_t const * const aData) noexcept {
+    auto result = startWritePage(aPage, aData);
+    sNowUs = sBusyUntilUs;
+    exit();
+    return result;
+  }
+
+  static nowtech::memory::SpiResult readPages(uint32_t const aStartPage, uint32_t const aPageCount, uint8_t * const aData) noexcept {
+    enter();
+    auto result = checkIdle();
+    if(result == nowtech::memory::SpiResult::cOk) {
+      std::copy_n(sMemoryFlash + aStartPage * cPageSizeInBytes, cPageSizeInBytes * aPageCount, aData);
+      occupy(cReadPageUs * aPageCount);
+      sNowUs = sBusyUntilUs;
+    }
+    else { // nothing to do
+    }
+    exit();
+    return result;
+  }
+
+protected:
+  static nowtech::memory::SpiResult startEraseSector(uint32_t const aSector) noexcept {
+    enter();
+    auto result = checkIdle();
+    if(result == nowtech::memory::SpiResult::cOk) {
+      std::fill_n(sMemoryFlash + aSector * cSectorSizeInBytes, cSectorSizeInBytes, 0xffu);
+      occupy(cEraseSectorUs);
+    }
+    else { // nothing to do
+    }
+    exit();
+    return result;
+  }
+
+  static nowtech::memory::SpiResult startWritePage(uint32_t const aPage, uint8_t const * const aData) noexcept {
+    enter();
+    auto result = checkIdle();
+    if(result == nowtech::memory::SpiResult::cOk) {
+      std::copy_n(aData, cPageSizeInBytes, sMemoryFlash + aPage * cPageSizeInBytes);
+      occupy(cWritePageUs);
+    }
+    else { // nothing to do
+    }
+    exit();
+    return result;
+  }
+
+  static nowtech::memory::SpiResult pollBusy() noexcept {
+    enter();
+    sNowUs += cPollUs;
+    auto result = (sNowUs < sBusyUntilUs ? nowtech::memory::SpiResult::cBusy : nowtech::memory::SpiResult::cOk);
+    if(result == nowtech::memory::SpiResult::cBusy) {
+      sNowUs = std::min(sBusyUntilUs, sNowUs + cPollUs * 100.0); // the driver would sleep between polls
+    }
+    else { // nothing to do
+    }
+    exit();
+    return result;
+  }
+
+private:
+  static void enter() {
+    double const cpuUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - sLastExit).count() * cCpuSlowdown;
+    sCpuUs += cpuUs;
+    sNowUs += cpuUs;
+  }
+
+  static void exit() {
+    sLastExit = std::chrono::steady_clock::now();
+  }
+
+  static nowtech::memory::SpiResult checkIdle() {
+    return sNowUs < sBusyUntilUs ? nowtech::memory::SpiResult::cBusy : nowtech::memory::SpiResult::cOk;
+  }
+
+  static void occupy(double const aDurationUs) {
+    sBusyUntilUs = sNowUs + aDurationUs;
+    sDeviceUs += aDurationUs;
+  }
+};
+
+uint8_t* TimedFlash::sMemoryFlash;
+double   TimedFlash::sNowUs;
+double   TimedFlash::sBusyUntilUs;
+double   TimedFlash::sDeviceUs;
+double   TimedFlash::sCpuUs;
+std::chrono::steady_clock::time_point TimedFlash::sLastExit;
+
+class BlockingInterface final : public TimedFlash {
+};
+
+class NonBlockingInterface final : public TimedFlash {
+public:
+  using TimedFlash::startEraseSector;
+  using TimedFlash::startWritePage;
+  using TimedFlash::pollBusy;
+};
+
+constexpr nowtech::memory::FlashCopies cCopies               = nowtech::memory::FlashCopies::c2;
+constexpr uint32_t                     cPagesNeeded          =  512u;
+constexpr uint32_t                     cReadAheadSizeInPages =   32u;
+constexpr uint32_t                     cMaxItemCount         = 3000u;
+constexpr uint32_t                     cValueBufferSize      =    8u;
+constexpr uint32_t                     cItemCount            = 2500u;
+
+template<typename tInterface>
+class Scenario final {
+  typedef nowtech::memory::FlashConfig<tInterface, cPagesNeeded, cCopies, cReadAheadSizeInPages, cMaxItemCount, cValueBufferSize> Config;
+  typedef nowtech::memory::FlashPartitioner<tInterface, Config>                                                                   Partitioner;
+
+public:
+  static double run(uint32_t const aStride) {
+    uint8_t value[32];
+    std::iota(value, value + sizeof(value), 0u);
+    tInterface::init();
+    Partitioner::init();
+    for(uint32_t i = 0u; i < cItemCount; ++i) {
+      Config::addConfig(value, 1u + i % 13u);
+    }
+    Config::commit();
+    value[0] = 0xa5u;
+    tInterface::startClock();
+    for(uint32_t i = 0u; i < cItemCount; i += aStride) {
+      Config::setConfig(i, value);
+    }
+    Config::commit();
+    tInterface::stopClock();
+    Partitioner::done();
+    tInterface::done();
+    return tInterface::sNowUs;
+  }
+};
+
+int main() {
+  std::cout << "commit of 2 copies, " << cItemCount << " items, simulated wall clock in ms\n";
+  std::cout << "changed items  blocking  non-blocking  device busy\n";
+  for(uint32_t stride : {cItemCount, 500u, 100u, 20u, 1u}) {
+    double const blocking = Scenario<BlockingInterface>::run(stride);
+    double const device = TimedFlash::sDeviceUs;
+    double const nonBlocking = Scenario<NonBlockingInterface>::run(stride);
+    std::cout << std::setw(13) << (cItemCount + stride - 1u) / stride << std::fixed << std::setprecision(2) << std::setw(10) << blocking / 1000.0
+              << std::setw(14) << nonBlocking / 1000.0 << std::setw(13) << device / 1000.0 << '\n';
+  }
+  return 0;
+}
@@ -0,0 +1,174 @@
+#include<algorithm>
+#include<iostream>
+#include<numeric>
+#include<iomanip>
+#include<vector>
+#include<string>
+#include<cstdint>
+#include<cstring>
+
+// Compares probe orders for finding the LEO set in a load-balancing partition of B pages. A LEO set of length L
+// is surely hit after k probes if the largest unprobed circular interval is shorter than L. At least ceil(B / L)
+// probes are needed for that, and the worst ratio to it over all L scores an order.
+
+struct Score {
+  std::vector<uint32_t> mProbesNeeded; // index: LEO length
+  double                mWorstRatio;
+  double                mMeanRatio;
+};
+
+// Removes the probes in reverse order, so each removal merges two neighbouring intervals in a linked list, and the
+// largest interval after k probes follows in O(B).
+Score score(std::vector<uint32_t> const &aOrder) {
+  uint32_t const length = aOrder.size();
+  std::vector<uint32_t> previous(length);
+  std::vector<uint32_t> next(length);
+  for(uint32_t i = 0u; i < length; ++i) {
+    previous[i] = (i + length - 1u) % length;
+    next[i] = (i + 1u) % length;
+  }
+  std::vector<uint32_t> maxGaps(length + 1u, 0u);
+  maxGaps[0u] = length;
+  uint32_t maxGap = 0u;
+  for(uint32_t k = length - 1u; k > 0u; --k) {
+    uint32_t const page = aOrder[k];
+    next[previous[page]] = next[page];
+    previous[next[page]] = previous[page];
+    maxGap = std::max(maxGap, (next[page] + length - previous[page] - 1u) % length);
+    maxGaps[k] = maxGap;
+  }
+  Score result { std::vector<uint32_t>(length + 1u, 0u), 0.0, 0.0 };
+  uint32_t k = 0u;
+  for(uint32_t leo = length; leo > 0u; --leo) {
+    while(maxGaps[k] >= leo) {
+      ++k;
+    }
+    result.mProbesNeeded[leo] = k;
+    double const ratio = static_cast<double>(k) / ((length + leo - 1u) / leo);
+    result.mWorstRatio = std::max(result.mWorstRatio, ratio);
+    result.mMeanRatio += ratio / length;
+  }
+  return result;
+}
+
+std::vector<uint32_t> makeStride(uint32_t const aLength, uint32_t const aDisplacement) {
+  std::vector<uint32_t> result(aLength);
+  uint32_t where = 0u;
+  for(uint32_t i = 0u; i < aLength; ++i) {
+    result[i] = where;
+    where = (where + aDisplacement) % aLength;
+  }
+  return result;
+}
+
+// Van der Corput order: the bit-reversed indices of the next power of 2, skipping the ones beyond the partition.
+std::vector<uint32_t> makeBitReversed(uint32_t const aLength) {
+  uint32_t bits = 0u;
+  while((1u << bits) < aLength) {
+    ++bits;
+  }
+  std::vector<uint32_t> result;
+  for(uint32_t i = 0u; i < (1u << bits); ++i) {
+    uint32_t reversed = 0u;
+    for(uint32_t bit = 0u; bit < bits; ++bit) {
+      reversed |= ((i >> bit) & 1u) << (bits - 1u - bit);
+    }
+    if(reversed < aLength) {
+      result.push_back(reversed);
+    }
+    else { // nothing to do
+    }
+  }
+  return result;
+}
+
+// The heuristic of the README, the same as FlashLoadBalancing::calculateGoldenRatioDisplacement.
+uint32_t findGoldenRatio(uint32_t const aLength) {
+  uint32_t result = 1u;
+  uint64_t bestValue = UINT64_MAX;
+  for(uint32_t d = aLength / 3u + 1u; 2u * d < aLength; ++d) {
+    if(std::gcd(d, aLength) == 1u) {
+      int64_t const m = aLength % d;
+      int64_t const n = std::min<int64_t>(m, d - m);
+      int64_t const signedValue = static_cast<int64_t>(d) * d - 3 * n * d + n * n;
+      uint64_t const value = static_cast<uint64_t>(signedValue < 0 ? -signedValue : signedValue);
+      if(value < bestValue) {
+        bestValue = value;
+        result = d;
+      }
+      else { // nothing to do
+      }
+    }
+    else { // nothing to do
+    }
+  }
+  return result;
+}
+
+// d and B - d give mirrored orders, so d <= B / 2 is enough.
+uint32_t findExhaustive(uint32_t const aLength) {
+  uint32_t result = 1u;
+  double bestWorst = 1e9;
+  double bestMean = 1e9;
+  for(uint32_t d = 1u; 2u * d <= aLength; ++d) {
+    if(std::gcd(d, aLength) == 1u) {
+      Score const candidate = score(makeStride(aLength, d));
+      if(candidate.mWorstRatio < bestWorst || (candidate.mWorstRatio == bestWorst && candidate.mMeanRatio < bestMean)) {
+        bestWorst = candidate.mWorstRatio;
+        bestMean = candidate.mMeanRatio;
+        result = d;
+      }
+      else { // nothing to do
+      }
+    }
+    else { // nothing to do
+    }
+  }
+  return result;
+}
+
+void print(char const * const aName, uint32_t const aLength, Score const &aScore) {
+  std::cout << std::setw(20) << aName << std::fixed << std::setprecision(3) << std::setw(8) << aScore.mWorstRatio << std::setw(8) << aScore.mMeanRatio;
+  for(uint32_t leo = 1u; leo <= aLength; leo *= 4u) {
+    std::cout << std::setw(8) << aScore.mProbesNeeded[leo];
+  }
+  std::cout << '\n';
+}
+
+int main(int argc, char **argv) {
+  int ret;
+  bool const table = (argc > 1 && std::strcmp(argv[1], "--table") == 0);
+  int const first = (table ? 2 : 1);
+  if(argc > first) {
+    std::vector<std::pair<uint32_t, uint32_t>> displacements;
+    for(int i = first; i < argc; ++i) {
+      uint32_t const length = std::stoul(argv[i]);
+      uint32_t const exhaustive = findExhaustive(length);
+      displacements.emplace_back(length, exhaustive);
+      if(!table) {
+        uint32_t const golden = findGoldenRatio(length);
+        std::cout << "partition " << length << ", probes needed for LEO length:\n" << std::setw(20) << "order" << std::setw(8) << "worst" << std::setw(8) << "mean";
+        for(uint32_t leo = 1u; leo <= length; leo *= 4u) {
+          std::cout << std::setw(8) << leo;
+        }
+        std::cout << '\n';
+        print(("golden d=" + std::to_string(golden)).c_str(), length, score(makeStride(length, golden)));
+        print(("exhaustive d=" + std::to_string(exhaustive)).c_str(), length, score(makeStride(length, exhaustive)));
+        print("van der Corput", length, score(makeBitReversed(length)));
+      }
+      else { // nothing to do
+      }
+    }
+    std::cout << "inline constexpr uint32_t cProbeDisplacements[][2] = {";
+    for(uint32_t i = 0u; i < displacements.size(); ++i) {
+      std::cout << (i == 0u ? " " : ", ") << "{ " << displacements[i].first << "u, " << displacements[i].second << "u }";
+    }
+    std::cout << " };\n";
+    ret = 0;
+  }
+  else {
+    std::cerr << "Usage: " << argv[0] << " [--table] [length of partition]...\n";
+    ret = 1;
+  }
+  return ret;
+}